@@ -1,9 +1,11 @@
 #include "app.h"
-#include "raycaster.h"
+#include "ray_packet.h"
 
 #include <glad/glad.h>
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
+#include <utility>
 
 namespace
 {
@@ -21,10 +23,35 @@ void print_gl_info()
     std::printf("GLSL        : %s\n", safe_str(GL_SHADING_LANGUAGE_VERSION));
 }
 
+const char *traversal_name(const RayTraversal traversal)
+{
+    switch (traversal)
+    {
+    case RayTraversal::Dda: return "dda";
+    case RayTraversal::Reference: return "reference";
+    case RayTraversal::Fixed: return "fixed point";
+    }
+    return "?";
+}
+
+const char *upload_mode_name(const UploadMode mode)
+{
+    switch (mode)
+    {
+    case UploadMode::BufferData: return "glBufferData";
+    case UploadMode::MapRange: return "map range";
+    case UploadMode::Persistent: return "persistent";
+    }
+    return "?";
+}
+
 } // namespace
 
 App::~App()
 {
+    pipeline_.reset();
+    frame_capture_.reset();
+    gpu_timer_.reset();
     renderer_.reset();
 
     if (gl_ctx_)
@@ -35,8 +62,21 @@ App::~App()
     SDL_Quit();
 }
 
-bool App::init()
+bool App::init(const char *map_path, const RenderBackend backend)
 {
+    backend_ = backend;
+    if (map_path)
+    {
+        auto loaded = Map::load(map_path);
+        if (!loaded)
+            return false;
+        map_ = std::move(*loaded);
+        std::printf("Map %s: %dx%d\n", map_path, map_.width(), map_.height());
+    }
+    player_.spawn(map_.spawn_x(), map_.spawn_y(), map_.spawn_angle());
+    entities_.reset(map_);
+    entities_.scatter(map_, kDefaultEntities, 1);
+
     if (!SDL_Init(SDL_INIT_VIDEO))
     {
         std::fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
@@ -84,28 +124,110 @@ bool App::init()
 
     renderer_ = std::make_unique<Renderer2D>();
     renderer_->init();
+    minimap_layer_ = renderer_->create_layer();
+    renderer_->set_wall_textures(wall_textures_);
+    gpu_timer_ = std::make_unique<GpuTimer>();
+    gpu_timer_->init();
+    for (FramePacket &p : packets_)
+    {
+        p.software.set_wall_textures(&wall_textures_);
+        p.software.set_clear_color(pack_rgba(0.3f, 0.3f, 0.3f));
+    }
+    if (backend_ == RenderBackend::Software)
+        std::printf("Renderer: software framebuffer\n");
+    std::printf("Vertex upload: %s\n",
+                upload_mode_name(renderer_->persistent_supported() ? UploadMode::Persistent
+                                                                    : UploadMode::MapRange));
 
     perf_freq_ = static_cast<double>(SDL_GetPerformanceFrequency());
     last_counter_ = SDL_GetPerformanceCounter();
 
     print_gl_info();
 
+    prev_player_ = player_;
+    pipeline_ = std::make_unique<FramePipeline>([this](const int slot) {
+        build_frame(packets_[static_cast<std::size_t>(slot)]);
+    });
     running_ = true;
     return true;
 }
 
+void App::record_input(const char *path)
+{
+    record_path_ = path;
+    input_log_ = InputLog{};
+    input_log_.set_map(map_.width(), map_.height(), map_.spawn_x(), map_.spawn_y(), map_.spawn_angle());
+}
+
+bool App::replay_input(const char *path)
+{
+    auto loaded = InputLog::load(path);
+    if (!loaded)
+        return false;
+    if (!loaded->matches_map(map_.width(), map_.height(), map_.spawn_x(), map_.spawn_y(), map_.spawn_angle()))
+        return false;
+    if (loaded->frames() == 0)
+    {
+        std::fprintf(stderr, "%s: no frames to replay\n", path);
+        return false;
+    }
+
+    input_log_ = std::move(*loaded);
+    replaying_ = true;
+    replay_frame_ = 0;
+    replay_retired_ = 0;
+    // Frame times should show the work, not the display's refresh rate.
+    SDL_GL_SetSwapInterval(0);
+    std::printf("Replaying %d frames from %s\n", input_log_.frames(), path);
+    return true;
+}
+
+void App::set_ray_budget(const double budget_ms)
+{
+    governor_.set_budget(budget_ms);
+    auto_rays_ = true;
+    std::printf("Ray budget: %.1f ms\n", budget_ms);
+}
+
+bool App::capture_video(const char *path)
+{
+    if (!frame_writer_.open(path, kCaptureFps))
+        return false;
+    frame_capture_ = std::make_unique<FrameCapture>();
+    frame_capture_->init();
+    capture_path_ = path;
+    std::printf("Capturing to %s\n", path);
+    return true;
+}
+
+void App::spawn_entities(const int count)
+{
+    entities_.reset(map_);
+    entities_.scatter(map_, count, 1);
+    std::printf("Entities: %d\n", entities_.size());
+}
+
 void App::run()
 {
     while (running_)
     {
-        process_events();
+        profiler_.begin_frame();
+        {
+            const FrameProfiler::Scope timed{&profiler_, FrameStage::Events};
+            process_events();
+        }
 
         const Uint64 now = SDL_GetPerformanceCounter();
         const auto dt = static_cast<float>(
             static_cast<double>(now - last_counter_) / perf_freq_);
         last_counter_ = now;
 
-        update(dt);
+        {
+            const FrameProfiler::Scope timed{&profiler_, FrameStage::Update};
+            update(dt);
+        }
+        if (!running_)
+            break;
 
         if (show_fps_)
         {
@@ -117,15 +239,64 @@ void App::run()
                 fps_accum_ = 0.0;
                 fps_frames_ = 0;
 
+                const FrameProfiler::Stats stats = profiler_.stats();
                 char title[256];
-                std::snprintf(title, sizeof(title), "%s | FPS: %.1f", kTitle, fps);
+                std::snprintf(title, sizeof(title), "%s | FPS: %.1f | p50/p99 %.1f/%.1f ms | %d rays%s | %s %.1f KiB/frame",
+                              kTitle, fps, stats.total.p50, stats.total.p99, shown_rays_, auto_rays_ ? " (auto)" : "",
+                              upload_mode_name(renderer_->upload_mode()),
+                              static_cast<double>(renderer_->uploaded_bytes()) / 1024.0);
                 SDL_SetWindowTitle(window_, title);
             }
         }
 
-        render();
-        SDL_GL_SwapWindow(window_);
+        // The frame posted last time, cast while this one was sampled.
+        const bool draining = replaying_ && replay_frame_ == input_log_.frames();
+        int slot = -1;
+        {
+            const FrameProfiler::Scope timed{&profiler_, FrameStage::Wait};
+            slot = pipeline_->take(draining);
+        }
+        if (slot < 0 && draining)
+        {
+            finish_replay();
+            break;
+        }
+        if (slot >= 0)
+        {
+            FramePacket &p = packets_[static_cast<std::size_t>(slot)];
+            render(p);
+            if (frame_capture_)
+            {
+                const FrameProfiler::Scope timed{&profiler_, FrameStage::Capture};
+                frame_capture_->capture(frame_writer_, p.fb_w, p.fb_h);
+            }
+            retire_frame(p);
+            pipeline_->release();
+        }
+        else
+            glClear(GL_COLOR_BUFFER_BIT);
+
+        {
+            const FrameProfiler::Scope timed{&profiler_, FrameStage::Swap};
+            SDL_GL_SwapWindow(window_);
+        }
+        profiler_.end_frame();
+        govern_rays();
+
+        if (profiler_.spikes() != reported_spikes_)
+        {
+            reported_spikes_ = profiler_.spikes();
+            const FrameProfiler::Spike &spike = profiler_.last_spike();
+            if (show_fps_ || show_profiler_)
+                std::printf("frame %llu: %.1f ms (median %.1f), %s +%.1f ms\n",
+                            static_cast<unsigned long long>(spike.index), spike.total_ms, spike.median_ms,
+                            frame_stage_name(spike.stage), spike.excess_ms);
+        }
     }
+
+    finish_capture();
+    if (!record_path_.empty() && input_log_.save(record_path_))
+        std::printf("Recorded %d frames to %s\n", input_log_.frames(), record_path_.c_str());
 }
 
 void App::process_events()
@@ -157,7 +328,16 @@ void App::process_events()
 
 void App::update(float dt)
 {
-    input_.update();
+    if (replaying_ && replay_frame_ == input_log_.frames())
+        return; // only frames in flight left
+    if (replaying_)
+    {
+        // The log's dt, not the wall clock, so the camera retraces the run.
+        dt = input_log_.dt(replay_frame_);
+        input_.update(input_log_.keys(replay_frame_));
+    }
+    else
+        input_.update();
 
     if (input_.pressed(SDL_SCANCODE_ESCAPE))
     {
@@ -172,40 +352,373 @@ void App::update(float dt)
             SDL_SetWindowTitle(window_, kTitle);
     }
 
+    if (input_.pressed(SDL_SCANCODE_G))
+    {
+        show_profiler_ = !show_profiler_;
+        profile_stats_ = profiler_.stats();
+    }
+
+    if (input_.pressed(SDL_SCANCODE_F9))
+        export_profile();
+
+    if (input_.pressed(SDL_SCANCODE_R))
+    {
+        traversal_ = traversal_ == RayTraversal::Dda         ? RayTraversal::Reference
+                     : traversal_ == RayTraversal::Reference ? RayTraversal::Fixed
+                                                             : RayTraversal::Dda;
+        std::printf("ray traversal: %s\n", traversal_name(traversal_));
+    }
+
+    if (input_.pressed(SDL_SCANCODE_P))
+    {
+        simd_ = simd_ == SimdMode::Auto ? SimdMode::Scalar : SimdMode::Auto;
+        std::printf("ray packets: %s\n", simd_mode_name(resolve_simd_mode(simd_)));
+    }
+
+    if (input_.pressed(SDL_SCANCODE_E))
+    {
+        skip_empty_ = !skip_empty_;
+        std::printf("empty-space skipping: %s\n", skip_empty_ ? "on" : "off");
+    }
+
+    if (input_.pressed(SDL_SCANCODE_T))
+    {
+        cast_threads_ = cast_threads_ >= ThreadPool::hardware_threads() ? 1 : cast_threads_ * 2;
+        cast_threads_ = std::min(cast_threads_, ThreadPool::hardware_threads());
+        std::printf("cast threads: %d\n", cast_threads_);
+    }
+
+    if (input_.pressed(SDL_SCANCODE_U))
+    {
+        // Persistent -> map range -> glBufferData -> persistent.
+        upload_mode_ = upload_mode_ == UploadMode::Persistent ? UploadMode::MapRange
+                       : upload_mode_ == UploadMode::MapRange ? UploadMode::BufferData
+                                                              : UploadMode::Persistent;
+        renderer_->set_upload_mode(upload_mode_);
+        std::printf("vertex upload: %s\n", upload_mode_name(upload_mode_));
+    }
+
+    if (input_.pressed(SDL_SCANCODE_I))
+    {
+        instanced_columns_ = !instanced_columns_;
+        renderer_->set_instanced_columns(instanced_columns_);
+        std::printf("instanced columns: %s\n", instanced_columns_ ? "on" : "off");
+    }
+
+    if (input_.pressed(SDL_SCANCODE_X))
+    {
+        textured_ = !textured_;
+        std::printf("wall textures: %s\n", textured_ ? "on" : "off");
+    }
+
+    if (input_.pressed(SDL_SCANCODE_M))
+    {
+        merge_walls_ = !merge_walls_;
+        std::printf("wall merging: %s\n", merge_walls_ ? "on" : "off");
+    }
+
+    if (input_.pressed(SDL_SCANCODE_F))
+    {
+        textured_floors_ = !textured_floors_;
+        std::printf("floor casting: %s\n", textured_floors_ ? "on" : "off");
+    }
+
+    if (input_.pressed(SDL_SCANCODE_H))
+    {
+        reuse_hits_ = !reuse_hits_;
+        std::printf("hit reuse: %s\n", reuse_hits_ ? "on" : "off");
+    }
+
+    if (input_.pressed(SDL_SCANCODE_B))
+    {
+        auto_rays_ = !auto_rays_;
+        governor_.reset();
+        std::printf("ray budget: %s (%.1f ms)\n", auto_rays_ ? "on" : "off", governor_.budget_ms());
+    }
+
     if (input_.pressed(SDL_SCANCODE_L))
     {
+        auto_rays_ = false;
         const int step = num_rays_ < 6 ? 1 : num_rays_ < 51 ? 5 : 50;
         num_rays_ = std::clamp(num_rays_ + step, 1, 5000);
     }
     if (input_.pressed(SDL_SCANCODE_K))
     {
+        auto_rays_ = false;
         const int step = num_rays_ <= 6 ? 1 : num_rays_ <= 51 ? 5 : 50;
         num_rays_ = std::clamp(num_rays_ - step, 1, 5000);
     }
 
-    player_.update(input_, dt);
+    post_frame(dt);
 }
 
-void App::render() const
+// Hands the frame's input and options to the cast thread.
+void App::post_frame(const float dt)
 {
-    glClear(GL_COLOR_BUFFER_BIT);
-    renderer_->begin_frame(fb_w_, fb_h_);
+    FramePacket &p = packets_[static_cast<std::size_t>(pipeline_->begin_submit())];
+    p.dt = dt;
+    p.input = input_;
+    p.opts = CastOptions{num_rays_, !fullscreen_, traversal_, simd_, cast_threads_, skip_empty_};
+    p.opts.textured = textured_;
+    p.opts.reuse_hits = reuse_hits_;
+    p.opts.textured_floors = textured_floors_;
+    p.opts.merge_walls = merge_walls_;
+    p.fb_w = fb_w_;
+    p.fb_h = fb_h_;
+    p.fullscreen = fullscreen_;
+    p.log_frame = replaying_ ? replay_frame_++ : -1;
+    pipeline_->submit();
+}
+
+void App::build_frame(FramePacket &p)
+{
+    p.times.clear();
+
+    edit_map(p.input);
+    tick_accum_ = std::min(tick_accum_ + p.dt, static_cast<double>(kMaxTicks * kTick));
+    while (tick_accum_ >= kTick)
+    {
+        prev_player_ = player_;
+        player_.update(p.input, kTick);
+        map_.step_doors(kTick);
+        tick_accum_ -= kTick;
+    }
+    const Player camera = Player::lerp(prev_player_, player_, static_cast<float>(tick_accum_ / kTick));
+    p.pose = {camera.x, camera.y, camera.angle};
+
+    if (backend_ == RenderBackend::Software)
+    {
+        p.software.resize(p.fb_w, p.fb_h);
+        p.software.clear();
+        if (!p.fullscreen)
+        {
+            const StageScope timed{&p.times, FrameStage::Batch};
+            draw_minimap(p.software, map_, p.fb_w, p.fb_h);
+        }
+        draw_scene(p.software, p, camera);
+        return;
+    }
+    p.minimap_changed = !p.fullscreen && minimap_outdated(p.fb_w, p.fb_h);
+    if (p.minimap_changed)
+    {
+        const StageScope timed{&p.times, FrameStage::Batch};
+        p.minimap.clear();
+        draw_minimap(p.minimap, map_, p.fb_w, p.fb_h);
+        minimap_w_ = p.fb_w;
+        minimap_h_ = p.fb_h;
+    }
+    p.draw.clear();
+    draw_scene(p.draw, p, camera);
+}
 
-    if (!fullscreen_)
+// Space opens or closes the door in the cell ahead, or hangs a shut one
+// in a plain wall there; C knocks the wall there down, or puts one up. Read from the frame's input, so replays make
+// the same edits.
+void App::edit_map(const Input &input)
+{
+    const bool toggle = input.pressed(SDL_SCANCODE_SPACE);
+    const bool carve = input.pressed(SDL_SCANCODE_C);
+    if (!toggle && !carve)
+        return;
+
+    const auto cell = static_cast<float>(Map::kCellSize);
+    const auto mx = static_cast<int>(std::floor(player_.x / cell + player_.dx));
+    const auto my = static_cast<int>(std::floor(player_.y / cell + player_.dy));
+    if (toggle && map_.toggle_door(mx, my))
+        std::printf("door %d,%d: %s\n", mx, my, map_.door(mx, my)->moving > 0 ? "opening" : "closing");
+    else if (toggle && map_.is_wall(mx, my))
     {
-        draw_minimap(*renderer_);
-        draw_player_2d(*renderer_, player_);
+        map_.add_door(mx, my, map_.tile(mx, my));
+        if (map_.is_door(mx, my))
+            std::printf("door %d,%d: hung\n", mx, my);
+    }
+    if (carve)
+    {
+        map_.set_tile(mx, my, map_.is_wall(mx, my) ? 0 : kBuiltTile);
+        std::printf("cell %d,%d: %s\n", mx, my, map_.is_wall(mx, my) ? "wall" : "open");
+    }
+}
+
+// Takes in the edits since the last call either way.
+bool App::minimap_outdated(const int fb_w, const int fb_h)
+{
+    const std::uint64_t since = minimap_revision_;
+    minimap_revision_ = map_.revision();
+    if (fb_w != minimap_w_ || fb_h != minimap_h_)
+        return true;
+    if (since == minimap_revision_)
+        return false;
+
+    minimap_edits_.clear();
+    if (!map_.edited_since(since, minimap_edits_))
+        return true;
+    const MapRegion shown = minimap_cells(map_, fb_w, fb_h);
+    return std::ranges::any_of(minimap_edits_, [&](const MapRegion &r) {
+        return r.x0 < shown.x1 && shown.x0 < r.x1 && r.y0 < shown.y1 && shown.y0 < r.y1;
+    });
+}
+
+// Everything but the minimap, which each backend handles on its own.
+void App::draw_scene(RenderSink &sink, FramePacket &p, const Player &camera)
+{
+    CastOptions opts = p.opts;
+    opts.stage_times = &p.times;
+
+    if (!p.fullscreen)
+    {
+        {
+            const StageScope timed{&p.times, FrameStage::Batch};
+            draw_player_2d(sink, camera);
+        }
 
         constexpr Viewport view_win{};
-        cast_and_draw(*renderer_, player_, view_win, num_rays_, true);
+        raycaster_.cast_and_draw(sink, map_, camera, view_win, opts);
+        raycaster_.draw_sprites(sink, entities_, camera, view_win, opts);
     }
     else
     {
-        const Viewport view_full{0, 0, fb_w_, fb_h_};
-        cast_and_draw(*renderer_, player_, view_full, num_rays_, false);
+        const Viewport view_full{0, 0, p.fb_w, p.fb_h};
+        raycaster_.cast_and_draw(sink, map_, camera, view_full, opts);
+        raycaster_.draw_sprites(sink, entities_, camera, view_full, opts);
+    }
+}
+
+// Records or checks the pose the frame was drawn from, once it is on screen.
+void App::retire_frame(const FramePacket &p)
+{
+    shown_rays_ = p.opts.num_rays;
+    if (!record_path_.empty())
+    {
+        p.input.held_keys(held_keys_);
+        input_log_.add_frame(p.dt, held_keys_, p.pose);
+        return;
+    }
+    if (p.log_frame < 0)
+        return;
+
+    // Same build, same result; other builds or compilers may round differently.
+    const InputLog::Pose &want = input_log_.pose(p.log_frame);
+    if (!replay_diverged_
+        && (std::fabs(p.pose.x - want.x) > 1e-2f || std::fabs(p.pose.y - want.y) > 1e-2f
+            || std::fabs(p.pose.angle - want.angle) > 1e-2f))
+    {
+        replay_diverged_ = true;
+        std::printf("replay: camera left the recorded path at frame %d\n", p.log_frame);
+    }
+    ++replay_retired_;
+}
+
+// Costs the frame that just ended: Cast and Batch ran on the cast thread a
+// frame earlier, Submit here. The governor's settle frames cover that lag.
+void App::govern_rays()
+{
+    if (!auto_rays_)
+        return;
+    const FrameProfiler::Frame &f = profiler_.last_frame();
+    if (f.dur_ns[static_cast<std::size_t>(FrameStage::Cast)] == 0)
+        return; // nothing was drawn
+    const double cost_ms = f.ms(FrameStage::Cast) + f.ms(FrameStage::Batch) + f.ms(FrameStage::Submit);
+    num_rays_ = governor_.update(cost_ms, num_rays_, max_rays());
+}
+
+// One ray per pixel column of the 3D view; more only redraws columns.
+int App::max_rays() const noexcept
+{
+    return std::min(fullscreen_ ? fb_w_ : Viewport{}.w, 5000);
+}
+
+void App::finish_replay()
+{
+    std::printf("Replayed %d frames\n", replay_retired_);
+    export_profile();
+    running_ = false;
+}
+
+void App::finish_capture()
+{
+    if (!frame_capture_)
+        return;
+    frame_capture_->finish(frame_writer_);
+    if (frame_writer_.close())
+        std::printf("Captured %llu frames to %s (%llu skipped waiting on the GPU, %llu on the disk)\n",
+                    static_cast<unsigned long long>(frame_writer_.frames_written()), capture_path_.c_str(),
+                    static_cast<unsigned long long>(frame_capture_->frames_skipped()),
+                    static_cast<unsigned long long>(frame_writer_.frames_dropped()));
+    frame_capture_.reset();
+}
+
+void App::render(FramePacket &p)
+{
+    // Results from a few frames back; this frame's query is read later.
+    gpu_timer_->collect(profiler_);
+    gpu_timer_->begin(profiler_.frame_index());
+    glClear(GL_COLOR_BUFFER_BIT);
+    profiler_.add(p.times);
+
+    if (backend_ == RenderBackend::Software)
+    {
+        draw_profiler(p.software, p.fb_w, p.fb_h);
+        {
+            const FrameProfiler::Scope timed{&profiler_, FrameStage::Flush};
+            renderer_->present(p.software, p.fb_w, p.fb_h);
+        }
+        gpu_timer_->end();
+        return;
     }
 
-    renderer_->flush();
+    {
+        const FrameProfiler::Scope timed{&profiler_, FrameStage::Submit};
+        renderer_->begin_frame(p.fb_w, p.fb_h);
+        renderer_->set_layer_visible(minimap_layer_, !p.fullscreen);
+        if (p.minimap_changed)
+        {
+            renderer_->begin_layer(minimap_layer_);
+            renderer_->submit(p.minimap);
+            renderer_->end_layer();
+        }
+        renderer_->submit(p.draw);
+    }
+    draw_profiler(*renderer_, p.fb_w, p.fb_h);
+    {
+        const FrameProfiler::Scope timed{&profiler_, FrameStage::Flush};
+        renderer_->flush();
+    }
+    gpu_timer_->end();
+}
+
+// Bottom right, under the 3D view in windowed mode.
+void App::draw_profiler(RenderSink &sink, const int fb_w, const int fb_h)
+{
+    if (!show_profiler_)
+        return;
+
+    const FrameProfiler::Scope timed{&profiler_, FrameStage::Submit};
+    // Sorting the whole history every frame would show up in the graph.
+    if (profiler_.frame_index() % 16 == 0)
+        profile_stats_ = profiler_.stats();
+    profiler_.snapshot(profile_frames_, 160);
+
+    constexpr float kW = 480.0f;
+    constexpr float kH = 170.0f;
+    draw_profiler_overlay(sink, profile_frames_, profile_stats_,
+                          static_cast<float>(fb_w) - kW - 18.0f, static_cast<float>(fb_h) - kH - 10.0f, kW, kH);
+}
+
+void App::export_profile() const
+{
+    constexpr auto kTrace = "trydoom-trace.json";
+    constexpr auto kCsv = "trydoom-frames.csv";
+    if (profiler_.write_chrome_trace(kTrace) && profiler_.write_csv(kCsv))
+        std::printf("profile: wrote %s and %s\n", kTrace, kCsv);
+
+    const FrameProfiler::Stats stats = profiler_.stats();
+    std::printf("%-7s %8s %8s %8s  (%d frames)\n", "stage", "p50 ms", "p95 ms", "p99 ms", stats.frames);
+    for (int s = 0; s < FrameProfiler::kStages; ++s)
+    {
+        const FrameProfiler::Percentiles &p = stats.stage[static_cast<std::size_t>(s)];
+        std::printf("%-7s %8.3f %8.3f %8.3f\n", frame_stage_name(static_cast<FrameStage>(s)), p.p50, p.p95, p.p99);
+    }
+    std::printf("%-7s %8.3f %8.3f %8.3f\n", "frame", stats.total.p50, stats.total.p95, stats.total.p99);
 }
 
 void App::update_framebuffer_size()
@@ -224,4 +737,6 @@ void App::update_framebuffer_size()
     const auto flags = SDL_GetWindowFlags(window_);
     fullscreen_ = (flags & SDL_WINDOW_FULLSCREEN) != 0
                   || (flags & SDL_WINDOW_MAXIMIZED) != 0;
+    // The cost per ray changes with the view.
+    governor_.reset();
 }
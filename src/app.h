@@ -1,10 +1,53 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 #include <SDL3/SDL.h>
+#include "draw_list.h"
+#include "entities.h"
+#include "frame_capture.h"
+#include "frame_pipeline.h"
+#include "frame_profiler.h"
+#include "frame_writer.h"
+#include "gpu_timer.h"
 #include "renderer.h"
 #include "input.h"
+#include "input_log.h"
 #include "player.h"
+#include "map.h"
+#include "ray_governor.h"
+#include "raycaster.h"
+#include "software_framebuffer.h"
+
+// Who turns cast_and_draw output into pixels; chosen at startup.
+enum class RenderBackend
+{
+    Gl,       // Renderer2D batches
+    Software, // SoftwareFramebuffer, shown as one texture per frame
+};
+
+// One frame on its way from the cast thread to the GL thread. App::update
+// fills the inputs, App::build_frame the rest.
+struct FramePacket
+{
+    float dt = 0.0f;
+    Input input;
+    CastOptions opts;
+    int fb_w = 0;
+    int fb_h = 0;
+    bool fullscreen = false;
+    int log_frame = -1; // InputLog frame being replayed
+
+    InputLog::Pose pose; // camera the frame was cast from
+    StageTimes times;
+    DrawList draw;                // Gl backend
+    SoftwareFramebuffer software; // Software backend, minimap included
+    bool minimap_changed = false; // Gl backend: minimap holds the layer's new contents
+    DrawList minimap;
+};
 
 class App
 {
@@ -15,37 +58,127 @@ public:
     App(const App &) = delete;
     App &operator=(const App &) = delete;
 
-    [[nodiscard]] bool init();
+    // map_path may be null for the built-in level.
+    [[nodiscard]] bool init(const char *map_path = nullptr, RenderBackend backend = RenderBackend::Gl);
+    // Call between init and run. Recording writes every frame's held keys,
+    // dt and camera pose to path when run returns; a replay drives the
+    // session from such a log instead of the keyboard, unthrottled, then
+    // prints and exports the profile and quits.
+    void record_input(const char *path);
+    [[nodiscard]] bool replay_input(const char *path);
+    // Lets RayGovernor pick the ray count so cast, batch and submit stay
+    // within budget_ms per frame; B toggles it in game.
+    void set_ray_budget(double budget_ms);
+    // Streams every frame shown to path (.y4m, else a PPM sequence prefix)
+    // until run returns, read back without stalling the loop.
+    [[nodiscard]] bool capture_video(const char *path);
+    // Replaces the entities scattered at init with count others.
+    void spawn_entities(int count);
     void run();
 
 private:
     void process_events();
     void update(float dt);
-    void render() const;
+    void post_frame(float dt);
+    // Cast thread: simulation, ray casting and the frame's draw list.
+    void build_frame(FramePacket &p);
+    void edit_map(const Input &input);
+    [[nodiscard]] bool minimap_outdated(int fb_w, int fb_h);
+    void draw_scene(RenderSink &sink, FramePacket &p, const Player &camera);
+    void render(FramePacket &p);
+    void retire_frame(const FramePacket &p);
+    void finish_replay();
+    void finish_capture();
+    void govern_rays();
+    [[nodiscard]] int max_rays() const noexcept;
+    void draw_profiler(RenderSink &sink, int fb_w, int fb_h);
+    void export_profile() const;
     void update_framebuffer_size();
 
     SDL_Window *window_ = nullptr;
     SDL_GLContext gl_ctx_ = nullptr;
     std::unique_ptr<Renderer2D> renderer_;
+    std::unique_ptr<GpuTimer> gpu_timer_;
+    std::unique_ptr<FrameCapture> frame_capture_; // while capturing
+    FrameWriter frame_writer_;
+    std::string capture_path_;
+    RenderBackend backend_ = RenderBackend::Gl;
+    WallTextures wall_textures_;
+
+    // Created last and destroyed first: the cast thread reads everything
+    // from here down to the simulation state.
+    std::unique_ptr<FramePipeline> pipeline_;
+    std::array<FramePacket, FramePipeline::kSlots> packets_;
 
     Input input_;
+    InputLog input_log_;
+    std::string record_path_;
+    bool replaying_ = false;
+    int replay_frame_ = 0;
+    int replay_retired_ = 0;
+    bool replay_diverged_ = false;
+    std::vector<std::uint16_t> held_keys_;
+    Map map_;
+    Entities entities_;
+    static constexpr int kDefaultEntities = 24;
+
+    // Cast thread only, after init. The simulation runs in fixed ticks; the
+    // camera is drawn between the last two. Map edits happen here too.
+    Raycaster raycaster_;
     Player player_;
+    Player prev_player_;
+    double tick_accum_ = 0.0;
+    static constexpr float kTick = 1.0f / 120.0f;
+    static constexpr int kMaxTicks = 8; // per frame, after a stall
+    static constexpr std::uint8_t kBuiltTile = 1; // walls put up with C
+
+    // What the retained minimap layer was drawn for; it is redrawn when the
+    // frame's size differs or an edit lands on a cell it shows.
+    int minimap_w_ = 0;
+    int minimap_h_ = 0;
+    std::uint64_t minimap_revision_ = 0;
+    std::vector<MapRegion> minimap_edits_;
 
     int fb_w_ = 0;
     int fb_h_ = 0;
     bool fullscreen_ = false;
     bool running_ = false;
 
+    // Retained minimap tiles; the cast thread decides when to rebuild them.
+    int minimap_layer_ = -1;
+
     int num_rays_ = 1000;
+    int shown_rays_ = 1000; // num_rays of the frame on screen
+    bool auto_rays_ = false;
+    RayGovernor governor_;
+    RayTraversal traversal_ = kDefaultTraversal;
+    SimdMode simd_ = SimdMode::Auto;
+    int cast_threads_ = ThreadPool::hardware_threads();
+    bool skip_empty_ = true;
+    UploadMode upload_mode_ = UploadMode::Persistent;
+    bool instanced_columns_ = true;
+    bool textured_ = true;
+    bool reuse_hits_ = true;
+    bool textured_floors_ = true;
+    bool merge_walls_ = true;
 
     bool show_fps_ = false;
     int fps_frames_ = 0;
     double fps_accum_ = 0.0;
 
+    FrameProfiler profiler_;
+    bool show_profiler_ = false;
+    std::vector<FrameProfiler::Frame> profile_frames_;
+    FrameProfiler::Stats profile_stats_;
+    std::uint64_t reported_spikes_ = 0;
+
     Uint64 last_counter_ = 0;
     double perf_freq_ = 0.0;
 
     static constexpr int kWidth = 1024;
     static constexpr int kHeight = 510;
+    // Frame rate written into .y4m captures: the vsynced loop's, and that of
+    // the logs a replay retraces.
+    static constexpr int kCaptureFps = 60;
     static constexpr auto kTitle = "Wolf3D on GPU";
 };
@@ -0,0 +1,960 @@
+#include "raycaster.h"
+#include "camera_batch.h"
+#include "entities.h"
+#include "frame_profiler.h"
+#include "frame_writer.h"
+#include "input_log.h"
+#include "ray_governor.h"
+#include "ray_packet.h"
+#include "render_sink.h"
+#include "software_framebuffer.h"
+#include "thread_pool.h"
+#include "player.h"
+#include "map.h"
+#include "math_utils.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+struct RecordedQuad
+{
+    float x0, y0, x1, y1;
+    float r, g, b;
+};
+
+struct RecordedLine
+{
+    float x0, y0, x1, y1;
+    float r, g, b;
+};
+
+// Stands in for Renderer2D: keeps everything cast_and_draw emits so the
+// cost of building a batch is measured, but never touches GL.
+class RecordingSink final : public RenderSink
+{
+public:
+    void clear() noexcept
+    {
+        quads_.clear();
+        lines_.clear();
+        runs_.clear();
+    }
+
+    void push_quad(float x0, float y0, float x1, float y1, float r, float g, float b) override
+    {
+        quads_.push_back(RecordedQuad{x0, y0, x1, y1, r, g, b});
+    }
+
+    [[nodiscard]] bool merges_walls() const noexcept override { return true; }
+    void push_wall_run(const WallRun &run) override { runs_.push_back(run); }
+
+    void push_line(float x0, float y0, float x1, float y1, float r, float g, float b) override
+    {
+        lines_.push_back(RecordedLine{x0, y0, x1, y1, r, g, b});
+    }
+
+    [[nodiscard]] std::size_t vertex_count() const noexcept
+    {
+        return (quads_.size() + runs_.size()) * 4 + lines_.size() * 2;
+    }
+
+    [[nodiscard]] const std::vector<RecordedQuad> &quads() const noexcept { return quads_; }
+    [[nodiscard]] const std::vector<RecordedLine> &lines() const noexcept { return lines_; }
+
+private:
+    std::vector<RecordedQuad> quads_;
+    std::vector<RecordedLine> lines_;
+    std::vector<WallRun> runs_;
+};
+
+// Counts vertices and drops them: isolates the ray casting itself.
+class NullSink final : public RenderSink
+{
+public:
+    void clear() noexcept { vertices_ = 0; }
+
+    void push_quad(float, float, float, float, float, float, float) override { vertices_ += 4; }
+    void push_line(float, float, float, float, float, float, float) override { vertices_ += 2; }
+    [[nodiscard]] bool merges_walls() const noexcept override { return true; }
+    void push_wall_run(const WallRun &) override { vertices_ += 4; }
+
+    [[nodiscard]] std::size_t vertex_count() const noexcept { return vertices_; }
+
+private:
+    std::size_t vertices_ = 0;
+};
+
+struct Options
+{
+    int rays = 1000;
+    int width = 1920;
+    int height = 1080;
+    int frames = 2000;
+    int warmup = 100;
+    bool null_sink = false;
+    bool software = false;
+    const char *dump = nullptr;
+    const char *trace = nullptr;
+    const char *replay = nullptr;
+    const char *capture = nullptr; // .y4m file or PPM prefix, software frames only
+    bool compare = false;
+    bool loose_compare = false; // big maps: tolerate the reference march's drift
+    bool self_test = false; // checks that need no map, then exits
+    RayTraversal traversal = kDefaultTraversal;
+    SimdMode simd = SimdMode::Auto;
+    int threads = 1;
+    bool skip_empty = true;
+    bool textured = true;
+    bool reuse_hits = true;
+    bool textured_floors = true;
+    bool merge_walls = true;
+    double budget_ms = 0.0; // > 0: RayGovernor picks the rays per frame
+    int entities = 0;       // scattered over the map, drawn as sprites
+    int doors = 0;          // put into doorways, shut, half or fully open
+    double door_toggles = 0.0; // per second, at 60 frames a second
+    int cameras = 0;        // > 0: CameraBatch renders this many tiles per frame
+    int tile_w = 160;
+    int tile_h = 120;
+    std::string_view path = "all";
+    const char *map_file = nullptr;
+    const char *save_map = nullptr;
+    int gen_w = 0;
+    int gen_h = 0;
+    float gen_fill = 0.02f;
+
+    [[nodiscard]] CastOptions cast_options(const bool debug_rays) const noexcept
+    {
+        CastOptions o{rays, debug_rays, traversal, simd, threads, skip_empty};
+        o.textured = textured;
+        o.reuse_hits = reuse_hits;
+        o.textured_floors = textured_floors;
+        o.merge_walls = merge_walls;
+        return o;
+    }
+};
+
+// xorshift32: deterministic on every platform.
+std::uint32_t next_random(std::uint32_t &state) noexcept
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+struct Waypoint
+{
+    int cx, cy;
+};
+
+// Deterministic wander over open cells starting at the spawn point. It keeps
+// heading straight when it can, so corridors get walked end to end; every
+// leg joins two 4-adjacent open cells, so the camera never enters a wall.
+std::vector<Waypoint> plan_walk(const Map &map, const int legs)
+{
+    constexpr int kDx[4] = {1, 0, -1, 0};
+    constexpr int kDy[4] = {0, 1, 0, -1};
+
+    Waypoint at{static_cast<int>(map.spawn_x()) / Map::kCellSize,
+                static_cast<int>(map.spawn_y()) / Map::kCellSize};
+    std::vector<Waypoint> walk{at};
+
+    std::uint32_t state = 0x2545f491u;
+    int dir = 0;
+    for (int i = 0; i < legs; ++i)
+    {
+        next_random(state);
+
+        // Straight first (most of the time), then a turn, then back.
+        const int turn = (state & 1u) ? 1 : 3;
+        const int order[4] = {(state & 6u) ? dir : (dir + turn) % 4,
+                              (dir + turn) % 4, (dir + 4 - turn) % 4, (dir + 2) % 4};
+        bool moved = false;
+        for (const int d : order)
+        {
+            if (map.is_wall(at.cx + kDx[d], at.cy + kDy[d]))
+                continue;
+            dir = d;
+            at = {at.cx + kDx[d], at.cy + kDy[d]};
+            walk.push_back(at);
+            moved = true;
+            break;
+        }
+        if (!moved)
+            break;
+    }
+    return walk;
+}
+
+struct Path
+{
+    std::string_view name;
+    std::vector<Waypoint> walk; // empty: turn a full circle at the spawn point
+    std::vector<InputLog::Pose> poses; // recorded camera, one per frame
+
+    void pose(const Map &map, const float t, Player &player) const
+    {
+        if (!poses.empty())
+        {
+            const auto i = std::min(static_cast<std::size_t>(t * static_cast<float>(poses.size())), poses.size() - 1);
+            player.spawn(poses[i].x, poses[i].y, poses[i].angle);
+            return;
+        }
+        if (walk.size() < 2)
+        {
+            player.spawn(map.spawn_x(), map.spawn_y(), map.spawn_angle() + 360.0f * t);
+            return;
+        }
+
+        const auto legs = static_cast<float>(walk.size() - 1);
+        const float u = t * legs;
+        const auto leg = std::min(static_cast<std::size_t>(u), walk.size() - 2);
+        const float f = u - static_cast<float>(leg);
+
+        const Waypoint a = walk[leg];
+        const Waypoint b = walk[leg + 1];
+        const auto cell = static_cast<float>(Map::kCellSize);
+        const auto dir_x = static_cast<float>(b.cx - a.cx);
+        const auto dir_y = static_cast<float>(b.cy - a.cy);
+
+        player.spawn((static_cast<float>(a.cx) + dir_x * f + 0.5f) * cell,
+                     (static_cast<float>(a.cy) + dir_y * f + 0.5f) * cell,
+                     math::rad_to_deg(std::atan2(-dir_y, dir_x)));
+    }
+};
+
+std::vector<Path> make_paths(const Map &map, const InputLog *log)
+{
+    std::vector<Path> paths;
+    paths.push_back({"spin", {}, {}});
+    paths.push_back({"walk", plan_walk(map, 64), {}});
+    if (log)
+    {
+        Path replay{"replay", {}, {}};
+        for (int f = 0; f < log->frames(); ++f)
+            replay.poses.push_back(log->pose(f));
+        paths.push_back(std::move(replay));
+    }
+    return paths;
+}
+
+const char *traversal_name(const RayTraversal t) noexcept
+{
+    switch (t)
+    {
+    case RayTraversal::Dda: return "dda";
+    case RayTraversal::Reference: return "reference";
+    case RayTraversal::Fixed: return "fixed";
+    }
+    return "?";
+}
+
+double percentile(const std::vector<double> &sorted, const double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    const auto i = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// opt.capture with the path's name worked in: a-walk.y4m, or prefix-walk.
+std::string capture_path(const Options &opt, const Path &path)
+{
+    const std::string_view out = opt.capture;
+    const std::size_t ext = out.ends_with(".y4m") ? out.size() - 4 : out.size();
+    std::string named(out.substr(0, ext));
+    named += '-';
+    named += path.name;
+    named += out.substr(ext);
+    return named;
+}
+
+// Queues the frame on writer and adds the time the caller spent copying
+// it to capture_ns; dropped frames cost nothing.
+void capture_frame(FrameWriter &writer, const SoftwareFramebuffer &fb, std::vector<double> &capture_ns)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    std::uint32_t *dst = writer.begin_frame(fb.width(), fb.height(), FrameLayout::Columns);
+    if (!dst)
+        return;
+    // Owned pixels, so the columns are contiguous.
+    std::copy_n(fb.columns(), static_cast<std::size_t>(fb.width()) * static_cast<std::size_t>(fb.height()), dst);
+    writer.end_frame();
+    capture_ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+}
+
+// Closes writer and reports what capture_frame cost.
+bool report_capture(FrameWriter &writer, const std::string &path, std::vector<double> &capture_ns)
+{
+    const bool ok = writer.close();
+    std::ranges::sort(capture_ns);
+    std::printf("       capture %s: %llu frames written, %llu dropped, copies p50 %.4f ms p99 %.4f ms\n",
+                path.c_str(), static_cast<unsigned long long>(writer.frames_written()),
+                static_cast<unsigned long long>(writer.frames_dropped()), percentile(capture_ns, 0.50) * 1e-6,
+                percentile(capture_ns, 0.99) * 1e-6);
+    return ok;
+}
+
+// Puts up to count doors into open cells walled on one axis and open on
+// the other, picked at random, and leaves them shut, half or fully open.
+// Returns how many fitted.
+int place_doors(Map &map, const int count)
+{
+    std::vector<Waypoint> doorways;
+    for (int y = 1; y < map.height() - 1; ++y)
+        for (int x = 1; x < map.width() - 1; ++x)
+        {
+            if (map.is_wall(x, y))
+                continue;
+            const bool x_walls = map.is_wall(x - 1, y) && map.is_wall(x + 1, y);
+            const bool y_walls = map.is_wall(x, y - 1) && map.is_wall(x, y + 1);
+            const bool x_open = !map.is_wall(x - 1, y) && !map.is_wall(x + 1, y);
+            const bool y_open = !map.is_wall(x, y - 1) && !map.is_wall(x, y + 1);
+            if ((x_walls && y_open) || (y_walls && x_open))
+                doorways.push_back({x, y});
+        }
+
+    std::uint32_t state = 0x68e31da4u;
+    const int n = std::min(count, static_cast<int>(doorways.size()));
+    for (int i = 0; i < n; ++i)
+    {
+        const auto left = static_cast<std::uint32_t>(doorways.size()) - static_cast<std::uint32_t>(i);
+        const int pick = i + static_cast<int>(next_random(state) % left);
+        std::swap(doorways[static_cast<std::size_t>(i)], doorways[static_cast<std::size_t>(pick)]);
+        const Waypoint d = doorways[static_cast<std::size_t>(i)];
+        map.add_door(d.cx, d.cy, 4);
+        map.set_door_open(d.cx, d.cy, static_cast<std::int32_t>(next_random(state) % 3) * (Map::kDoorOpen / 2));
+    }
+    return n;
+}
+
+// Toggles random doors while a path runs, opt.door_toggles per second at
+// 60 frames a second, and slides the moving ones on by a frame.
+class DoorTraffic
+{
+public:
+    void frame(Map &map, const Options &opt)
+    {
+        if ((opt.doors == 0 && opt.door_toggles <= 0.0) || !map.has_doors())
+            return;
+        const auto t0 = std::chrono::steady_clock::now();
+        carry_ += opt.door_toggles / kFps;
+        for (; carry_ >= 1.0; carry_ -= 1.0)
+        {
+            const Map::Door &d = map.door(static_cast<int>(next_random(state_) % static_cast<std::uint32_t>(map.doors())));
+            map.toggle_door(d.x, d.y);
+            ++toggles_;
+        }
+        map.step_doors(1.0f / kFps);
+        moving_ += map.moving_doors();
+        edit_ns_.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+    }
+
+    void report(const Map &map, const int frames)
+    {
+        if (edit_ns_.empty())
+            return;
+        std::ranges::sort(edit_ns_);
+        std::printf("       %d doors: %lld toggled, %.0f moving per frame, edits p50 %.4f ms p99 %.4f ms\n",
+                    map.doors(), toggles_, moving_ / frames, percentile(edit_ns_, 0.50) * 1e-6,
+                    percentile(edit_ns_, 0.99) * 1e-6);
+    }
+
+private:
+    static constexpr double kFps = 60.0;
+    std::uint32_t state_ = 0x2f6b9a31u;
+    double carry_ = 0.0;
+    long long toggles_ = 0;
+    double moving_ = 0.0;
+    std::vector<double> edit_ns_;
+};
+
+template <typename Sink>
+bool run_path(Raycaster &caster, Map &map, const Entities &entities, const Path &path, const Options &opt,
+              Sink &sink)
+{
+    const Viewport view{0, 0, opt.width, opt.height};
+    Player player;
+    FrameProfiler profiler;
+    StageTimes times;
+    CastOptions cast_opts = opt.cast_options(false);
+    if (opt.trace)
+        cast_opts.stage_times = &times;
+    RayGovernor governor(opt.budget_ms);
+    DoorTraffic doors;
+
+    FrameWriter writer;
+    std::vector<double> capture_ns;
+    constexpr bool kCapturable = std::is_same_v<Sink, SoftwareFramebuffer>;
+    if (kCapturable && opt.capture && !writer.open(capture_path(opt, path)))
+        return false;
+
+    std::vector<double> frame_ns;
+    frame_ns.reserve(static_cast<std::size_t>(opt.frames));
+    std::size_t vertices = 0;
+    double columns = 0.0;
+    double cast = 0.0;
+    double sprites = 0.0;
+
+    for (int f = -opt.warmup; f < opt.frames; ++f)
+    {
+        const int i = f < 0 ? f + opt.warmup : f;
+        path.pose(map, static_cast<float>(i) / static_cast<float>(opt.frames), player);
+        doors.frame(map, opt);
+
+        sink.clear();
+        profiler.begin_frame();
+        const auto t0 = std::chrono::steady_clock::now();
+        caster.cast_and_draw(sink, map, player, view, cast_opts);
+        caster.draw_sprites(sink, entities, player, view, cast_opts);
+        const auto t1 = std::chrono::steady_clock::now();
+        profiler.add(times);
+        times.clear();
+        profiler.end_frame();
+
+        const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        const int rays = cast_opts.num_rays;
+        if (opt.budget_ms > 0.0)
+            cast_opts.num_rays = governor.update(ns * 1e-6, rays, opt.width);
+        if (f < 0)
+            continue;
+        frame_ns.push_back(ns);
+        columns += rays;
+        cast += caster.rays_cast();
+        sprites += caster.sprites_drawn();
+        if constexpr (requires { sink.vertex_count(); })
+            vertices += sink.vertex_count();
+        if constexpr (kCapturable)
+            if (writer.is_open())
+                capture_frame(writer, sink, capture_ns);
+    }
+
+    double total_ns = 0.0;
+    for (const double ns : frame_ns)
+        total_ns += ns;
+    std::ranges::sort(frame_ns);
+
+    std::printf("%-6.*s %7d %12.3f %10.2f %12.1f %9.4f %9.4f %9.4f\n",
+                static_cast<int>(path.name.size()), path.name.data(),
+                opt.frames,
+                columns / (total_ns * 1e-9) * 1e-6,
+                total_ns / columns,
+                static_cast<double>(vertices) / opt.frames,
+                percentile(frame_ns, 0.50) * 1e-6,
+                percentile(frame_ns, 0.95) * 1e-6,
+                percentile(frame_ns, 0.99) * 1e-6);
+    if (cast < columns)
+        std::printf("       %.1f%% of columns reused from the frame before\n", 100.0 * (1.0 - cast / columns));
+    if (entities.size() > 0)
+        std::printf("       %.1f of %d sprites drawn per frame\n", sprites / opt.frames, entities.size());
+    if (opt.budget_ms > 0.0)
+        std::printf("       budget %.2f ms: %.0f rays on average, %d at the end\n", opt.budget_ms,
+                    columns / opt.frames, cast_opts.num_rays);
+    doors.report(map, opt.warmup + opt.frames);
+    if (writer.is_open() && !report_capture(writer, capture_path(opt, path), capture_ns))
+        return false;
+
+    // The last FrameProfiler::kHistory frames, split into cast and batch.
+    if (!opt.trace)
+        return true;
+    const std::string prefix = std::string(opt.trace) + "-" + std::string(path.name);
+    const bool ok = profiler.write_chrome_trace(prefix + ".json");
+    return profiler.write_csv(prefix + ".csv") && ok;
+}
+
+// cameras viewpoints per frame through one CameraBatch into an atlas of
+// tile_w x tile_h tiles, one ray per tile column. Camera i runs i / cameras
+// of the way ahead along the path, so every tile sees something different.
+bool run_cameras(CameraBatch &batch, const Map &map, const Entities &entities, const Path &path,
+                 const Options &opt, SoftwareFramebuffer &atlas)
+{
+    const int cols = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(opt.cameras))));
+    const int rows = (opt.cameras + cols - 1) / cols;
+    atlas.resize(cols * opt.tile_w, rows * opt.tile_h);
+
+    std::vector<Viewport> tiles;
+    for (int i = 0; i < opt.cameras; ++i)
+        tiles.push_back(grid_tile(i, cols, opt.tile_w, opt.tile_h));
+    std::vector<Player> players(static_cast<std::size_t>(opt.cameras));
+    CastOptions cast_opts = opt.cast_options(false);
+    cast_opts.num_rays = opt.tile_w;
+
+    FrameWriter writer;
+    std::vector<double> capture_ns;
+    if (opt.capture && !writer.open(capture_path(opt, path)))
+        return false;
+
+    std::vector<double> frame_ns;
+    frame_ns.reserve(static_cast<std::size_t>(opt.frames));
+    double cast = 0.0;
+
+    for (int f = -opt.warmup; f < opt.frames; ++f)
+    {
+        const int i = f < 0 ? f + opt.warmup : f;
+        const float t = static_cast<float>(i) / static_cast<float>(opt.frames);
+        for (int c = 0; c < opt.cameras; ++c)
+        {
+            const float u = t + static_cast<float>(c) / static_cast<float>(opt.cameras);
+            path.pose(map, u - std::floor(u), players[static_cast<std::size_t>(c)]);
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+        batch.render(atlas, map, players, tiles, cast_opts, &entities);
+        const auto t1 = std::chrono::steady_clock::now();
+        if (f < 0)
+            continue;
+        frame_ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+        cast += batch.rays_cast();
+        if (writer.is_open())
+            capture_frame(writer, atlas, capture_ns);
+    }
+
+    double total_ns = 0.0;
+    for (const double ns : frame_ns)
+        total_ns += ns;
+    std::ranges::sort(frame_ns);
+
+    const double camera_frames = static_cast<double>(opt.frames) * opt.cameras;
+    std::printf("%-6.*s %7d %12.1f %12.3f %9.4f %9.4f %9.4f\n",
+                static_cast<int>(path.name.size()), path.name.data(),
+                opt.frames,
+                camera_frames / (total_ns * 1e-9),
+                cast / (total_ns * 1e-9) * 1e-6,
+                percentile(frame_ns, 0.50) * 1e-6,
+                percentile(frame_ns, 0.95) * 1e-6,
+                percentile(frame_ns, 0.99) * 1e-6);
+    return !writer.is_open() || report_capture(writer, capture_path(opt, path), capture_ns);
+}
+
+// Renders every frame with the selected options and with the scalar
+// reference traversal, then compares them column by column: the debug ray
+// end points are the hit positions, the quads the projected wall extents.
+// Hits may differ by 1e-4 of the distance in at most 1e-4 of the columns.
+// The reference marches in double, so it does not drift on big maps; what
+// mismatches remain (a few in 10^5 on generated maps up to 4096x4096) are
+// rays through a grid corner, which may stop on either cell. With --loose,
+// and for the fixed traversal, whose rays are aimed at the nearest fine
+// angle, 1e-3 in 1%. That is too loose to catch a bug that only breaks a
+// few columns a frame.
+bool compare_path(Raycaster &caster, const Map &map, const Path &path, const Options &opt,
+                  RecordingSink &test, RecordingSink &ref)
+{
+    const bool loose = opt.loose_compare || opt.traversal == RayTraversal::Fixed;
+    const float per_dist = loose ? 1e-3f : 1e-4f;
+    const double max_rate = loose ? 1e-2 : 1e-4;
+    const Viewport view{0, 0, opt.width, opt.height};
+    const CastOptions ref_opts{opt.rays, true, RayTraversal::Reference, SimdMode::Scalar, 1};
+    // One wall quad per column, whatever --flat.
+    CastOptions test_opts = opt.cast_options(true);
+    test_opts.merge_walls = false;
+    // Its own caster, so caster only ever reuses its own hits.
+    Raycaster reference;
+
+    Player player;
+    long long columns = 0;
+    long long hit_mismatch = 0;
+    float max_hit_diff = 0.0f;
+    float max_wall_diff = 0.0f;
+    std::uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a over the hit points
+
+    for (int f = 0; f < opt.frames; ++f)
+    {
+        path.pose(map, static_cast<float>(f) / static_cast<float>(opt.frames), player);
+        test.clear();
+        ref.clear();
+        caster.cast_and_draw(test, map, player, view, test_opts);
+        reference.cast_and_draw(ref, map, player, view, ref_opts);
+
+        const auto &tl = test.lines();
+        const auto &rl = ref.lines();
+        for (const RecordedLine &l : tl)
+            for (const float v : {l.x1, l.y1})
+            {
+                std::uint32_t bits = 0;
+                std::memcpy(&bits, &v, sizeof(bits));
+                hash = (hash ^ bits) * 0x100000001b3ull;
+            }
+        for (std::size_t c = 0; c < rl.size() && c < tl.size(); ++c)
+        {
+            const float dist = std::hypot(rl[c].x1 - player.x, rl[c].y1 - player.y);
+            const float diff = std::hypot(tl[c].x1 - rl[c].x1, tl[c].y1 - rl[c].y1);
+            ++columns;
+            if (diff > 0.01f + per_dist * dist)
+            {
+                ++hit_mismatch;
+                continue;
+            }
+            max_hit_diff = std::max(max_hit_diff, diff);
+
+            // Quads 0 and 1 are sky and floor.
+            const RecordedQuad &tq = test.quads()[c + 2];
+            const RecordedQuad &rq = ref.quads()[c + 2];
+            max_wall_diff = std::max({max_wall_diff,
+                                      std::fabs(tq.y0 - rq.y0), std::fabs(tq.y1 - rq.y1)});
+        }
+        hit_mismatch += static_cast<long long>(std::max(tl.size(), rl.size()) - std::min(tl.size(), rl.size()));
+    }
+
+    const double rate = columns ? static_cast<double>(hit_mismatch) / static_cast<double>(columns) : 0.0;
+    std::printf("%-6.*s %12lld %14lld %12.5f %12.5f\n",
+                static_cast<int>(path.name.size()), path.name.data(),
+                columns, hit_mismatch,
+                static_cast<double>(max_hit_diff), static_cast<double>(max_wall_diff));
+    // Diffable across machines and builds: fixed-point hits never change.
+    if (opt.traversal == RayTraversal::Fixed)
+        std::printf("       hits hash %016llx\n", static_cast<unsigned long long>(hash));
+    return rate <= max_rate;
+}
+
+// A pool that is resized between jobs must run every task of the next job
+// exactly once: workers it starts wait for that job, not the one before.
+// Those that did not raced the next job with a null one.
+bool check_thread_pool_resize()
+{
+    ThreadPool pool(2);
+    std::vector<std::atomic<int>> runs(64);
+    bool ok = true;
+    for (int round = 0; round < 2000 && ok; ++round)
+    {
+        pool.resize(2 + round % 4);
+        for (std::atomic<int> &r : runs)
+            r.store(0, std::memory_order_relaxed);
+        pool.parallel_for(static_cast<int>(runs.size()), [&](const int i) {
+            runs[static_cast<std::size_t>(i)].fetch_add(1, std::memory_order_relaxed);
+        });
+        ok = ok && std::ranges::all_of(runs, [](const std::atomic<int> &r) { return r.load() == 1; });
+    }
+    std::printf("thread pool resize: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// A caster that last cast another traversal from the same spot must cast
+// DDA afresh rather than reuse those hits.
+bool check_reuse_after_traversal_switch()
+{
+    const Map map;
+    const Player player;
+    const Viewport view{0, 0, 640, 480};
+    bool ok = true;
+    for (const RayTraversal from : {RayTraversal::Fixed, RayTraversal::Reference})
+    {
+        RecordingSink switched;
+        RecordingSink fresh;
+        Raycaster caster;
+        Raycaster reference;
+        caster.cast_and_draw(switched, map, player, view, {1000, true, from});
+        switched.clear();
+        caster.cast_and_draw(switched, map, player, view, {1000, true, RayTraversal::Dda});
+        reference.cast_and_draw(fresh, map, player, view, {1000, true, RayTraversal::Dda});
+        ok = ok && std::ranges::equal(switched.lines(), fresh.lines(), [](const RecordedLine &a, const RecordedLine &b) {
+                 return a.x1 == b.x1 && a.y1 == b.y1;
+             });
+    }
+    std::printf("hit reuse after a traversal switch: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Saves and reloads a log whose frames change 600 keys, exactly 255, 3
+// and then nearly all of them, so changes split across continuation
+// records round-trip.
+bool check_input_log_round_trip()
+{
+    std::vector<std::vector<std::uint16_t>> frames(6);
+    for (std::uint16_t k = 0; k < 600; ++k)
+        frames[1].push_back(k);
+    frames[2].assign(frames[1].begin() + 255, frames[1].end());
+    frames[3] = frames[2];
+    frames[3].insert(frames[3].end(), {700, 701, 702});
+    frames[4] = {4, 26, 44};
+
+    InputLog log;
+    log.set_map(8, 11, 150.0f, 150.0f, 90.0f);
+    for (std::size_t f = 0; f < frames.size(); ++f)
+    {
+        const auto t = static_cast<float>(f);
+        log.add_frame(1.0f / 60.0f + t * 1e-3f, frames[f], {100.0f + t, 200.0f - t, t * 15.0f});
+    }
+
+    const std::string path = (std::filesystem::temp_directory_path() / "trydoom_self_test.tdin").string();
+    const std::optional<InputLog> loaded = log.save(path) ? InputLog::load(path) : std::nullopt;
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+
+    bool ok = loaded && loaded->frames() == log.frames() && loaded->matches_map(8, 11, 150.0f, 150.0f, 90.0f);
+    for (int f = 0; ok && f < log.frames(); ++f)
+    {
+        const InputLog::Pose &a = log.pose(f);
+        const InputLog::Pose &b = loaded->pose(f);
+        ok = loaded->dt(f) == log.dt(f) && a.x == b.x && a.y == b.y && a.angle == b.angle
+             && std::ranges::equal(loaded->keys(f), log.keys(f));
+    }
+    std::printf("input log round trip: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+void print_usage(const char *argv0)
+{
+    std::printf("usage: %s [--rays N] [--budget MS] [--size WxH] [--frames N] [--warmup N]"
+                " [--path spin|walk|all] [--null] [--traversal dda|reference|fixed]"
+                " [--simd scalar|sse2|avx2|auto] [--threads N] [--no-skip] [--no-reuse] [--flat [--no-merge]] [--flat-floors] [--entities N] [--compare [--loose]]"
+                " [--doors N] [--door-toggles PER_SEC]"
+                " [--map FILE | --gen-map WxH[:FILL]] [--save-map FILE]"
+                " [--software [--dump PREFIX]] [--cameras N [--tile WxH] [--dump PREFIX]]"
+                " [--capture FILE.y4m|PREFIX] [--trace PREFIX] [--replay FILE.tdin] [--self-test]\n",
+                argv0);
+}
+
+bool parse_args(const int argc, char *argv[], Options &opt)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (arg == "--rays" && has_value)
+            opt.rays = std::clamp(std::atoi(argv[++i]), 1, 1 << 20);
+        else if (arg == "--threads" && has_value)
+            opt.threads = std::clamp(std::atoi(argv[++i]), 1, 256);
+        else if (arg == "--frames" && has_value)
+            opt.frames = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--warmup" && has_value)
+            opt.warmup = std::max(std::atoi(argv[++i]), 0);
+        else if (arg == "--size" && has_value)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2
+                || opt.width <= 0 || opt.height <= 0)
+                return false;
+        }
+        else if (arg == "--path" && has_value)
+            opt.path = argv[++i];
+        else if (arg == "--map" && has_value)
+            opt.map_file = argv[++i];
+        else if (arg == "--save-map" && has_value)
+            opt.save_map = argv[++i];
+        else if (arg == "--gen-map" && has_value)
+        {
+            const int n = std::sscanf(argv[++i], "%dx%d:%f", &opt.gen_w, &opt.gen_h, &opt.gen_fill);
+            if (n < 2 || opt.gen_w < 3 || opt.gen_h < 3)
+                return false;
+        }
+        else if (arg == "--dump" && has_value)
+            opt.dump = argv[++i];
+        else if (arg == "--entities" && has_value)
+            opt.entities = std::max(std::atoi(argv[++i]), 0);
+        else if (arg == "--doors" && has_value)
+            opt.doors = std::max(std::atoi(argv[++i]), 0);
+        else if (arg == "--door-toggles" && has_value)
+            opt.door_toggles = std::max(std::atof(argv[++i]), 0.0);
+        else if (arg == "--cameras" && has_value)
+            opt.cameras = std::clamp(std::atoi(argv[++i]), 0, 1 << 16);
+        else if (arg == "--tile" && has_value)
+        {
+            if (std::sscanf(argv[++i], "%dx%d", &opt.tile_w, &opt.tile_h) != 2
+                || opt.tile_w <= 0 || opt.tile_h <= 0)
+                return false;
+        }
+        else if (arg == "--budget" && has_value)
+            opt.budget_ms = std::atof(argv[++i]);
+        else if (arg == "--capture" && has_value)
+            opt.capture = argv[++i];
+        else if (arg == "--trace" && has_value)
+            opt.trace = argv[++i];
+        else if (arg == "--replay" && has_value)
+            opt.replay = argv[++i];
+        else if (arg == "--null")
+            opt.null_sink = true;
+        else if (arg == "--software")
+            opt.software = true;
+        else if (arg == "--no-skip")
+            opt.skip_empty = false;
+        else if (arg == "--no-reuse")
+            opt.reuse_hits = false;
+        else if (arg == "--flat")
+            opt.textured = false;
+        else if (arg == "--no-merge")
+            opt.merge_walls = false;
+        else if (arg == "--flat-floors")
+            opt.textured_floors = false;
+        else if (arg == "--compare")
+            opt.compare = true;
+        else if (arg == "--loose")
+            opt.loose_compare = true;
+        else if (arg == "--self-test")
+            opt.self_test = true;
+        else if (arg == "--traversal" && has_value)
+        {
+            const std::string_view v = argv[++i];
+            if (v == "dda")
+                opt.traversal = RayTraversal::Dda;
+            else if (v == "reference")
+                opt.traversal = RayTraversal::Reference;
+            else if (v == "fixed")
+                opt.traversal = RayTraversal::Fixed;
+            else
+                return false;
+        }
+        else if (arg == "--simd" && has_value)
+        {
+            const std::string_view v = argv[++i];
+            if (v == "scalar")
+                opt.simd = SimdMode::Scalar;
+            else if (v == "sse2")
+                opt.simd = SimdMode::Sse2;
+            else if (v == "avx2")
+                opt.simd = SimdMode::Avx2;
+            else if (v == "auto")
+                opt.simd = SimdMode::Auto;
+            else
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    if (!parse_args(argc, argv, opt))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (opt.self_test)
+    {
+        const bool pool_ok = check_thread_pool_resize();
+        const bool reuse_ok = check_reuse_after_traversal_switch();
+        const bool log_ok = check_input_log_round_trip();
+        return pool_ok && reuse_ok && log_ok ? 0 : 1;
+    }
+
+    Map map;
+    if (opt.map_file)
+    {
+        auto loaded = Map::load(opt.map_file);
+        if (!loaded)
+            return 1;
+        map = std::move(*loaded);
+    }
+    else if (opt.gen_w > 0)
+        map = Map::generate(opt.gen_w, opt.gen_h, opt.gen_fill, 1);
+    // Before saving, so --save-map keeps them.
+    const int placed = opt.doors > 0 ? place_doors(map, opt.doors) : 0;
+
+    if (opt.save_map && !map.save(opt.save_map))
+        return 1;
+
+    std::optional<InputLog> log;
+    if (opt.replay)
+    {
+        log = InputLog::load(opt.replay);
+        if (!log || !log->matches_map(map.width(), map.height(), map.spawn_x(), map.spawn_y(), map.spawn_angle()))
+            return 1;
+    }
+
+    std::printf("map %dx%d\n", map.width(), map.height());
+    if (opt.doors > 0)
+        std::printf("doors: %d placed in doorways\n", placed);
+    else if (map.has_doors())
+        std::printf("doors: %d from the map\n", map.doors());
+    if (log)
+        std::printf("replay %s: %d recorded frames\n", opt.replay, log->frames());
+    const bool dda = opt.traversal == RayTraversal::Dda;
+    const char *simd_name = dda ? simd_mode_name(resolve_simd_mode(opt.simd)) : "scalar";
+    const char *skip_name = dda && opt.skip_empty ? "on" : "off";
+    if (opt.compare)
+    {
+        std::printf("rays %d  viewport %dx%d  %s/%s skip %s vs reference/scalar\n",
+                    opt.rays, opt.width, opt.height, traversal_name(opt.traversal), simd_name, skip_name);
+        std::printf("%-6s %12s %14s %12s %12s\n",
+                    "path", "columns", "hit mismatch", "max hit |d|", "max wall |d|");
+    }
+    else if (opt.cameras > 0)
+    {
+        std::printf("cameras %d  tile %dx%d  traversal %s  simd %s  skip %s  threads %d  walls %s\n",
+                    opt.cameras, opt.tile_w, opt.tile_h, traversal_name(opt.traversal), simd_name, skip_name,
+                    opt.threads, opt.textured ? "textured" : "flat");
+        std::printf("%-6s %7s %12s %12s %9s %9s %9s\n",
+                    "path", "frames", "cam-frames/s", "Mrays/s", "p50 ms", "p95 ms", "p99 ms");
+    }
+    else
+    {
+        std::printf("rays %d  viewport %dx%d  sink %s  traversal %s  simd %s  skip %s  threads %d  walls %s\n",
+                    opt.rays, opt.width, opt.height,
+                    opt.software ? "software" : opt.null_sink ? "null" : "recording",
+                    traversal_name(opt.traversal), simd_name, skip_name, opt.threads,
+                    opt.textured ? "textured" : opt.merge_walls && !opt.software ? "merged" : "flat");
+        std::printf("%-6s %7s %12s %10s %12s %9s %9s %9s\n",
+                    "path", "frames", "Mrays/s", "ns/col", "verts/frame",
+                    "p50 ms", "p95 ms", "p99 ms");
+    }
+
+    Entities entities;
+    entities.reset(map);
+    entities.scatter(map, opt.entities, 1);
+
+    Raycaster caster;
+    CameraBatch batch(opt.threads);
+    RecordingSink recording;
+    RecordingSink reference;
+    NullSink null_sink;
+    const WallTextures wall_textures;
+    SoftwareFramebuffer software;
+    software.resize(opt.width, opt.height);
+    software.set_wall_textures(&wall_textures);
+    bool any = false;
+    bool ok = true;
+    for (const Path &path : make_paths(map, log ? &*log : nullptr))
+    {
+        if (opt.path != "all" && opt.path != path.name)
+            continue;
+        any = true;
+        if (opt.compare)
+            ok = compare_path(caster, map, path, opt, recording, reference) && ok;
+        else if (opt.cameras > 0)
+        {
+            ok = run_cameras(batch, map, entities, path, opt, software) && ok;
+            if (opt.dump && !software.write_ppm(std::string(opt.dump) + "-" + std::string(path.name) + ".ppm"))
+                ok = false;
+        }
+        else if (opt.software)
+        {
+            ok = run_path(caster, map, entities, path, opt, software) && ok;
+            // The last frame of the path, for eyeballing or diffing runs.
+            if (opt.dump && !software.write_ppm(std::string(opt.dump) + "-" + std::string(path.name) + ".ppm"))
+                ok = false;
+        }
+        else if (opt.null_sink)
+            ok = run_path(caster, map, entities, path, opt, null_sink) && ok;
+        else
+            ok = run_path(caster, map, entities, path, opt, recording) && ok;
+    }
+
+    if (!any)
+    {
+        std::fprintf(stderr, "unknown path: %.*s\n",
+                     static_cast<int>(opt.path.size()), opt.path.data());
+        return 1;
+    }
+    return ok ? 0 : 2;
+}
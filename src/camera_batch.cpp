@@ -0,0 +1,53 @@
+#include "camera_batch.h"
+#include "player.h"
+
+#include <algorithm>
+
+CameraBatch::CameraBatch(const int threads) : pool_(threads)
+{
+}
+
+void CameraBatch::set_threads(const int threads)
+{
+    pool_.resize(threads);
+}
+
+void CameraBatch::render(SoftwareFramebuffer &atlas, const Map &map, const std::span<const Player> cameras,
+                         const std::span<const Viewport> tiles, const CastOptions &opts, const Entities *entities)
+{
+    const int n = static_cast<int>(std::min(cameras.size(), tiles.size()));
+    while (static_cast<int>(cameras_.size()) < n)
+        cameras_.push_back(std::make_unique<Camera>());
+
+    // One thread per camera while there are enough of them; otherwise the
+    // spare threads go into each camera's own column split.
+    CastOptions camera_opts = opts;
+    camera_opts.threads = std::max(1, pool_.size() / std::max(n, 1));
+    camera_opts.stage_times = nullptr;
+
+    pool_.parallel_for(n, [&](const int i) {
+        Camera &c = *cameras_[static_cast<std::size_t>(i)];
+        const Viewport &tile = tiles[static_cast<std::size_t>(i)];
+        c.view.view_tile(atlas, tile.x0, tile.y0, tile.w, tile.h);
+        c.view.clear();
+        const Viewport local{0, 0, c.view.width(), c.view.height()};
+        c.rays = 0;
+        if (local.w == 0 || local.h == 0)
+            return;
+        const Player &player = cameras[static_cast<std::size_t>(i)];
+        c.caster.cast_and_draw(c.view, map, player, local, camera_opts);
+        if (entities)
+            c.caster.draw_sprites(c.view, *entities, player, local, camera_opts);
+        c.rays = c.caster.rays_cast();
+    });
+
+    rays_cast_ = 0;
+    for (int i = 0; i < n; ++i)
+        rays_cast_ += cameras_[static_cast<std::size_t>(i)]->rays;
+}
+
+Viewport grid_tile(const int index, const int cols, const int w, const int h) noexcept
+{
+    const int c = std::max(cols, 1);
+    return {index % c * w, index / c * h, w, h};
+}
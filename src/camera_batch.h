@@ -0,0 +1,54 @@
+#pragma once
+
+#include "raycaster.h"
+#include "software_framebuffer.h"
+#include "thread_pool.h"
+
+#include <memory>
+#include <span>
+#include <vector>
+
+// Renders many viewpoints of one map in a single call, each into its own
+// tile of a shared atlas framebuffer, e.g. the observations of a crowd of
+// agents. Every camera keeps its own Raycaster, so a camera that did not
+// move is answered from its last hits as usual, and draws through a view of
+// its atlas tile, so tiles are written in place and never copied.
+class CameraBatch
+{
+public:
+    explicit CameraBatch(int threads = ThreadPool::hardware_threads());
+
+    CameraBatch(const CameraBatch &) = delete;
+    CameraBatch &operator=(const CameraBatch &) = delete;
+
+    void set_threads(int threads);
+    [[nodiscard]] int threads() const noexcept { return pool_.size(); }
+
+    // Casts cameras[i] into tiles[i] of atlas (tile coordinates in atlas
+    // pixels), clearing each tile first, then draws entities into it when
+    // given. Cameras are spread across the threads; when there are fewer
+    // cameras than threads, each one also splits its columns across its
+    // share. opts applies to every camera, except that threads and
+    // stage_times are the batch's own. Tiles should not overlap.
+    void render(SoftwareFramebuffer &atlas, const Map &map, std::span<const Player> cameras,
+                std::span<const Viewport> tiles, const CastOptions &opts, const Entities *entities = nullptr);
+
+    // Rays cast by the last render, over all cameras.
+    [[nodiscard]] int rays_cast() const noexcept { return rays_cast_; }
+
+private:
+    struct Camera
+    {
+        Raycaster caster;
+        SoftwareFramebuffer view;
+        int rays = 0;
+    };
+
+    ThreadPool pool_;
+    // Kept past the end of a smaller batch, so their hits survive it.
+    std::vector<std::unique_ptr<Camera>> cameras_;
+    int rays_cast_ = 0;
+};
+
+// Tile index of a cols-wide grid of w x h tiles, row by row.
+[[nodiscard]] Viewport grid_tile(int index, int cols, int w, int h) noexcept;
@@ -0,0 +1,54 @@
+#include "draw_list.h"
+#include "wall_textures.h"
+
+#include <algorithm>
+
+namespace
+{
+
+std::uint16_t unorm16(const float v) noexcept
+{
+    return static_cast<std::uint16_t>(std::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+} // namespace
+
+ColumnInstance wall_instance(const WallSpan &w) noexcept
+{
+    return {w.x0, w.width, w.y0, w.y1, pack_rgba(w.shade, w.shade, w.shade),
+            unorm16(w.u), static_cast<std::uint16_t>(WallTextures::index_for_tile(w.tile)),
+            unorm16(w.v0), unorm16(w.v1)};
+}
+
+void DrawList::push_quad(const float x0, const float y0, const float x1, const float y1,
+                         const float r, const float g, const float b)
+{
+    const std::uint32_t rgba = pack_rgba(r, g, b);
+    quads_.insert(quads_.end(), {{x0, y0, rgba}, {x1, y0, rgba}, {x1, y1, rgba}, {x0, y1, rgba}});
+}
+
+void DrawList::push_line(const float x0, const float y0, const float x1, const float y1,
+                         const float r, const float g, const float b)
+{
+    const std::uint32_t rgba = pack_rgba(r, g, b);
+    lines_.insert(lines_.end(), {{x0, y0, rgba}, {x1, y1, rgba}});
+}
+
+void DrawList::push_column(const float x0, const float width, const float y0, const float y1,
+                           const float r, const float g, const float b)
+{
+    columns_.push_back(ColumnInstance{x0, width, y0, y1, pack_rgba(r, g, b)});
+}
+
+void DrawList::push_wall(const WallSpan &w)
+{
+    columns_.push_back(wall_instance(w));
+}
+
+void DrawList::push_wall_run(const WallRun &run)
+{
+    const std::uint32_t left = pack_rgba(run.shade0, run.shade0, run.shade0);
+    const std::uint32_t right = pack_rgba(run.shade1, run.shade1, run.shade1);
+    quads_.insert(quads_.end(), {{run.x0, run.top0, left}, {run.x1, run.top1, right},
+                                 {run.x1, run.bottom1, right}, {run.x0, run.bottom0, left}});
+}
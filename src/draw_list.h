@@ -0,0 +1,62 @@
+#pragma once
+
+#include "render_sink.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// 12 bytes: quads are drawn indexed, so each costs four of these.
+struct Vertex2D
+{
+    float x, y;
+    std::uint32_t rgba; // RGBA8, red in the low byte
+};
+
+// One push_column / push_wall strip, expanded to a quad by the column
+// vertex shader: 28 bytes instead of four vertices. u, v0 and v1 are 0..1
+// in 1/65535 steps; walls multiply rgba by the texture array layer.
+struct ColumnInstance
+{
+    static constexpr std::uint16_t kFlat = 0xffff; // layer of untextured strips
+
+    float x0, width;
+    float y0, y1;
+    std::uint32_t rgba; // RGBA8, red in the low byte
+    std::uint16_t u = 0, layer = kFlat;
+    std::uint16_t v0 = 0, v1 = 0xffff;
+};
+
+[[nodiscard]] ColumnInstance wall_instance(const WallSpan &w) noexcept;
+
+// A frame recorded straight into Renderer2D's vertex and instance formats.
+// Needs no GL, so another thread can build it while the GL thread draws
+// the previous one; Renderer2D::submit then only copies the spans.
+// clear keeps the capacity, so a reused list stops allocating.
+class DrawList final : public RenderSink
+{
+public:
+    void clear() noexcept
+    {
+        quads_.clear();
+        lines_.clear();
+        columns_.clear();
+    }
+
+    void push_quad(float x0, float y0, float x1, float y1, float r, float g, float b) override;
+    void push_line(float x0, float y0, float x1, float y1, float r, float g, float b) override;
+    void push_column(float x0, float width, float y0, float y1, float r, float g, float b) override;
+    void push_wall(const WallSpan &w) override;
+    [[nodiscard]] bool merges_walls() const noexcept override { return true; }
+    void push_wall_run(const WallRun &run) override;
+
+    // Four vertices per quad, in reserve_quads order.
+    [[nodiscard]] std::span<const Vertex2D> quads() const noexcept { return quads_; }
+    [[nodiscard]] std::span<const Vertex2D> lines() const noexcept { return lines_; }
+    [[nodiscard]] std::span<const ColumnInstance> columns() const noexcept { return columns_; }
+
+private:
+    std::vector<Vertex2D> quads_;
+    std::vector<Vertex2D> lines_;
+    std::vector<ColumnInstance> columns_;
+};
@@ -0,0 +1,136 @@
+#include "entities.h"
+#include "map.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+constexpr auto kCellF = static_cast<float>(Map::kCellSize);
+constexpr float kBucketF = kCellF * static_cast<float>(1 << Entities::kBucketShift);
+
+// xorshift32, as in Map::generate.
+std::uint32_t next_random(std::uint32_t &state) noexcept
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float cross(const float ax, const float ay, const float bx, const float by) noexcept
+{
+    return ax * by - ay * bx;
+}
+
+} // namespace
+
+void Entities::reset(const Map &map)
+{
+    x_.clear();
+    y_.clear();
+    kind_.clear();
+    constexpr int kBucket = 1 << kBucketShift;
+    buckets_w_ = (map.width() + kBucket - 1) / kBucket;
+    buckets_h_ = (map.height() + kBucket - 1) / kBucket;
+    rebuild_grid();
+}
+
+int Entities::add(const float x, const float y, const std::uint8_t kind)
+{
+    x_.push_back(x);
+    y_.push_back(y);
+    kind_.push_back(kind);
+    return size() - 1;
+}
+
+void Entities::scatter(const Map &map, const int count, const std::uint32_t seed)
+{
+    std::uint32_t state = seed ? seed : 0x9e3779b9u;
+    // Give up on maps with hardly any open cells rather than spin.
+    for (int placed = 0, tries = 0; placed < count && tries < count * 64; ++tries)
+    {
+        const auto mx = static_cast<int>(next_random(state) % static_cast<std::uint32_t>(map.width()));
+        const auto my = static_cast<int>(next_random(state) % static_cast<std::uint32_t>(map.height()));
+        if (map.is_wall(mx, my))
+            continue;
+        // Inset by the radius, so a sprite never pokes into a wall.
+        const float span = kCellF - 2.0f * kRadius;
+        const float fx = static_cast<float>(next_random(state) & 0xffffu) / 65535.0f;
+        const float fy = static_cast<float>(next_random(state) & 0xffffu) / 65535.0f;
+        add(static_cast<float>(mx) * kCellF + kRadius + fx * span, static_cast<float>(my) * kCellF + kRadius + fy * span,
+            static_cast<std::uint8_t>(placed % kKinds));
+        ++placed;
+    }
+    rebuild_grid();
+}
+
+int Entities::bucket_of(const float x, const float y) const noexcept
+{
+    const int bx = std::clamp(static_cast<int>(x / kBucketF), 0, buckets_w_ - 1);
+    const int by = std::clamp(static_cast<int>(y / kBucketF), 0, buckets_h_ - 1);
+    return by * buckets_w_ + bx;
+}
+
+void Entities::rebuild_grid()
+{
+    const auto buckets = static_cast<std::size_t>(buckets_w_) * static_cast<std::size_t>(buckets_h_);
+    bucket_begin_.assign(buckets + 1, 0);
+    bucket_ids_.resize(x_.size());
+    if (buckets == 0)
+        return;
+
+    for (std::size_t i = 0; i < x_.size(); ++i)
+        ++bucket_begin_[static_cast<std::size_t>(bucket_of(x_[i], y_[i])) + 1];
+    for (std::size_t b = 0; b < buckets; ++b)
+        bucket_begin_[b + 1] += bucket_begin_[b];
+
+    std::vector<std::uint32_t> next(bucket_begin_.begin(), bucket_begin_.end() - 1);
+    for (std::size_t i = 0; i < x_.size(); ++i)
+        bucket_ids_[next[static_cast<std::size_t>(bucket_of(x_[i], y_[i]))]++] = static_cast<std::uint32_t>(i);
+}
+
+void Entities::query(const float px, const float py, const float lx, const float ly, const float rx,
+                     const float ry, float far, std::vector<std::uint32_t> &out) const
+{
+    if (bucket_begin_.size() < 2)
+        return;
+
+    // Nothing lies past the grid, and a bounded far keeps the corners finite.
+    far = std::min(far, std::hypot(static_cast<float>(buckets_w_), static_cast<float>(buckets_h_)) * kBucketF);
+    const float ax = px + lx * far, ay = py + ly * far;
+    const float bx = px + rx * far, by = py + ry * far;
+
+    const auto bucket = [](const float v, const int buckets) {
+        return std::clamp(static_cast<int>(std::floor(v / kBucketF)), 0, buckets - 1);
+    };
+    const int bx0 = bucket(std::min({px, ax, bx}) - kRadius, buckets_w_);
+    const int by0 = bucket(std::min({py, ay, by}) - kRadius, buckets_h_);
+    const int bx1 = bucket(std::max({px, ax, bx}) + kRadius, buckets_w_);
+    const int by1 = bucket(std::max({py, ay, by}) + kRadius, buckets_h_);
+
+    // Inside is where both edges turn towards the other one.
+    const float left_sign = cross(lx, ly, rx, ry) >= 0.0f ? 1.0f : -1.0f;
+    for (int y = by0; y <= by1; ++y)
+    {
+        for (int x = bx0; x <= bx1; ++x)
+        {
+            // Bucket bounds grown by the sprite radius; out when all four
+            // corners are outside the same edge.
+            const float x0 = static_cast<float>(x) * kBucketF - kRadius - px;
+            const float y0 = static_cast<float>(y) * kBucketF - kRadius - py;
+            const float x1 = x0 + kBucketF + 2.0f * kRadius;
+            const float y1 = y0 + kBucketF + 2.0f * kRadius;
+            const auto outside = [&](const float ex, const float ey, const float sign) {
+                return sign * cross(ex, ey, x0, y0) < 0.0f && sign * cross(ex, ey, x1, y0) < 0.0f
+                       && sign * cross(ex, ey, x0, y1) < 0.0f && sign * cross(ex, ey, x1, y1) < 0.0f;
+            };
+            if (outside(lx, ly, left_sign) || outside(rx, ry, -left_sign))
+                continue;
+
+            const auto b = static_cast<std::size_t>(y * buckets_w_ + x);
+            out.insert(out.end(), bucket_ids_.begin() + bucket_begin_[b], bucket_ids_.begin() + bucket_begin_[b + 1]);
+        }
+    }
+}
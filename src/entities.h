@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class Map;
+
+// Billboard entities as a structure of arrays, bucketed by a uniform grid
+// over the map's cells so a view only looks at the entities near it. A
+// bucket covers 8x8 cells, like the first OccupancyPyramid level; ids are
+// stored sorted by bucket (a counting sort), so each bucket is one
+// contiguous run and the whole grid costs one offset per bucket.
+class Entities
+{
+public:
+    static constexpr int kBucketShift = 3;
+    // World size of every sprite: a blob half a cell tall standing on the floor.
+    static constexpr float kRadius = 22.0f;
+    static constexpr float kHeight = 44.0f;
+    static constexpr int kKinds = 4;
+
+    Entities() = default;
+
+    // Drops every entity and sizes the grid for map.
+    void reset(const Map &map);
+    // Returns the id; call rebuild_grid before the next query.
+    int add(float x, float y, std::uint8_t kind);
+    // Adds count entities at random points of open cells, the same ones for
+    // a seed, and rebuilds the grid.
+    void scatter(const Map &map, int count, std::uint32_t seed);
+    // Sorts ids into buckets.
+    void rebuild_grid();
+
+    [[nodiscard]] int size() const noexcept { return static_cast<int>(x_.size()); }
+    [[nodiscard]] std::span<const float> x() const noexcept { return x_; }
+    [[nodiscard]] std::span<const float> y() const noexcept { return y_; }
+    [[nodiscard]] std::span<const std::uint8_t> kind() const noexcept { return kind_; }
+
+    // Ids of the entities that can overlap the triangle from (px, py) along
+    // the unit directions (lx, ly) and (rx, ry), up to far: whole buckets,
+    // minus those entirely outside either edge. Appends to out.
+    void query(float px, float py, float lx, float ly, float rx, float ry, float far,
+               std::vector<std::uint32_t> &out) const;
+
+private:
+    [[nodiscard]] int bucket_of(float x, float y) const noexcept;
+
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<std::uint8_t> kind_;
+
+    int buckets_w_ = 0;
+    int buckets_h_ = 0;
+    std::vector<std::uint32_t> bucket_begin_; // buckets + 1 offsets into bucket_ids_
+    std::vector<std::uint32_t> bucket_ids_;
+};
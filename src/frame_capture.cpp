@@ -0,0 +1,91 @@
+#include "frame_capture.h"
+#include "frame_writer.h"
+
+#include <cstring>
+
+FrameCapture::~FrameCapture()
+{
+    for (GLsync &fence : fences_)
+        if (fence)
+            glDeleteSync(fence);
+    if (pbos_[0])
+        glDeleteBuffers(kPbos, pbos_);
+}
+
+void FrameCapture::init()
+{
+    glGenBuffers(kPbos, pbos_);
+}
+
+void FrameCapture::capture(FrameWriter &writer, const int w, const int h)
+{
+    collect(writer, false);
+    if (!pbos_[0] || w <= 0 || h <= 0)
+        return;
+    if (pending_ == kPbos)
+    {
+        ++skipped_;
+        return;
+    }
+
+    const auto bytes = static_cast<std::size_t>(w) * static_cast<std::size_t>(h) * sizeof(std::uint32_t);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[next_]);
+    if (capacity_[next_] < bytes)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_READ);
+        capacity_[next_] = bytes;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadBuffer(GL_BACK);
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    fences_[next_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    w_[next_] = w;
+    h_[next_] = h;
+    next_ = (next_ + 1) % kPbos;
+    ++pending_;
+}
+
+void FrameCapture::finish(FrameWriter &writer)
+{
+    collect(writer, true);
+}
+
+void FrameCapture::collect(FrameWriter &writer, const bool wait)
+{
+    // Reads finish in submission order, so stop at the first busy one.
+    while (pending_ > 0)
+    {
+        const int oldest = (next_ + kPbos - pending_) % kPbos;
+        const GLenum status = glClientWaitSync(fences_[oldest], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                               wait ? 1'000'000'000 : 0);
+        if (status == GL_TIMEOUT_EXPIRED && !wait)
+            break;
+        glDeleteSync(fences_[oldest]);
+        fences_[oldest] = nullptr;
+        --pending_;
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            ++skipped_;
+            continue;
+        }
+
+        const auto bytes = static_cast<std::size_t>(w_[oldest]) * static_cast<std::size_t>(h_[oldest])
+                           * sizeof(std::uint32_t);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_[oldest]);
+        const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), GL_MAP_READ_BIT);
+        // The writer may be full too; then the frame is dropped there.
+        std::uint32_t *dst = pixels ? writer.begin_frame(w_[oldest], h_[oldest], FrameLayout::RowsBottomUp) : nullptr;
+        if (dst)
+        {
+            std::memcpy(dst, pixels, bytes);
+            writer.end_frame();
+        }
+        else if (!pixels)
+            ++skipped_;
+        if (pixels)
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
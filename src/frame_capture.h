@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+class FrameWriter;
+
+// Reads finished frames back from the back buffer through a ring of pixel
+// pack buffers. glReadPixels into a PBO only queues the copy; the pixels
+// are mapped a frame or two later, once the frame's fence has signalled,
+// and handed to a FrameWriter, so capturing never waits for the GPU. When
+// every PBO is still in flight the frame is skipped instead.
+class FrameCapture
+{
+public:
+    FrameCapture() = default;
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    void init();
+    // After the frame's draws, before the swap: queues the read of the
+    // w x h back buffer and passes finished reads to writer, oldest first.
+    void capture(FrameWriter &writer, int w, int h);
+    // Waits for the reads still in flight and passes them on.
+    void finish(FrameWriter &writer);
+
+    [[nodiscard]] std::uint64_t frames_skipped() const noexcept { return skipped_; }
+
+private:
+    static constexpr int kPbos = 3;
+
+    void collect(FrameWriter &writer, bool wait);
+
+    GLuint pbos_[kPbos]{};
+    GLsync fences_[kPbos]{};
+    std::size_t capacity_[kPbos]{};
+    int w_[kPbos]{};
+    int h_[kPbos]{};
+    int next_ = 0;    // PBO the next read uses
+    int pending_ = 0; // reads in flight, ending at next_
+    std::uint64_t skipped_ = 0;
+};
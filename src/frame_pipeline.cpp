@@ -0,0 +1,76 @@
+#include "frame_pipeline.h"
+
+#include <utility>
+
+FramePipeline::FramePipeline(std::function<void(int slot)> build) : build_(std::move(build))
+{
+    worker_ = std::thread([this] { worker_loop(); });
+}
+
+FramePipeline::~FramePipeline()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+int FramePipeline::begin_submit()
+{
+    std::unique_lock lock(mutex_);
+    cv_.wait(lock, [&] { return submitted_ - released_ < kSlots; });
+    return static_cast<int>(submitted_ % kSlots);
+}
+
+void FramePipeline::submit()
+{
+    {
+        std::lock_guard lock(mutex_);
+        ++submitted_;
+    }
+    cv_.notify_all();
+}
+
+int FramePipeline::take(const bool drain)
+{
+    std::unique_lock lock(mutex_);
+    const std::uint64_t in_flight = submitted_ - released_;
+    if (in_flight == 0 || (!drain && in_flight < kSlots))
+        return -1;
+    cv_.wait(lock, [&] { return built_ > released_; });
+    return static_cast<int>(released_ % kSlots);
+}
+
+void FramePipeline::release()
+{
+    {
+        std::lock_guard lock(mutex_);
+        ++released_;
+    }
+    cv_.notify_all();
+}
+
+void FramePipeline::worker_loop()
+{
+    for (;;)
+    {
+        std::uint64_t frame = 0;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [&] { return stopping_ || built_ != submitted_; });
+            if (stopping_)
+                return;
+            frame = built_;
+        }
+
+        build_(static_cast<int>(frame % kSlots));
+
+        {
+            std::lock_guard lock(mutex_);
+            ++built_;
+        }
+        cv_.notify_all();
+    }
+}
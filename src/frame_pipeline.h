@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Builds frames on a thread of its own, one frame ahead of the caller. The
+// caller owns kSlots packets: it fills the inputs of slot begin_submit(),
+// calls submit(), and the build function turns that slot into a finished
+// frame while the caller draws the previous one, returned by take(). Slots
+// are handed out in order, so building and drawing never share a packet.
+class FramePipeline
+{
+public:
+    static constexpr int kSlots = 2;
+
+    explicit FramePipeline(std::function<void(int slot)> build);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    // Slot to fill next; blocks while every slot is in flight.
+    [[nodiscard]] int begin_submit();
+    void submit();
+    // Oldest frame, waiting for its build; -1 while fewer than kSlots are
+    // in flight, so the caller always has the next frame building. drain
+    // hands out whatever is left instead, -1 once nothing is. Give the slot
+    // back with release.
+    [[nodiscard]] int take(bool drain = false);
+    void release();
+
+private:
+    void worker_loop();
+
+    std::function<void(int)> build_;
+    std::thread worker_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::uint64_t submitted_ = 0;
+    std::uint64_t built_ = 0;
+    std::uint64_t released_ = 0;
+    bool stopping_ = false;
+};
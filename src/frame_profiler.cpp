@@ -0,0 +1,397 @@
+#include "frame_profiler.h"
+#include "render_sink.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+
+constexpr std::size_t kGpu = static_cast<std::size_t>(FrameStage::Gpu);
+constexpr std::size_t kFlush = static_cast<std::size_t>(FrameStage::Flush);
+
+struct Rgb
+{
+    float r, g, b;
+};
+
+constexpr Rgb kStageColors[FrameProfiler::kStages] = {
+    {0.55f, 0.55f, 0.55f}, // events
+    {0.95f, 0.85f, 0.20f}, // update
+    {0.25f, 0.80f, 0.30f}, // cast
+    {0.20f, 0.75f, 0.85f}, // batch
+    {0.85f, 0.25f, 0.60f}, // wait
+    {0.30f, 0.45f, 0.95f}, // submit
+    {0.95f, 0.55f, 0.15f}, // flush
+    {0.90f, 0.30f, 0.25f}, // capture
+    {0.55f, 0.40f, 0.95f}, // swap
+    {1.00f, 1.00f, 1.00f}, // gpu
+};
+
+constexpr float kGraphMs = 40.0f;
+constexpr int kGraphFrames = 160;
+
+std::uint32_t clamp_ns(const std::int64_t ns) noexcept
+{
+    return static_cast<std::uint32_t>(std::clamp<std::int64_t>(ns, 0, UINT32_MAX));
+}
+
+std::int32_t clamp_offset(const std::int64_t ns) noexcept
+{
+    return static_cast<std::int32_t>(std::clamp<std::int64_t>(ns, INT32_MIN, INT32_MAX));
+}
+
+FrameProfiler::Percentiles percentiles(std::vector<double> &ms)
+{
+    if (ms.empty())
+        return {};
+    std::ranges::sort(ms);
+    const auto at = [&](const double p) {
+        const auto i = static_cast<std::size_t>(p * static_cast<double>(ms.size() - 1) + 0.5);
+        return ms[std::min(i, ms.size() - 1)];
+    };
+    return {at(0.50), at(0.95), at(0.99)};
+}
+
+std::FILE *open_for_write(const std::string &path)
+{
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (!f)
+        std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+    return f;
+}
+
+bool close_written(std::FILE *f, const std::string &path, const bool ok)
+{
+    if (std::fclose(f) == 0 && ok)
+        return true;
+    std::fprintf(stderr, "Failed writing %s\n", path.c_str());
+    return false;
+}
+
+} // namespace
+
+const char *frame_stage_name(const FrameStage stage) noexcept
+{
+    switch (stage)
+    {
+    case FrameStage::Events: return "events";
+    case FrameStage::Update: return "update";
+    case FrameStage::Cast: return "cast";
+    case FrameStage::Batch: return "batch";
+    case FrameStage::Wait: return "wait";
+    case FrameStage::Submit: return "submit";
+    case FrameStage::Flush: return "flush";
+    case FrameStage::Capture: return "capture";
+    case FrameStage::Swap: return "swap";
+    case FrameStage::Gpu: return "gpu";
+    case FrameStage::Count: break;
+    }
+    return "?";
+}
+
+FrameProfiler::FrameProfiler()
+    : slots_(std::make_unique<Slot[]>(kHistory))
+{
+}
+
+void FrameProfiler::begin_frame() noexcept
+{
+    current_ = Frame{};
+    current_.index = published_.load(std::memory_order_relaxed);
+    current_.start_ns = profiler_now_ns();
+    in_frame_ = true;
+}
+
+void FrameProfiler::add(const FrameStage stage, const std::int64_t begin_ns, const std::int64_t end_ns) noexcept
+{
+    if (!in_frame_)
+        return;
+    const auto s = static_cast<std::size_t>(stage);
+    if (current_.dur_ns[s] == 0)
+        current_.begin_ns[s] = clamp_offset(begin_ns - current_.start_ns);
+    current_.dur_ns[s] = clamp_ns(std::int64_t{current_.dur_ns[s]} + (end_ns - begin_ns));
+}
+
+void FrameProfiler::add(const StageTimes &times) noexcept
+{
+    for (std::size_t s = 0; s < kStages; ++s)
+        if (times.dur_ns[s] != 0)
+            add(static_cast<FrameStage>(s), times.begin_ns[s], times.begin_ns[s] + times.dur_ns[s]);
+}
+
+void FrameProfiler::end_frame()
+{
+    if (!in_frame_)
+        return;
+    in_frame_ = false;
+
+    current_.total_ns = clamp_ns(profiler_now_ns() - current_.start_ns);
+    // GPU time arrives later through add_late; it is drawn from the flush on.
+    current_.begin_ns[kGpu] = current_.begin_ns[kFlush];
+    check_spike(current_);
+
+    publish(slots_[current_.index % kHistory], current_);
+    published_.store(current_.index + 1, std::memory_order_release);
+}
+
+void FrameProfiler::publish(Slot &slot, const Frame &frame) noexcept
+{
+    const std::uint64_t seq = frame.index * 2;
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.start_ns.store(frame.start_ns, std::memory_order_relaxed);
+    slot.total_ns.store(frame.total_ns, std::memory_order_relaxed);
+    slot.spike.store(static_cast<std::uint8_t>(frame.spike), std::memory_order_relaxed);
+    for (std::size_t s = 0; s < kStages; ++s)
+    {
+        slot.begin_ns[s].store(frame.begin_ns[s], std::memory_order_relaxed);
+        slot.dur_ns[s].store(frame.dur_ns[s], std::memory_order_relaxed);
+    }
+
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+void FrameProfiler::add_late(const std::uint64_t frame, const FrameStage stage, const std::uint64_t ns) noexcept
+{
+    Slot &slot = slots_[frame % kHistory];
+    if (slot.seq.load(std::memory_order_relaxed) != frame * 2 + 2)
+        return;
+    // One relaxed store: readers see the frame with or without it.
+    slot.dur_ns[static_cast<std::size_t>(stage)].store(clamp_ns(static_cast<std::int64_t>(ns)),
+                                                        std::memory_order_relaxed);
+}
+
+void FrameProfiler::check_spike(Frame &frame)
+{
+    if (frame.index % kSpikeRefresh == 0)
+        baseline_ = stats(kSpikeWindow);
+    if (baseline_.frames < kSpikeWindow / 2)
+        return;
+
+    const double total_ms = frame.total_ns * 1e-6;
+    if (total_ms < baseline_.total.p50 * kSpikeFactor)
+        return;
+
+    Spike spike{frame.index, total_ms, baseline_.total.p50};
+    // GPU time is not in yet, and the CPU only waits for it inside swap.
+    for (int s = 0; s < kStages; ++s)
+    {
+        const auto stage = static_cast<FrameStage>(s);
+        if (stage == FrameStage::Gpu)
+            continue;
+        const double excess = frame.ms(stage) - baseline_.stage[static_cast<std::size_t>(s)].p50;
+        if (spike.stage == FrameStage::Count || excess > spike.excess_ms)
+        {
+            spike.stage = stage;
+            spike.excess_ms = excess;
+        }
+    }
+
+    frame.spike = spike.stage;
+    last_spike_ = spike;
+    ++spikes_;
+}
+
+void FrameProfiler::snapshot(std::vector<Frame> &out, const int max_frames) const
+{
+    out.clear();
+    const std::uint64_t end = published_.load(std::memory_order_acquire);
+    const auto count = std::min<std::uint64_t>({end, static_cast<std::uint64_t>(std::max(max_frames, 0)),
+                                                static_cast<std::uint64_t>(kHistory)});
+
+    for (std::uint64_t i = end - count; i < end; ++i)
+    {
+        const Slot &slot = slots_[i % kHistory];
+        const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != i * 2 + 2)
+            continue;
+
+        Frame f;
+        f.index = i;
+        f.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+        f.total_ns = slot.total_ns.load(std::memory_order_relaxed);
+        f.spike = static_cast<FrameStage>(slot.spike.load(std::memory_order_relaxed));
+        for (std::size_t s = 0; s < kStages; ++s)
+        {
+            f.begin_ns[s] = slot.begin_ns[s].load(std::memory_order_relaxed);
+            f.dur_ns[s] = slot.dur_ns[s].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq)
+            out.push_back(f);
+    }
+}
+
+FrameProfiler::Stats FrameProfiler::stats(const std::span<const Frame> frames)
+{
+    Stats st;
+    st.frames = static_cast<int>(frames.size());
+
+    std::vector<double> ms;
+    ms.reserve(frames.size());
+    for (const Frame &f : frames)
+        ms.push_back(f.total_ns * 1e-6);
+    st.total = percentiles(ms);
+
+    for (std::size_t s = 0; s < kStages; ++s)
+    {
+        ms.clear();
+        for (const Frame &f : frames)
+            if (f.dur_ns[s] != 0)
+                ms.push_back(f.dur_ns[s] * 1e-6);
+        st.stage[s] = percentiles(ms);
+    }
+    return st;
+}
+
+FrameProfiler::Stats FrameProfiler::stats(const int max_frames) const
+{
+    std::vector<Frame> frames;
+    snapshot(frames, max_frames);
+    return stats(frames);
+}
+
+bool FrameProfiler::write_chrome_trace(const std::string &path) const
+{
+    std::vector<Frame> frames;
+    snapshot(frames);
+
+    std::FILE *f = open_for_write(path);
+    if (!f)
+        return false;
+
+    // One track for the frames and one per stage, so merged repeats of a
+    // stage never overlap another stage's span.
+    bool ok = std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                              "\"args\":{\"name\":\"frame\"}}") > 0;
+    for (int s = 0; s < kStages; ++s)
+        ok = ok && std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                                   "\"args\":{\"name\":\"%s\"}}",
+                                s + 1, frame_stage_name(static_cast<FrameStage>(s))) > 0;
+
+    const std::int64_t t0 = frames.empty() ? 0 : frames.front().start_ns;
+    for (const Frame &fr : frames)
+    {
+        const double start_us = static_cast<double>(fr.start_ns - t0) * 1e-3;
+        ok = ok && std::fprintf(f, ",\n{\"name\":\"frame %llu\",\"ph\":\"X\",\"pid\":1,\"tid\":0,"
+                                   "\"ts\":%.3f,\"dur\":%.3f}",
+                                static_cast<unsigned long long>(fr.index), start_us, fr.total_ns * 1e-3) > 0;
+        for (std::size_t s = 0; s < kStages; ++s)
+        {
+            if (fr.dur_ns[s] == 0)
+                continue;
+            ok = ok && std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+                                       "\"ts\":%.3f,\"dur\":%.3f}",
+                                    frame_stage_name(static_cast<FrameStage>(s)), s + 1,
+                                    start_us + fr.begin_ns[s] * 1e-3, fr.dur_ns[s] * 1e-3) > 0;
+        }
+        if (fr.spike != FrameStage::Count)
+            ok = ok && std::fprintf(f, ",\n{\"name\":\"spike: %s\",\"ph\":\"i\",\"s\":\"p\",\"pid\":1,\"tid\":0,"
+                                       "\"ts\":%.3f}",
+                                    frame_stage_name(fr.spike), start_us) > 0;
+    }
+    ok = ok && std::fprintf(f, "\n]}\n") > 0;
+
+    return close_written(f, path, ok);
+}
+
+bool FrameProfiler::write_csv(const std::string &path) const
+{
+    std::vector<Frame> frames;
+    snapshot(frames);
+
+    std::FILE *f = open_for_write(path);
+    if (!f)
+        return false;
+
+    bool ok = std::fprintf(f, "frame,start_ms,total_ms") > 0;
+    for (int s = 0; s < kStages; ++s)
+        ok = ok && std::fprintf(f, ",%s_ms", frame_stage_name(static_cast<FrameStage>(s))) > 0;
+    ok = ok && std::fprintf(f, ",spike\n") > 0;
+
+    const std::int64_t t0 = frames.empty() ? 0 : frames.front().start_ns;
+    for (const Frame &fr : frames)
+    {
+        ok = ok && std::fprintf(f, "%llu,%.4f,%.4f", static_cast<unsigned long long>(fr.index),
+                                static_cast<double>(fr.start_ns - t0) * 1e-6, fr.total_ns * 1e-6) > 0;
+        for (std::size_t s = 0; s < kStages; ++s)
+            ok = ok && std::fprintf(f, ",%.4f", fr.dur_ns[s] * 1e-6) > 0;
+        ok = ok && std::fprintf(f, ",%s\n", fr.spike != FrameStage::Count ? frame_stage_name(fr.spike) : "") > 0;
+    }
+
+    return close_written(f, path, ok);
+}
+
+void draw_profiler_overlay(RenderSink &sink, const std::span<const FrameProfiler::Frame> frames,
+                           const FrameProfiler::Stats &stats, const float x0, const float y0,
+                           const float w, const float h)
+{
+    constexpr int kStages = FrameProfiler::kStages;
+    constexpr float kRow = 8.0f;
+    constexpr float kPad = 4.0f;
+
+    const float legend_h = kStages * kRow + kPad;
+    const float graph_top = y0 + kPad;
+    const float graph_bottom = y0 + h - legend_h - kPad;
+    const float per_ms = (graph_bottom - graph_top) / kGraphMs;
+
+    sink.push_quad(x0, y0, x0 + w, y0 + h, 0.08f, 0.08f, 0.10f);
+
+    const float bar_w = (w - 2.0f * kPad) / kGraphFrames;
+    const std::size_t shown = std::min(frames.size(), static_cast<std::size_t>(kGraphFrames));
+    float x = x0 + w - kPad - static_cast<float>(shown) * bar_w;
+    for (const FrameProfiler::Frame &f : frames.last(shown))
+    {
+        float y = graph_bottom;
+        for (int s = 0; s < kStages; ++s)
+        {
+            const auto stage = static_cast<FrameStage>(s);
+            if (stage == FrameStage::Gpu)
+                continue;
+            const float top = std::max(y - static_cast<float>(f.ms(stage)) * per_ms, graph_top);
+            const Rgb c = kStageColors[s];
+            if (top < y)
+                sink.push_quad(x, top, x + bar_w, y, c.r, c.g, c.b);
+            y = top;
+        }
+        if (f.spike != FrameStage::Count)
+            sink.push_quad(x, std::max(y - 3.0f, graph_top), x + bar_w, y, 1.0f, 0.1f, 0.1f);
+
+        const auto gpu_ms = static_cast<float>(f.ms(FrameStage::Gpu));
+        if (gpu_ms > 0.0f)
+        {
+            const float gy = std::max(graph_bottom - gpu_ms * per_ms, graph_top);
+            sink.push_quad(x, gy - 1.0f, x + bar_w, gy, 1.0f, 1.0f, 1.0f);
+        }
+        x += bar_w;
+    }
+
+    for (const float ms : {1000.0f / 60.0f, 1000.0f / 30.0f})
+    {
+        const float y = graph_bottom - ms * per_ms;
+        sink.push_line(x0 + kPad, y, x0 + w - kPad, y, 0.6f, 0.6f, 0.6f);
+    }
+
+    // p99 dim, p95 brighter and p50 full colour on top, on the graph's scale
+    // stretched to the row width.
+    const float bar_x = x0 + 3.0f * kPad;
+    const float row_ms = (x0 + w - kPad - bar_x) / kGraphMs;
+    float y = graph_bottom + kPad;
+    for (int s = 0; s < kStages; ++s)
+    {
+        const Rgb c = kStageColors[s];
+        const FrameProfiler::Percentiles &p = stats.stage[static_cast<std::size_t>(s)];
+        const auto len = [&](const double ms) {
+            return std::min(static_cast<float>(ms) * row_ms, x0 + w - kPad - bar_x);
+        };
+        sink.push_quad(x0 + kPad, y + 1.0f, x0 + 2.0f * kPad, y + kRow - 1.0f, c.r, c.g, c.b);
+        sink.push_quad(bar_x, y + 2.0f, bar_x + len(p.p99), y + kRow - 2.0f, c.r * 0.4f, c.g * 0.4f, c.b * 0.4f);
+        sink.push_quad(bar_x, y + 2.0f, bar_x + len(p.p95), y + kRow - 2.0f, c.r * 0.7f, c.g * 0.7f, c.b * 0.7f);
+        sink.push_quad(bar_x, y + 2.0f, bar_x + len(p.p50), y + kRow - 2.0f, c.r, c.g, c.b);
+        y += kRow;
+    }
+}
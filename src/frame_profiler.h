@@ -0,0 +1,207 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+class RenderSink;
+
+// Parts of a frame timed by FrameProfiler, in the order they run.
+enum class FrameStage : std::uint8_t
+{
+    Events,  // SDL event pump
+    Update,  // input and options
+    Cast,    // ray casting on every thread
+    Batch,   // building the frame's draw list or software pixels
+    Wait,    // GL thread waiting for the cast thread's packet
+    Submit,  // copying the packet into Renderer2D, minimap and overlay
+    Flush,   // Renderer2D::flush, or the software present
+    Capture, // queueing the back buffer read, passing older reads to FrameWriter
+    Swap,    // SDL_GL_SwapWindow
+    Gpu,     // GL_TIME_ELAPSED around the draws, known a few frames later
+    Count,
+};
+
+[[nodiscard]] const char *frame_stage_name(FrameStage stage) noexcept;
+
+// steady_clock in nanoseconds; comparable across threads.
+[[nodiscard]] inline std::int64_t profiler_now_ns() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Times the enclosing block into target, a FrameProfiler or StageTimes;
+// does nothing with a null target, so optional call sites need no branches.
+template <typename Target>
+class StageScope
+{
+public:
+    StageScope(Target *target, const FrameStage stage) noexcept
+        : target_(target), stage_(stage), begin_ns_(target ? profiler_now_ns() : 0)
+    {
+    }
+    ~StageScope()
+    {
+        if (target_)
+            target_->add(stage_, begin_ns_, profiler_now_ns());
+    }
+
+    StageScope(const StageScope &) = delete;
+    StageScope &operator=(const StageScope &) = delete;
+
+private:
+    Target *target_;
+    FrameStage stage_;
+    std::int64_t begin_ns_;
+};
+
+// Stage spans measured on a thread other than the profiler's (the cast
+// thread), handed over with the frame and merged by FrameProfiler::add.
+struct StageTimes
+{
+    static constexpr int kStages = static_cast<int>(FrameStage::Count);
+
+    std::array<std::int64_t, kStages> begin_ns{}; // first begin
+    std::array<std::int64_t, kStages> dur_ns{};   // summed, 0 = did not run
+
+    void clear() noexcept { *this = StageTimes{}; }
+    void add(const FrameStage stage, const std::int64_t begin, const std::int64_t end) noexcept
+    {
+        const auto s = static_cast<std::size_t>(stage);
+        if (dur_ns[s] == 0)
+            begin_ns[s] = begin;
+        dur_ns[s] += end - begin;
+    }
+};
+
+// Per-stage CPU (and late GPU) timings of the last kHistory frames. One
+// thread records: begin_frame, Scope / add, end_frame; other threads time
+// into StageTimes and pass them over. Finished frames go into a ring of
+// seqlocked slots, so snapshot, stats and the exports can run on any
+// thread without locks and never stall the frame; a slot that is being
+// rewritten while read is skipped.
+class FrameProfiler
+{
+public:
+    static constexpr int kStages = static_cast<int>(FrameStage::Count);
+    static constexpr int kHistory = 512;
+
+    struct Frame
+    {
+        std::uint64_t index = 0;
+        std::int64_t start_ns = 0;  // profiler_now_ns()
+        std::uint32_t total_ns = 0; // begin_frame to end_frame
+        // Offsets from start_ns, negative for work another thread did ahead
+        // of the frame. A stage that runs more than once in a frame keeps
+        // its first begin and the sum of the durations; 0 = did not run.
+        std::array<std::int32_t, kStages> begin_ns{};
+        std::array<std::uint32_t, kStages> dur_ns{};
+        FrameStage spike = FrameStage::Count; // culprit when the frame spiked
+
+        [[nodiscard]] double ms(const FrameStage s) const noexcept
+        {
+            return dur_ns[static_cast<std::size_t>(s)] * 1e-6;
+        }
+    };
+
+    struct Percentiles
+    {
+        double p50 = 0.0, p95 = 0.0, p99 = 0.0; // ms
+    };
+
+    struct Stats
+    {
+        int frames = 0;
+        Percentiles total;
+        std::array<Percentiles, kStages> stage{};
+    };
+
+    // A frame that took kSpikeFactor x the rolling median or more, blamed on
+    // the CPU stage furthest above its own median.
+    struct Spike
+    {
+        std::uint64_t index = 0;
+        double total_ms = 0.0;
+        double median_ms = 0.0;
+        FrameStage stage = FrameStage::Count;
+        double excess_ms = 0.0;
+    };
+
+    using Scope = StageScope<FrameProfiler>;
+
+    FrameProfiler();
+
+    FrameProfiler(const FrameProfiler &) = delete;
+    FrameProfiler &operator=(const FrameProfiler &) = delete;
+
+    void begin_frame() noexcept;
+    void add(FrameStage stage, std::int64_t begin_ns, std::int64_t end_ns) noexcept;
+    void add(const StageTimes &times) noexcept;
+    // Publishes the frame and checks it against the rolling median.
+    void end_frame();
+    // For durations measured after their frame ended (GPU queries); dropped
+    // once the frame has left the ring. Same thread as end_frame.
+    void add_late(std::uint64_t frame, FrameStage stage, std::uint64_t ns) noexcept;
+
+    // Index of the frame being recorded, or of the last one between frames.
+    [[nodiscard]] std::uint64_t frame_index() const noexcept { return current_.index; }
+    // The frame being recorded, or the last finished one between frames.
+    [[nodiscard]] const Frame &last_frame() const noexcept { return current_; }
+    // Spikes seen so far and the latest one.
+    [[nodiscard]] std::uint64_t spikes() const noexcept { return spikes_; }
+    [[nodiscard]] const Spike &last_spike() const noexcept { return last_spike_; }
+
+    // Up to max_frames of the newest finished frames, oldest first.
+    void snapshot(std::vector<Frame> &out, int max_frames = kHistory) const;
+    // Nearest-rank percentiles over frames; a stage counts only in frames
+    // where it ran.
+    [[nodiscard]] static Stats stats(std::span<const Frame> frames);
+    [[nodiscard]] Stats stats(int max_frames = kHistory) const;
+
+    // Everything in the ring, for chrome://tracing / Perfetto or a
+    // spreadsheet, timed from the first frame. Print the reason on failure.
+    [[nodiscard]] bool write_chrome_trace(const std::string &path) const;
+    [[nodiscard]] bool write_csv(const std::string &path) const;
+
+private:
+    static constexpr double kSpikeFactor = 1.5;
+    static constexpr int kSpikeWindow = 256;  // frames behind the median
+    static constexpr int kSpikeRefresh = 64;  // frames between median updates
+
+    struct Slot
+    {
+        // 2 * index + 1 while written, 2 * index + 2 once complete.
+        std::atomic<std::uint64_t> seq{0};
+        std::atomic<std::int64_t> start_ns{0};
+        std::atomic<std::uint32_t> total_ns{0};
+        std::atomic<std::uint8_t> spike{kStages};
+        std::array<std::atomic<std::int32_t>, kStages> begin_ns{};
+        std::array<std::atomic<std::uint32_t>, kStages> dur_ns{};
+    };
+
+    void publish(Slot &slot, const Frame &frame) noexcept;
+    void check_spike(Frame &frame);
+
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<std::uint64_t> published_{0}; // frames ever published
+
+    Frame current_;
+    bool in_frame_ = false;
+
+    Stats baseline_;
+    std::uint64_t spikes_ = 0;
+    Spike last_spike_;
+};
+
+// Stacked per-stage bars for frames (newest on the right) over a 40 ms
+// scale with 60 and 30 fps lines, and below them one row per stage with
+// its p50 / p95 / p99. Spiking frames get a red cap, GPU time a white tick.
+void draw_profiler_overlay(RenderSink &sink, std::span<const FrameProfiler::Frame> frames,
+                           const FrameProfiler::Stats &stats, float x0, float y0, float w, float h);
@@ -0,0 +1,241 @@
+#include "frame_writer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+[[nodiscard]] bool ends_with(const std::string &s, const char *suffix) noexcept
+{
+    const std::size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Full-range BT.601 in 16.16 fixed point, as JPEG uses it.
+[[nodiscard]] std::uint8_t luma(const std::uint32_t rgba) noexcept
+{
+    const int r = static_cast<int>(rgba & 0xffu);
+    const int g = static_cast<int>((rgba >> 8) & 0xffu);
+    const int b = static_cast<int>((rgba >> 16) & 0xffu);
+    return static_cast<std::uint8_t>((19595 * r + 38470 * g + 7471 * b + 32768) >> 16);
+}
+
+// Sums of r, g and b over a 2x2 block are in 0..1020, so the result needs
+// two more bits of shift.
+void chroma(const int r, const int g, const int b, std::uint8_t &cb, std::uint8_t &cr) noexcept
+{
+    cb = static_cast<std::uint8_t>(std::clamp((-11059 * r - 21709 * g + 32768 * b + (512 << 16) + 131072) >> 18, 0, 255));
+    cr = static_cast<std::uint8_t>(std::clamp((32768 * r - 27439 * g - 5329 * b + (512 << 16) + 131072) >> 18, 0, 255));
+}
+
+} // namespace
+
+std::uint32_t FrameWriter::Buffer::at(const int x, const int y) const noexcept
+{
+    const auto ux = static_cast<std::size_t>(x);
+    const auto uy = static_cast<std::size_t>(y);
+    switch (layout)
+    {
+    case FrameLayout::Rows: return rgba[uy * static_cast<std::size_t>(w) + ux];
+    case FrameLayout::RowsBottomUp: return rgba[(static_cast<std::size_t>(h) - 1 - uy) * static_cast<std::size_t>(w) + ux];
+    case FrameLayout::Columns: return rgba[ux * static_cast<std::size_t>(h) + uy];
+    }
+    return 0;
+}
+
+FrameWriter::~FrameWriter()
+{
+    close();
+}
+
+bool FrameWriter::open(const std::string &path, const int fps)
+{
+    if (is_open())
+        close();
+
+    path_ = path;
+    y4m_ = ends_with(path, ".y4m");
+    fps_ = std::max(fps, 1);
+    queued_ = done_ = dropped_ = written_ = 0;
+    closing_ = false;
+    failed_ = false;
+    stream_w_ = stream_h_ = 0;
+    if (y4m_)
+    {
+        stream_ = std::fopen(path.c_str(), "wb");
+        if (!stream_)
+        {
+            std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+            return false;
+        }
+    }
+
+    worker_ = std::thread([this] { worker_loop(); });
+    return true;
+}
+
+std::uint32_t *FrameWriter::begin_frame(const int w, const int h, const FrameLayout layout)
+{
+    if (!is_open() || w <= 0 || h <= 0)
+        return nullptr;
+    {
+        std::lock_guard lock(mutex_);
+        if (queued_ - done_ == kBuffers)
+        {
+            ++dropped_;
+            return nullptr;
+        }
+    }
+
+    // The writer thread only touches buffers between done_ and queued_.
+    Buffer &b = buffers_[queued_ % kBuffers];
+    b.rgba.resize(static_cast<std::size_t>(w) * static_cast<std::size_t>(h));
+    b.w = w;
+    b.h = h;
+    b.layout = layout;
+    return b.rgba.data();
+}
+
+void FrameWriter::end_frame()
+{
+    {
+        std::lock_guard lock(mutex_);
+        ++queued_;
+    }
+    cv_.notify_all();
+}
+
+bool FrameWriter::close()
+{
+    if (!is_open())
+        return !failed_;
+    {
+        std::lock_guard lock(mutex_);
+        closing_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+
+    if (stream_ && std::fclose(stream_) != 0 && !failed_)
+    {
+        std::fprintf(stderr, "Failed writing %s\n", path_.c_str());
+        failed_ = true;
+    }
+    stream_ = nullptr;
+    return !failed_;
+}
+
+void FrameWriter::worker_loop()
+{
+    for (;;)
+    {
+        std::uint64_t frame = 0;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [&] { return closing_ || done_ != queued_; });
+            if (done_ == queued_)
+                return; // closing with nothing left
+            frame = done_;
+        }
+
+        // After the first failure the rest are only retired.
+        if (!failed_)
+        {
+            failed_ = !write(buffers_[frame % kBuffers]);
+            if (failed_)
+                std::fprintf(stderr, "Failed writing %s\n", path_.c_str());
+            else
+                ++written_;
+        }
+
+        {
+            std::lock_guard lock(mutex_);
+            ++done_;
+        }
+    }
+}
+
+bool FrameWriter::write(const Buffer &frame)
+{
+    return y4m_ ? write_y4m(frame) : write_ppm(frame);
+}
+
+bool FrameWriter::write_y4m(const Buffer &frame)
+{
+    if (stream_w_ == 0)
+    {
+        stream_w_ = frame.w;
+        stream_h_ = frame.h;
+        if (std::fprintf(stream_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", stream_w_, stream_h_, fps_) < 0)
+            return false;
+    }
+
+    const int w = stream_w_;
+    const int h = stream_h_;
+    const int cw = (w + 1) / 2;
+    const int ch = (h + 1) / 2;
+    const auto luma_size = static_cast<std::size_t>(w) * static_cast<std::size_t>(h);
+    const auto chroma_size = static_cast<std::size_t>(cw) * static_cast<std::size_t>(ch);
+    bytes_.resize(luma_size + 2 * chroma_size);
+    std::uint8_t *y_plane = bytes_.data();
+    std::uint8_t *cb_plane = y_plane + luma_size;
+    std::uint8_t *cr_plane = cb_plane + chroma_size;
+
+    // Outside the frame is black: Y 0, chroma centred.
+    const std::uint32_t black = 0xff000000u;
+    auto at = [&](const int x, const int y) noexcept {
+        return x < frame.w && y < frame.h ? frame.at(x, y) : black;
+    };
+
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+            y_plane[static_cast<std::size_t>(y) * static_cast<std::size_t>(w) + static_cast<std::size_t>(x)] =
+                luma(at(x, y));
+
+    // Odd edges repeat their last row or column.
+    for (int cy = 0; cy < ch; ++cy)
+        for (int cx = 0; cx < cw; ++cx)
+        {
+            const int x0 = 2 * cx;
+            const int y0 = 2 * cy;
+            const int x1 = std::min(x0 + 1, w - 1);
+            const int y1 = std::min(y0 + 1, h - 1);
+            int r = 0, g = 0, b = 0;
+            for (const std::uint32_t p : {at(x0, y0), at(x1, y0), at(x0, y1), at(x1, y1)})
+            {
+                r += static_cast<int>(p & 0xffu);
+                g += static_cast<int>((p >> 8) & 0xffu);
+                b += static_cast<int>((p >> 16) & 0xffu);
+            }
+            const auto i = static_cast<std::size_t>(cy) * static_cast<std::size_t>(cw) + static_cast<std::size_t>(cx);
+            chroma(r, g, b, cb_plane[i], cr_plane[i]);
+        }
+
+    return std::fputs("FRAME\n", stream_) >= 0 && std::fwrite(bytes_.data(), 1, bytes_.size(), stream_) == bytes_.size();
+}
+
+bool FrameWriter::write_ppm(const Buffer &frame)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "-%06llu.ppm", static_cast<unsigned long long>(written_));
+    const std::string path = path_ + name;
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    bytes_.resize(static_cast<std::size_t>(frame.w) * static_cast<std::size_t>(frame.h) * 3);
+    std::uint8_t *out = bytes_.data();
+    for (int y = 0; y < frame.h; ++y)
+        for (int x = 0; x < frame.w; ++x, out += 3)
+        {
+            const std::uint32_t p = frame.at(x, y);
+            out[0] = static_cast<std::uint8_t>(p);
+            out[1] = static_cast<std::uint8_t>(p >> 8);
+            out[2] = static_cast<std::uint8_t>(p >> 16);
+        }
+
+    bool ok = std::fprintf(f, "P6\n%d %d\n255\n", frame.w, frame.h) > 0;
+    ok = ok && std::fwrite(bytes_.data(), 1, bytes_.size(), f) == bytes_.size();
+    return std::fclose(f) == 0 && ok;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How a frame's pixels are laid out in the buffer begin_frame returns.
+enum class FrameLayout
+{
+    Rows,         // top row first
+    RowsBottomUp, // bottom row first, as glReadPixels returns them
+    Columns,      // column-major, as SoftwareFramebuffer::columns stores them
+};
+
+// Streams RGBA8 frames (pack_rgba layout) to disk on a thread of its own.
+// The caller copies each frame into one of kBuffers buffers and moves on;
+// converting and writing happen behind it. When every buffer is still
+// waiting for the disk the frame is dropped rather than waited for, so
+// memory stays bounded and the caller never stalls.
+//
+// A path ending in .y4m becomes one YUV4MPEG2 stream (4:2:0, full-range
+// BT.601, i.e. C420jpeg) sized by the first frame; later frames of another
+// size are cropped or padded with black. Any other path is a prefix for a
+// PPM sequence, prefix-000000.ppm and on, each frame at its own size.
+class FrameWriter
+{
+public:
+    static constexpr int kBuffers = 4;
+
+    FrameWriter() = default;
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    // Starts the writer thread; prints the reason on failure.
+    [[nodiscard]] bool open(const std::string &path, int fps = 60);
+    [[nodiscard]] bool is_open() const noexcept { return worker_.joinable(); }
+
+    // Room for a w x h frame in layout; nullptr drops the frame. Every
+    // non-null begin_frame must be followed by end_frame. Reordering into
+    // rows happens on the writer thread, so any layout is a plain copy.
+    [[nodiscard]] std::uint32_t *begin_frame(int w, int h, FrameLayout layout = FrameLayout::Rows);
+    void end_frame();
+    // Writes what is queued, stops the thread and closes the output.
+    // Returns false if anything failed to write.
+    bool close();
+
+    // Final after close.
+    [[nodiscard]] std::uint64_t frames_written() const noexcept { return written_; }
+    [[nodiscard]] std::uint64_t frames_dropped() const noexcept { return dropped_; }
+
+private:
+    struct Buffer
+    {
+        std::vector<std::uint32_t> rgba;
+        int w = 0;
+        int h = 0;
+        FrameLayout layout = FrameLayout::Rows;
+
+        // Top-left origin; (x, y) must be inside the frame.
+        [[nodiscard]] std::uint32_t at(int x, int y) const noexcept;
+    };
+
+    void worker_loop();
+    [[nodiscard]] bool write(const Buffer &frame);
+    [[nodiscard]] bool write_y4m(const Buffer &frame);
+    [[nodiscard]] bool write_ppm(const Buffer &frame);
+
+    std::string path_;
+    bool y4m_ = false;
+    int fps_ = 60;
+    std::array<Buffer, kBuffers> buffers_;
+    std::thread worker_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::uint64_t queued_ = 0;
+    std::uint64_t done_ = 0; // written or failed
+    std::uint64_t dropped_ = 0;
+    bool closing_ = false;
+
+    // Writer thread only.
+    std::uint64_t written_ = 0;
+    std::FILE *stream_ = nullptr; // the .y4m
+    int stream_w_ = 0;
+    int stream_h_ = 0;
+    std::vector<std::uint8_t> bytes_; // one converted frame
+    bool failed_ = false;
+};
@@ -0,0 +1,50 @@
+#include "gpu_timer.h"
+#include "frame_profiler.h"
+
+GpuTimer::~GpuTimer()
+{
+    if (queries_[0])
+        glDeleteQueries(kQueries, queries_);
+}
+
+void GpuTimer::init()
+{
+    glGenQueries(kQueries, queries_);
+}
+
+void GpuTimer::begin(const std::uint64_t frame)
+{
+    active_ = queries_[0] && !pending_[next_];
+    if (!active_)
+        return;
+    frames_[next_] = frame;
+    glBeginQuery(GL_TIME_ELAPSED, queries_[next_]);
+}
+
+void GpuTimer::end()
+{
+    if (!active_)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending_[next_] = true;
+    next_ = (next_ + 1) % kQueries;
+    active_ = false;
+}
+
+void GpuTimer::collect(FrameProfiler &profiler)
+{
+    // Queries finish in submission order, so stop at the first busy one.
+    while (pending_[oldest_])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries_[oldest_], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries_[oldest_], GL_QUERY_RESULT, &ns);
+        profiler.add_late(frames_[oldest_], FrameStage::Gpu, ns);
+        pending_[oldest_] = false;
+        oldest_ = (oldest_ + 1) % kQueries;
+    }
+}
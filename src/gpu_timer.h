@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <glad/glad.h>
+
+class FrameProfiler;
+
+// GL_TIME_ELAPSED queries for FrameStage::Gpu. A query's result is read a
+// few frames after it ends, once the GPU is done with it, so timing never
+// stalls the pipeline; when every query is still in flight the frame goes
+// untimed instead.
+class GpuTimer
+{
+public:
+    GpuTimer() = default;
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    void init();
+    // Brackets the GL work of profiler frame `frame`; not nestable.
+    void begin(std::uint64_t frame);
+    void end();
+    // Hands finished results to the profiler, oldest first.
+    void collect(FrameProfiler &profiler);
+
+private:
+    static constexpr int kQueries = 4;
+
+    GLuint queries_[kQueries]{};
+    std::uint64_t frames_[kQueries]{};
+    bool pending_[kQueries]{};
+    int next_ = 0;   // query the next begin uses
+    int oldest_ = 0; // oldest pending query
+    bool active_ = false;
+};
@@ -3,6 +3,8 @@
 #include <SDL3/SDL.h>
 #include <array>
 #include <cstdint>
+#include <span>
+#include <vector>
 
 class Input
 {
@@ -15,6 +17,25 @@ public:
             curr_[static_cast<std::size_t>(i)] = ks[i] ? 1 : 0;
     }
 
+    // Replay: the held keys come from an InputLog instead of SDL.
+    void update(const std::span<const std::uint16_t> keys) noexcept
+    {
+        prev_ = curr_;
+        curr_.fill(0);
+        for (const std::uint16_t sc : keys)
+            if (sc < SDL_SCANCODE_COUNT)
+                curr_[sc] = 1;
+    }
+
+    // Held scancodes, ascending, for recording.
+    void held_keys(std::vector<std::uint16_t> &out) const
+    {
+        out.clear();
+        for (std::size_t i = 0; i < curr_.size(); ++i)
+            if (curr_[i])
+                out.push_back(static_cast<std::uint16_t>(i));
+    }
+
     [[nodiscard]] bool down(const SDL_Scancode sc) const noexcept
     {
         return curr_[sc] != 0;
@@ -0,0 +1,199 @@
+#include "input_log.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+
+// On-disk layout, little-endian:
+//   InputFileHeader
+//   frames records of: float dt, x, y, angle; uint8_t n; n uint16_t
+//   scancodes that went down or up since the previous frame
+struct InputFileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t frames;
+    std::uint32_t map_width;
+    std::uint32_t map_height;
+    float spawn_x;
+    float spawn_y;
+    float spawn_angle;
+};
+static_assert(sizeof(InputFileHeader) == 32);
+
+constexpr char kMagic[4] = {'T', 'D', 'I', 'N'};
+constexpr std::uint32_t kVersion = 1;
+constexpr std::size_t kFrameBytes = 4 * sizeof(float) + 1;
+// Changes are written in runs of at most 255; longer runs continue in
+// zero-dt continuation records, which real frames never produce.
+constexpr std::size_t kMaxChanges = 255;
+
+} // namespace
+
+void InputLog::add_frame(const float dt, const std::span<const std::uint16_t> keys, const Pose &pose)
+{
+    dt_.push_back(dt);
+    poses_.push_back(pose);
+    keys_.insert(keys_.end(), keys.begin(), keys.end());
+    key_begin_.push_back(static_cast<std::uint32_t>(keys_.size()));
+}
+
+void InputLog::set_map(const int width, const int height, const float spawn_x, const float spawn_y,
+                       const float spawn_angle) noexcept
+{
+    map_w_ = width;
+    map_h_ = height;
+    spawn_x_ = spawn_x;
+    spawn_y_ = spawn_y;
+    spawn_angle_ = spawn_angle;
+}
+
+std::span<const std::uint16_t> InputLog::keys(const int frame) const noexcept
+{
+    const auto f = static_cast<std::size_t>(frame);
+    return {keys_.data() + key_begin_[f], keys_.data() + key_begin_[f + 1]};
+}
+
+bool InputLog::matches_map(const int width, const int height, const float spawn_x, const float spawn_y,
+                           const float spawn_angle) const
+{
+    if (width == map_w_ && height == map_h_ && spawn_x == spawn_x_ && spawn_y == spawn_y_
+        && spawn_angle == spawn_angle_)
+        return true;
+    std::fprintf(stderr, "input log was recorded on a %dx%d map spawning at (%g, %g, %g), not %dx%d at (%g, %g, %g)\n",
+                 map_w_, map_h_, static_cast<double>(spawn_x_), static_cast<double>(spawn_y_),
+                 static_cast<double>(spawn_angle_), width, height, static_cast<double>(spawn_x),
+                 static_cast<double>(spawn_y), static_cast<double>(spawn_angle));
+    return false;
+}
+
+std::optional<InputLog> InputLog::load(const std::string &path)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return std::nullopt;
+
+    InputFileHeader h{};
+    if (file.size() < sizeof(h))
+    {
+        std::fprintf(stderr, "%s: truncated input log header\n", path.c_str());
+        return std::nullopt;
+    }
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion)
+    {
+        std::fprintf(stderr, "%s: not a version %u input log\n", path.c_str(), kVersion);
+        return std::nullopt;
+    }
+
+    // Every frame takes at least kFrameBytes, so a count past that is
+    // malformed; checked before it sizes anything.
+    if (h.frames > (file.size() - sizeof(h)) / kFrameBytes)
+    {
+        std::fprintf(stderr, "%s: input log claims %u frames, more than the file holds\n", path.c_str(),
+                     h.frames);
+        return std::nullopt;
+    }
+
+    InputLog log;
+    log.set_map(static_cast<int>(h.map_width), static_cast<int>(h.map_height),
+                h.spawn_x, h.spawn_y, h.spawn_angle);
+    log.dt_.reserve(h.frames);
+    log.poses_.reserve(h.frames);
+
+    std::vector<std::uint16_t> held;
+    std::vector<std::uint16_t> changes;
+    std::vector<std::uint16_t> next;
+    const std::byte *p = file.data() + sizeof(h);
+    const std::byte *end = file.data() + file.size();
+    while (log.frames() < static_cast<int>(h.frames))
+    {
+        if (static_cast<std::size_t>(end - p) < kFrameBytes)
+            break;
+        float rec[4];
+        std::memcpy(rec, p, sizeof(rec));
+        const auto n = static_cast<std::size_t>(p[sizeof(rec)]);
+        p += kFrameBytes;
+        if (static_cast<std::size_t>(end - p) < n * sizeof(std::uint16_t))
+            break;
+        changes.resize(n);
+        if (n > 0)
+            std::memcpy(changes.data(), p, n * sizeof(std::uint16_t));
+        p += n * sizeof(std::uint16_t);
+
+        std::ranges::sort(changes);
+        next.clear();
+        std::ranges::set_symmetric_difference(held, changes, std::back_inserter(next));
+        held.swap(next);
+        // A continuation record only carries more changes for the next frame.
+        if (rec[0] == 0.0f && n == kMaxChanges)
+            continue;
+        log.add_frame(rec[0], held, {rec[1], rec[2], rec[3]});
+    }
+
+    if (log.frames() != static_cast<int>(h.frames))
+    {
+        std::fprintf(stderr, "%s: input log truncated after %d of %u frames\n", path.c_str(), log.frames(),
+                     h.frames);
+        return std::nullopt;
+    }
+    return log;
+}
+
+bool InputLog::save(const std::string &path) const
+{
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    InputFileHeader h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.frames = static_cast<std::uint32_t>(frames());
+    h.map_width = static_cast<std::uint32_t>(map_w_);
+    h.map_height = static_cast<std::uint32_t>(map_h_);
+    h.spawn_x = spawn_x_;
+    h.spawn_y = spawn_y_;
+    h.spawn_angle = spawn_angle_;
+
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+
+    std::span<const std::uint16_t> prev;
+    std::vector<std::uint16_t> changes;
+    for (int i = 0; i < frames() && ok; ++i)
+    {
+        const std::span<const std::uint16_t> cur = keys(i);
+        changes.clear();
+        std::ranges::set_symmetric_difference(prev, cur, std::back_inserter(changes));
+        prev = cur;
+
+        std::span<const std::uint16_t> rest = changes;
+        for (;;)
+        {
+            const bool last = rest.size() < kMaxChanges;
+            const std::size_t n = last ? rest.size() : kMaxChanges;
+            const Pose &pose = poses_[static_cast<std::size_t>(i)];
+            const float rec[4] = {last ? dt(i) : 0.0f, pose.x, pose.y, pose.angle};
+            const auto count = static_cast<unsigned char>(n);
+            ok = ok && std::fwrite(rec, sizeof(rec), 1, f) == 1;
+            ok = ok && std::fwrite(&count, 1, 1, f) == 1;
+            ok = ok && (n == 0 || std::fwrite(rest.data(), sizeof(std::uint16_t), n, f) == n);
+            rest = rest.subspan(n);
+            if (last)
+                break;
+        }
+    }
+    ok = std::fclose(f) == 0 && ok;
+
+    if (!ok)
+        std::fprintf(stderr, "Failed writing %s\n", path.c_str());
+    return ok;
+}
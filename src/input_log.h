@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Per-frame keyboard snapshots, dt and the resulting camera pose of a play
+// session. Replaying the keys with the logged dt rebuilds the same run
+// regardless of the machine's speed; the poses let the headless bench fly
+// the same camera path and let a replay notice when a build diverges.
+// On disk (.tdin) keys are stored as changes from the previous frame, so a
+// frame with no key going up or down costs 17 bytes.
+class InputLog
+{
+public:
+    struct Pose
+    {
+        float x = 0.0f, y = 0.0f, angle = 0.0f;
+    };
+
+    InputLog() = default;
+
+    // Keys are SDL scancodes, ascending.
+    void add_frame(float dt, std::span<const std::uint16_t> keys, const Pose &pose);
+    // The map the session started on, checked on replay.
+    void set_map(int width, int height, float spawn_x, float spawn_y, float spawn_angle) noexcept;
+
+    [[nodiscard]] int frames() const noexcept { return static_cast<int>(dt_.size()); }
+    [[nodiscard]] float dt(const int frame) const noexcept { return dt_[static_cast<std::size_t>(frame)]; }
+    [[nodiscard]] const Pose &pose(const int frame) const noexcept { return poses_[static_cast<std::size_t>(frame)]; }
+    [[nodiscard]] std::span<const std::uint16_t> keys(int frame) const noexcept;
+    // False, with the reason printed, when the log was made on another map.
+    [[nodiscard]] bool matches_map(int width, int height, float spawn_x, float spawn_y, float spawn_angle) const;
+
+    // Prints the reason and returns nullopt on a missing, truncated or
+    // malformed file.
+    [[nodiscard]] static std::optional<InputLog> load(const std::string &path);
+    [[nodiscard]] bool save(const std::string &path) const;
+
+private:
+    std::vector<float> dt_;
+    std::vector<Pose> poses_;
+    std::vector<std::uint32_t> key_begin_{0}; // frames() + 1 offsets into keys_
+    std::vector<std::uint16_t> keys_;
+
+    int map_w_ = 0, map_h_ = 0;
+    float spawn_x_ = 0.0f, spawn_y_ = 0.0f, spawn_angle_ = 0.0f;
+};
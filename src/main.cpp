@@ -1,10 +1,51 @@
 #include <SDL3/SDL_main.h>
 #include "app.h"
 
-int main(int, char *[])
+#include <cstdlib>
+#include <cstring>
+
+// Usage: TryDOOM [--software] [--budget MS] [--entities N] [--record FILE | --replay FILE]
+//                [--capture FILE.y4m|PREFIX] [MAP]
+int main(int argc, char *argv[])
 {
+    const char *map_path = nullptr;
+    const char *record_path = nullptr;
+    const char *replay_path = nullptr;
+    const char *capture_path = nullptr;
+    double budget_ms = 0.0;
+    int entities = -1;
+    RenderBackend backend = RenderBackend::Gl;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--software") == 0)
+            backend = RenderBackend::Software;
+        else if (std::strcmp(argv[i], "--budget") == 0 && has_value)
+            budget_ms = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--entities") == 0 && has_value)
+            entities = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--record") == 0 && has_value)
+            record_path = argv[++i];
+        else if (std::strcmp(argv[i], "--replay") == 0 && has_value)
+            replay_path = argv[++i];
+        else if (std::strcmp(argv[i], "--capture") == 0 && has_value)
+            capture_path = argv[++i];
+        else
+            map_path = argv[i];
+    }
+
     App app;
-    if (!app.init())
+    if (!app.init(map_path, backend))
+        return 1;
+    if (entities >= 0)
+        app.spawn_entities(entities);
+    if (budget_ms > 0.0)
+        app.set_ray_budget(budget_ms);
+    if (replay_path && !app.replay_input(replay_path))
+        return 1;
+    if (record_path && !replay_path)
+        app.record_input(record_path);
+    if (capture_path && !app.capture_video(capture_path))
         return 1;
     app.run();
     return 0;
@@ -0,0 +1,479 @@
+#include "map.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace
+{
+
+constexpr int kBuiltinWidth = 8;
+constexpr int kBuiltinHeight = 11;
+
+constexpr std::array<std::uint8_t, kBuiltinWidth * kBuiltinHeight> kBuiltinTiles = {
+    1, 1, 1, 1, 1, 1, 1, 1,
+    1, 0, 0, 0, 0, 0, 0, 1,
+    1, 0, 0, 1, 1, 0, 0, 1,
+    1, 0, 0, 1, 1, 0, 0, 1,
+    1, 0, 0, 1, 0, 0, 0, 1,
+    1, 0, 0, 0, 0, 1, 1, 1,
+    1, 1, 1, 0, 0, 0, 0, 1,
+    1, 0, 1, 0, 0, 0, 0, 1,
+    1, 0, 1, 1, 1, 1, 0, 1,
+    1, 0, 0, 0, 0, 0, 0, 1,
+    1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+// On-disk layout, little-endian:
+//   MapFileHeader
+//   occupancy: height rows of words_per_row uint64_t, bit (x & 63) of word
+//              (x >> 6) set for a wall, at occupancy_offset (8-byte aligned)
+//   tiles:     width * height bytes, row-major, at tiles_offset
+//   doors:     door_count MapFileDoor records at doors_offset (version 2;
+//              version 1 files end at the 48-byte header prefix and have none)
+struct MapFileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t words_per_row;
+    float spawn_x;
+    float spawn_y;
+    float spawn_angle;
+    std::uint64_t occupancy_offset;
+    std::uint64_t tiles_offset;
+    std::uint64_t doors_offset;
+    std::uint32_t door_count;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(MapFileHeader) == 64);
+constexpr std::size_t kHeaderV1 = 48;
+
+// A door is saved at rest, open by open of Map::kDoorOpen.
+struct MapFileDoor
+{
+    std::uint32_t x;
+    std::uint32_t y;
+    std::int32_t open;
+    std::uint32_t flags; // bit 0: Door::vertical
+};
+static_assert(sizeof(MapFileDoor) == 16);
+
+constexpr char kMagic[4] = {'T', 'D', 'M', 'P'};
+constexpr std::uint32_t kVersion = 2;
+constexpr std::uint64_t kPlaneAlign = 64;
+constexpr std::uint32_t kMaxSide = 1u << 20;
+
+int words_for(const int width) noexcept
+{
+    return (width + 63) / 64;
+}
+
+std::uint64_t align_up(const std::uint64_t v) noexcept
+{
+    return (v + kPlaneAlign - 1) / kPlaneAlign * kPlaneAlign;
+}
+
+std::uint64_t cell_key(const int width, const int mx, const int my) noexcept
+{
+    return static_cast<std::uint64_t>(my) * static_cast<std::uint64_t>(width) + static_cast<std::uint64_t>(mx);
+}
+
+// xorshift32: deterministic across platforms, unlike <random> distributions.
+std::uint32_t next_random(std::uint32_t &state) noexcept
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+} // namespace
+
+Map::Map(const int width, const int height,
+         const float spawn_x, const float spawn_y, const float spawn_angle)
+    : width_(width), height_(height), words_per_row_(words_for(width)),
+      spawn_x_(spawn_x), spawn_y_(spawn_y), spawn_angle_(spawn_angle)
+{
+    door_bits_.assign(static_cast<std::size_t>(words_per_row_) * static_cast<std::size_t>(height_), 0);
+    const std::size_t regions = static_cast<std::size_t>(regions_w()) * static_cast<std::size_t>(regions_h());
+    region_revision_.assign(regions, 0);
+    region_entry_.assign(regions, -1);
+    edits_.reserve(kEditLog);
+}
+
+Map::Map()
+    : Map(from_tiles(kBuiltinWidth, kBuiltinHeight,
+                     {kBuiltinTiles.begin(), kBuiltinTiles.end()},
+                     150.0f, 150.0f, 90.0f))
+{
+}
+
+Map Map::from_tiles(const int width, const int height, std::vector<std::uint8_t> tiles,
+                    const float spawn_x, const float spawn_y, const float spawn_angle)
+{
+    tiles.resize(static_cast<std::size_t>(width) * static_cast<std::size_t>(height), 1);
+
+    Map map(width, height, spawn_x, spawn_y, spawn_angle);
+    map.owned_occupancy_.assign(static_cast<std::size_t>(map.words_per_row_)
+                                * static_cast<std::size_t>(height), 0);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (tiles[static_cast<std::size_t>(y) * static_cast<std::size_t>(width)
+                      + static_cast<std::size_t>(x)] != 0)
+                map.owned_occupancy_[static_cast<std::size_t>(y) * map.words_per_row_
+                                     + static_cast<std::size_t>(x >> 6)] |= std::uint64_t{1} << (x & 63);
+        }
+    }
+    map.owned_tiles_ = std::move(tiles);
+    map.occupancy_ = map.owned_occupancy_.data();
+    map.tiles_ = map.owned_tiles_.data();
+    map.pyramid_.build(map.occupancy_, width, height, map.words_per_row_);
+    return map;
+}
+
+Map Map::generate(int width, int height, const float fill, const std::uint32_t seed)
+{
+    width = std::max(width, 3);
+    height = std::max(height, 3);
+
+    std::vector<std::uint8_t> tiles(static_cast<std::size_t>(width) * static_cast<std::size_t>(height), 0);
+    auto at = [&](const int x, const int y) -> std::uint8_t & {
+        return tiles[static_cast<std::size_t>(y) * static_cast<std::size_t>(width)
+                     + static_cast<std::size_t>(x)];
+    };
+
+    for (int x = 0; x < width; ++x)
+        at(x, 0) = at(x, height - 1) = 1;
+    for (int y = 0; y < height; ++y)
+        at(0, y) = at(width - 1, y) = 1;
+
+    std::uint32_t state = seed ? seed : 0x9e3779b9u;
+    const auto threshold = static_cast<std::uint32_t>(std::clamp(fill, 0.0f, 1.0f) * 65535.0f);
+    for (int y = 1; y < height - 1; ++y)
+    {
+        for (int x = 1; x < width - 1; ++x)
+        {
+            const std::uint32_t r = next_random(state);
+            if ((r & 0xffffu) < threshold)
+                at(x, y) = static_cast<std::uint8_t>(1 + (r >> 16) % 4);
+        }
+    }
+
+    // Clear a 3x3 pocket in the middle so there is always somewhere to stand.
+    const int cx = width / 2;
+    const int cy = height / 2;
+    for (int y = std::max(cy - 1, 1); y <= std::min(cy + 1, height - 2); ++y)
+        for (int x = std::max(cx - 1, 1); x <= std::min(cx + 1, width - 2); ++x)
+            at(x, y) = 0;
+
+    const auto cell = static_cast<float>(kCellSize);
+    return from_tiles(width, height, std::move(tiles),
+                      (static_cast<float>(cx) + 0.5f) * cell,
+                      (static_cast<float>(cy) + 0.5f) * cell, 90.0f);
+}
+
+std::optional<Map> Map::load(const std::string &path)
+{
+    MappedFile file;
+    if (!file.open(path, true))
+        return std::nullopt;
+
+    MapFileHeader h{};
+    if (file.size() < kHeaderV1)
+    {
+        std::fprintf(stderr, "%s: truncated map header\n", path.c_str());
+        return std::nullopt;
+    }
+    std::memcpy(&h, file.data(), kHeaderV1);
+
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version == 0 || h.version > kVersion)
+    {
+        std::fprintf(stderr, "%s: not a version 1 to %u map file\n", path.c_str(), kVersion);
+        return std::nullopt;
+    }
+    const std::size_t header_bytes = h.version == 1 ? kHeaderV1 : sizeof(h);
+    if (file.size() < header_bytes)
+    {
+        std::fprintf(stderr, "%s: truncated map header\n", path.c_str());
+        return std::nullopt;
+    }
+    std::memcpy(&h, file.data(), header_bytes);
+    if (h.width == 0 || h.height == 0 || h.width > kMaxSide || h.height > kMaxSide
+        || h.words_per_row != static_cast<std::uint32_t>(words_for(static_cast<int>(h.width))))
+    {
+        std::fprintf(stderr, "%s: bad map dimensions %ux%u\n", path.c_str(), h.width, h.height);
+        return std::nullopt;
+    }
+
+    const std::uint64_t occupancy_bytes = std::uint64_t{h.words_per_row} * h.height * sizeof(std::uint64_t);
+    const std::uint64_t tile_bytes = std::uint64_t{h.width} * h.height;
+    auto fits = [&](const std::uint64_t offset, const std::uint64_t bytes) {
+        return offset >= header_bytes && offset <= file.size() && bytes <= file.size() - offset;
+    };
+    if (h.occupancy_offset % alignof(std::uint64_t) != 0
+        || !fits(h.occupancy_offset, occupancy_bytes) || !fits(h.tiles_offset, tile_bytes)
+        || (h.door_count != 0 && !fits(h.doors_offset, std::uint64_t{h.door_count} * sizeof(MapFileDoor))))
+    {
+        std::fprintf(stderr, "%s: map planes exceed the file\n", path.c_str());
+        return std::nullopt;
+    }
+
+    Map map(static_cast<int>(h.width), static_cast<int>(h.height),
+            h.spawn_x, h.spawn_y, h.spawn_angle);
+    map.occupancy_ = reinterpret_cast<std::uint64_t *>(file.data() + h.occupancy_offset);
+    map.tiles_ = reinterpret_cast<std::uint8_t *>(file.data() + h.tiles_offset);
+    map.file_ = std::move(file);
+    map.pyramid_.build(map.occupancy_, map.width_, map.height_, map.words_per_row_);
+
+    for (std::uint32_t i = 0; i < h.door_count; ++i)
+    {
+        MapFileDoor d{};
+        std::memcpy(&d, map.file_.data() + h.doors_offset + std::uint64_t{i} * sizeof(d), sizeof(d));
+        if (d.x >= h.width || d.y >= h.height)
+        {
+            std::fprintf(stderr, "%s: door %u at (%u, %u) is off the map\n", path.c_str(), i, d.x, d.y);
+            return std::nullopt;
+        }
+        const int mx = static_cast<int>(d.x);
+        const int my = static_cast<int>(d.y);
+        map.add_door(mx, my, map.tile(mx, my));
+        map.doors_.back().vertical = (d.flags & 1u) != 0;
+        map.set_door_open(mx, my, d.open);
+    }
+    return map;
+}
+
+bool Map::save(const std::string &path) const
+{
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    const std::uint64_t occupancy_bytes = static_cast<std::uint64_t>(words_per_row_)
+                                          * static_cast<std::uint64_t>(height_) * sizeof(std::uint64_t);
+
+    MapFileHeader h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.width = static_cast<std::uint32_t>(width_);
+    h.height = static_cast<std::uint32_t>(height_);
+    h.words_per_row = static_cast<std::uint32_t>(words_per_row_);
+    h.spawn_x = spawn_x_;
+    h.spawn_y = spawn_y_;
+    h.spawn_angle = spawn_angle_;
+    h.occupancy_offset = align_up(sizeof(h));
+    const std::size_t tile_bytes = static_cast<std::size_t>(width_) * static_cast<std::size_t>(height_);
+    h.tiles_offset = align_up(h.occupancy_offset + occupancy_bytes);
+    h.doors_offset = align_up(h.tiles_offset + tile_bytes);
+    h.door_count = static_cast<std::uint32_t>(doors_.size());
+
+    std::vector<MapFileDoor> doors;
+    doors.reserve(doors_.size());
+    for (const Door &door : doors_)
+        doors.push_back({static_cast<std::uint32_t>(door.x), static_cast<std::uint32_t>(door.y),
+                         door.open, door.vertical ? 1u : 0u});
+
+    const std::array<char, kPlaneAlign> zeros{};
+
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = ok && std::fwrite(zeros.data(), 1, h.occupancy_offset - sizeof(h), f) == h.occupancy_offset - sizeof(h);
+    ok = ok && std::fwrite(occupancy_, 1, occupancy_bytes, f) == occupancy_bytes;
+    const std::uint64_t pad = h.tiles_offset - h.occupancy_offset - occupancy_bytes;
+    ok = ok && std::fwrite(zeros.data(), 1, pad, f) == pad;
+    ok = ok && std::fwrite(tiles_, 1, tile_bytes, f) == tile_bytes;
+    const std::uint64_t door_pad = h.doors_offset - h.tiles_offset - tile_bytes;
+    ok = ok && std::fwrite(zeros.data(), 1, door_pad, f) == door_pad;
+    ok = ok && std::fwrite(doors.data(), sizeof(MapFileDoor), doors.size(), f) == doors.size();
+    ok = std::fclose(f) == 0 && ok;
+
+    if (!ok)
+        std::fprintf(stderr, "Failed writing %s\n", path.c_str());
+    return ok;
+}
+
+void Map::set_wall_bit(const int mx, const int my, const bool wall) noexcept
+{
+    std::uint64_t &word = occupancy_[static_cast<std::size_t>(my) * words_per_row_ + static_cast<std::size_t>(mx >> 6)];
+    const std::uint64_t bit = std::uint64_t{1} << (mx & 63);
+    if (((word & bit) != 0) == wall)
+        return;
+    word ^= bit;
+    pyramid_.update(occupancy_, words_per_row_, mx, my);
+}
+
+void Map::set_tile(const int mx, const int my, const std::uint8_t tile)
+{
+    if (static_cast<unsigned>(mx) >= static_cast<unsigned>(width_)
+        || static_cast<unsigned>(my) >= static_cast<unsigned>(height_))
+        return;
+    if (is_door(mx, my))
+        remove_door(mx, my);
+    tiles_[static_cast<std::size_t>(my) * static_cast<std::size_t>(width_) + static_cast<std::size_t>(mx)] = tile;
+    set_wall_bit(mx, my, tile != 0);
+    touch(mx, my);
+}
+
+void Map::add_door(const int mx, const int my, const std::uint8_t tile)
+{
+    if (static_cast<unsigned>(mx) >= static_cast<unsigned>(width_)
+        || static_cast<unsigned>(my) >= static_cast<unsigned>(height_))
+        return;
+    if (is_door(mx, my))
+        remove_door(mx, my);
+
+    tiles_[static_cast<std::size_t>(my) * static_cast<std::size_t>(width_) + static_cast<std::size_t>(mx)] =
+        std::max<std::uint8_t>(tile, 1);
+    set_wall_bit(mx, my, true);
+    door_bits_[static_cast<std::size_t>(my) * words_per_row_ + static_cast<std::size_t>(mx >> 6)] |=
+        std::uint64_t{1} << (mx & 63);
+
+    Door door;
+    door.x = mx;
+    door.y = my;
+    door.vertical = (is_wall(mx, my - 1) && is_wall(mx, my + 1)) || !(is_wall(mx - 1, my) && is_wall(mx + 1, my));
+    door_index_[cell_key(width_, mx, my)] = static_cast<std::uint32_t>(doors_.size());
+    doors_.push_back(door);
+    touch(mx, my);
+}
+
+// Swaps the last door into the removed one's slot.
+void Map::remove_door(const int mx, const int my)
+{
+    const auto it = door_index_.find(cell_key(width_, mx, my));
+    const std::uint32_t index = it->second;
+    door_index_.erase(it);
+    door_bits_[static_cast<std::size_t>(my) * words_per_row_ + static_cast<std::size_t>(mx >> 6)] &=
+        ~(std::uint64_t{1} << (mx & 63));
+
+    const auto last = static_cast<std::uint32_t>(doors_.size() - 1);
+    if (index != last)
+    {
+        doors_[index] = doors_[last];
+        door_index_[cell_key(width_, doors_[index].x, doors_[index].y)] = index;
+    }
+    doors_.pop_back();
+    std::erase(moving_, index);
+    std::ranges::replace(moving_, last, index);
+}
+
+const Map::Door *Map::door(const int mx, const int my) const noexcept
+{
+    if (!is_door(mx, my))
+        return nullptr;
+    return &doors_[door_index_.find(cell_key(width_, mx, my))->second];
+}
+
+bool Map::toggle_door(const int mx, const int my)
+{
+    if (!is_door(mx, my))
+        return false;
+    const std::uint32_t index = door_index_.find(cell_key(width_, mx, my))->second;
+    Door &door = doors_[index];
+    const bool close = door.moving > 0 || (door.moving == 0 && door.open == kDoorOpen);
+    if (door.moving == 0)
+        moving_.push_back(index);
+    door.moving = close ? -1 : 1;
+    return true;
+}
+
+void Map::set_door_open(const int mx, const int my, const std::int32_t open)
+{
+    if (!is_door(mx, my))
+        return;
+    const std::uint32_t index = door_index_.find(cell_key(width_, mx, my))->second;
+    Door &door = doors_[index];
+    if (door.moving != 0)
+        std::erase(moving_, index);
+    door.moving = 0;
+    door.open = std::clamp(open, 0, kDoorOpen);
+    touch(mx, my);
+}
+
+void Map::step_doors(const float dt)
+{
+    const auto step = static_cast<std::int32_t>(dt * kDoorSpeed * static_cast<float>(kDoorOpen));
+    if (step <= 0)
+        return;
+
+    std::size_t kept = 0;
+    for (const std::uint32_t index : moving_)
+    {
+        Door &door = doors_[index];
+        door.open = std::clamp(door.open + door.moving * step, 0, kDoorOpen);
+        touch(door.x, door.y);
+        if (door.open == 0 || door.open == kDoorOpen)
+            door.moving = 0;
+        else
+            moving_[kept++] = index;
+    }
+    moving_.resize(kept);
+}
+
+void Map::touch(const int mx, const int my)
+{
+    const int region = (my >> kRegionShift) * regions_w() + (mx >> kRegionShift);
+    ++revision_;
+    region_revision_[static_cast<std::size_t>(region)] = revision_;
+    std::int32_t &entry = region_entry_[static_cast<std::size_t>(region)];
+    if (entry >= 0)
+        edits_[static_cast<std::size_t>(entry)].region = -1;
+    entry = static_cast<std::int32_t>(edits_.size());
+    edits_.push_back({revision_, region});
+    if (edits_.size() >= kEditLog)
+        trim_edits();
+}
+
+void Map::trim_edits()
+{
+    std::erase_if(edits_, [](const Edit &e) { return e.region < 0; });
+    if (edits_.size() > kEditLog / 2)
+    {
+        const std::size_t drop = edits_.size() - kEditLog / 2;
+        log_floor_ = edits_[drop - 1].revision;
+        for (std::size_t i = 0; i < drop; ++i)
+            region_entry_[static_cast<std::size_t>(edits_[i].region)] = -1;
+        edits_.erase(edits_.begin(), edits_.begin() + static_cast<std::ptrdiff_t>(drop));
+    }
+    for (std::size_t i = 0; i < edits_.size(); ++i)
+        region_entry_[static_cast<std::size_t>(edits_[i].region)] = static_cast<std::int32_t>(i);
+}
+
+std::uint64_t Map::region_revision(const int rx, const int ry) const noexcept
+{
+    if (static_cast<unsigned>(rx) >= static_cast<unsigned>(regions_w())
+        || static_cast<unsigned>(ry) >= static_cast<unsigned>(regions_h()))
+        return 0;
+    return region_revision_[static_cast<std::size_t>(ry) * static_cast<std::size_t>(regions_w())
+                            + static_cast<std::size_t>(rx)];
+}
+
+bool Map::edited_since(const std::uint64_t revision, std::vector<MapRegion> &regions, const std::size_t limit) const
+{
+    if (revision < log_floor_)
+        return false;
+
+    const int regions_x = regions_w();
+    std::size_t found = 0;
+    const auto first = std::ranges::upper_bound(edits_, revision, {}, &Edit::revision);
+    for (auto it = first; it != edits_.end(); ++it)
+    {
+        if (it->region < 0)
+            continue;
+        if (++found > limit)
+            return false;
+        const int rx = it->region % regions_x;
+        const int ry = it->region / regions_x;
+        regions.push_back({rx << kRegionShift, ry << kRegionShift,
+                           std::min((rx + 1) << kRegionShift, width_), std::min((ry + 1) << kRegionShift, height_)});
+    }
+    return true;
+}
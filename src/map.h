@@ -1,32 +1,204 @@
 #pragma once
 
-#include <array>
+#include "mapped_file.h"
+#include "occupancy_pyramid.h"
+
 #include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cells [x0, x1) x [y0, y1).
+struct MapRegion
+{
+    int x0 = 0, y0 = 0;
+    int x1 = 0, y1 = 0;
+};
 
-struct Map
+// Tile grid the ray caster walks. Occupancy is a bit-packed plane (one
+// uint64_t word per 64 tiles of a row) and is what traversal and collision
+// read; tile types live in a separate byte plane for shading. Both planes
+// either point into a copy-on-write mapping of a map file or into owned
+// storage, so an edit copies at most the page it lands on.
+//
+// Every edit bumps revision() and stamps the kRegionSize x kRegionSize
+// region it touched with the new revision, so whatever is derived from the
+// map (the pyramid, cached ray hits, the minimap) catches up on just those
+// regions: edited_since lists them from a bounded log of recent edits.
+class Map
 {
-    static constexpr int kWidth = 8;
-    static constexpr int kHeight = 11;
+public:
     static constexpr int kCellSize = 88;
+    static constexpr int kRegionShift = OccupancyPyramid::kShift;
+    static constexpr int kRegionSize = 1 << kRegionShift;
 
-    static constexpr std::array<int, kWidth * kHeight> kTiles = {
-        1, 1, 1, 1, 1, 1, 1, 1,
-        1, 0, 0, 0, 0, 0, 0, 1,
-        1, 0, 0, 1, 1, 0, 0, 1,
-        1, 0, 0, 1, 1, 0, 0, 1,
-        1, 0, 0, 1, 0, 0, 0, 1,
-        1, 0, 0, 0, 0, 1, 1, 1,
-        1, 1, 1, 0, 0, 0, 0, 1,
-        1, 0, 1, 0, 0, 0, 0, 1,
-        1, 0, 1, 1, 1, 1, 0, 1,
-        1, 0, 0, 0, 0, 0, 0, 1,
-        1, 1, 1, 1, 1, 1, 1, 1,
+    // A sliding door, as in Wolfenstein 3-D. The cell counts as wall for
+    // is_wall and the pyramid, but rays only stop at the door's panel on
+    // the cell's mid line, which slides sideways into the jamb as it opens.
+    struct Door
+    {
+        int x = 0, y = 0;
+        // Panel on the line x = const, across an east-west passage; hits on
+        // it are RayHit::vertical like those on x = const cell faces.
+        bool vertical = false;
+        std::int8_t moving = 0; // +1 opening, -1 closing, 0 at rest
+        // From 0 (shut) to kDoorOpen; the panel covers the [open, 1) part of
+        // the cell along its line.
+        std::int32_t open = 0;
     };
+    static constexpr std::int32_t kDoorOpen = 1 << 16;
+    static constexpr float kDoorSpeed = 1.0f; // cells per second
+
+    // The built-in 8x11 level.
+    Map();
+
+    Map(const Map &) = delete;
+    Map &operator=(const Map &) = delete;
+    Map(Map &&) noexcept = default;
+    Map &operator=(Map &&) noexcept = default;
+
+    // Builds a map from one byte per tile, row-major; non-zero is wall.
+    [[nodiscard]] static Map from_tiles(int width, int height, std::vector<std::uint8_t> tiles,
+                                        float spawn_x, float spawn_y, float spawn_angle);
+    // Walled arena with randomly scattered pillars covering roughly fill of
+    // the interior; spawns at the free cell closest to the centre.
+    [[nodiscard]] static Map generate(int width, int height, float fill, std::uint32_t seed);
 
-    [[nodiscard]] static constexpr bool is_wall(int mx, int my) noexcept
+    // Maps a .tdmap file copy-on-write: edits never reach the file. Prints
+    // the reason and returns nullopt on a missing, truncated or malformed
+    // file.
+    [[nodiscard]] static std::optional<Map> load(const std::string &path);
+    // Writes a version 2 .tdmap file, doors included; moving doors are
+    // saved at rest where they are.
+    [[nodiscard]] bool save(const std::string &path) const;
+
+    [[nodiscard]] int width() const noexcept { return width_; }
+    [[nodiscard]] int height() const noexcept { return height_; }
+
+    // Out-of-bounds cells count as wall.
+    [[nodiscard]] bool is_wall(const int mx, const int my) const noexcept
     {
-        if (mx < 0 || my < 0 || mx >= kWidth || my >= kHeight)
+        if (static_cast<unsigned>(mx) >= static_cast<unsigned>(width_)
+            || static_cast<unsigned>(my) >= static_cast<unsigned>(height_))
             return true;
-        return kTiles[static_cast<std::size_t>(my) * kWidth + static_cast<std::size_t>(mx)] == 1;
+        const std::uint64_t word = occupancy_[static_cast<std::size_t>(my) * words_per_row_
+                                              + static_cast<std::size_t>(mx >> 6)];
+        return ((word >> (mx & 63)) & 1u) != 0;
+    }
+
+    [[nodiscard]] std::uint8_t tile(const int mx, const int my) const noexcept
+    {
+        if (static_cast<unsigned>(mx) >= static_cast<unsigned>(width_)
+            || static_cast<unsigned>(my) >= static_cast<unsigned>(height_))
+            return 1;
+        return tiles_[static_cast<std::size_t>(my) * static_cast<std::size_t>(width_)
+                      + static_cast<std::size_t>(mx)];
+    }
+
+    // Sets the tile type of an in-bounds cell, 0 for open floor, replacing
+    // any door there.
+    void set_tile(int mx, int my, std::uint8_t tile);
+
+    // Turns an in-bounds cell into a shut door drawn with tile type tile.
+    // The panel runs between the two neighbours that are wall, along y
+    // unless only the x neighbours are.
+    void add_door(int mx, int my, std::uint8_t tile);
+    [[nodiscard]] bool has_doors() const noexcept { return !doors_.empty(); }
+    [[nodiscard]] int doors() const noexcept { return static_cast<int>(doors_.size()); }
+    [[nodiscard]] bool is_door(const int mx, const int my) const noexcept
+    {
+        if (static_cast<unsigned>(mx) >= static_cast<unsigned>(width_)
+            || static_cast<unsigned>(my) >= static_cast<unsigned>(height_))
+            return false;
+        const std::uint64_t word = door_bits_[static_cast<std::size_t>(my) * words_per_row_
+                                              + static_cast<std::size_t>(mx >> 6)];
+        return ((word >> (mx & 63)) & 1u) != 0;
+    }
+    // The door in cell (mx, my), or null.
+    [[nodiscard]] const Door *door(int mx, int my) const noexcept;
+    [[nodiscard]] const Door &door(const int index) const noexcept
+    {
+        return doors_[static_cast<std::size_t>(index)];
     }
+    // Starts the door opening, or closing when it is open or opening.
+    // False when there is no door at (mx, my).
+    bool toggle_door(int mx, int my);
+    // Puts the door at rest, open by open of kDoorOpen.
+    void set_door_open(int mx, int my, std::int32_t open);
+    // Slides every moving door on by dt seconds; costs nothing per door at rest.
+    void step_doors(float dt);
+    [[nodiscard]] int moving_doors() const noexcept { return static_cast<int>(moving_.size()); }
+
+    // Bumped by every edit; 0 until the first.
+    [[nodiscard]] std::uint64_t revision() const noexcept { return revision_; }
+    [[nodiscard]] int regions_w() const noexcept { return (width_ + kRegionSize - 1) >> kRegionShift; }
+    [[nodiscard]] int regions_h() const noexcept { return (height_ + kRegionSize - 1) >> kRegionShift; }
+    // Revision of the last edit in region (rx, ry); 0 if it was never edited.
+    [[nodiscard]] std::uint64_t region_revision(int rx, int ry) const noexcept;
+    // Appends the regions edited after revision, each once, clipped to the
+    // map. False when the edit log no longer reaches back that far, or more
+    // than limit regions turn up: everything counts as edited then.
+    [[nodiscard]] bool edited_since(std::uint64_t revision, std::vector<MapRegion> &regions,
+                                    std::size_t limit = SIZE_MAX) const;
+
+    [[nodiscard]] const std::uint64_t *occupancy() const noexcept { return occupancy_; }
+    [[nodiscard]] int words_per_row() const noexcept { return words_per_row_; }
+    // Built whenever the occupancy plane is set; rays use it to skip open space.
+    [[nodiscard]] const OccupancyPyramid &pyramid() const noexcept { return pyramid_; }
+
+    // Upper bound on the cells a ray crosses before leaving the grid.
+    [[nodiscard]] int max_ray_steps() const noexcept { return width_ + height_; }
+
+    [[nodiscard]] float spawn_x() const noexcept { return spawn_x_; }
+    [[nodiscard]] float spawn_y() const noexcept { return spawn_y_; }
+    [[nodiscard]] float spawn_angle() const noexcept { return spawn_angle_; }
+
+private:
+    // Also sizes the door plane, the region stamps and the edit log, so
+    // edits never allocate them mid-frame.
+    Map(int width, int height, float spawn_x, float spawn_y, float spawn_angle);
+
+    void set_wall_bit(int mx, int my, bool wall) noexcept;
+    void remove_door(int mx, int my);
+    // Records an edit of cell (mx, my).
+    void touch(int mx, int my);
+    void trim_edits();
+
+    int width_ = 0;
+    int height_ = 0;
+    int words_per_row_ = 0;
+    float spawn_x_ = 0.0f;
+    float spawn_y_ = 0.0f;
+    float spawn_angle_ = 0.0f;
+
+    std::uint64_t *occupancy_ = nullptr;
+    std::uint8_t *tiles_ = nullptr;
+    OccupancyPyramid pyramid_;
+
+    MappedFile file_;
+    std::vector<std::uint64_t> owned_occupancy_;
+    std::vector<std::uint8_t> owned_tiles_;
+
+    // Same layout as the occupancy plane.
+    std::vector<std::uint64_t> door_bits_;
+    std::vector<Door> doors_;
+    std::unordered_map<std::uint64_t, std::uint32_t> door_index_; // cell -> doors_
+    std::vector<std::uint32_t> moving_;                            // doors_ in motion
+
+    // Edit log, oldest first. A region edited again has its older entry
+    // blanked (region -1), so live entries never outnumber the regions;
+    // once the log fills it drops the blanks, then the oldest half.
+    struct Edit
+    {
+        std::uint64_t revision;
+        std::int32_t region;
+    };
+    static constexpr std::size_t kEditLog = 1 << 14;
+    std::uint64_t revision_ = 0;
+    std::uint64_t log_floor_ = 0;             // edits after this are all in the log
+    std::vector<Edit> edits_;
+    std::vector<std::uint64_t> region_revision_;
+    std::vector<std::int32_t> region_entry_;     // each region's live entry in edits_, or -1
 };
@@ -0,0 +1,145 @@
+#include "mapped_file.h"
+
+#include <cstdio>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0))
+#ifdef _WIN32
+      , file_(std::exchange(other.file_, nullptr)),
+      mapping_(std::exchange(other.mapping_, nullptr))
+#endif
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path, const bool copy_on_write)
+{
+    close();
+
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        file_ = nullptr;
+        std::fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file_, &size) || size.QuadPart <= 0)
+    {
+        std::fprintf(stderr, "Cannot map empty file %s\n", path.c_str());
+        close();
+        return false;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    void *view = mapping_ ? MapViewOfFile(mapping_, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view)
+    {
+        std::fprintf(stderr, "Cannot map %s\n", path.c_str());
+        close();
+        return false;
+    }
+
+    data_ = static_cast<std::byte *>(view);
+    size_ = static_cast<std::size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+    data_ = nullptr;
+    size_ = 0;
+    mapping_ = nullptr;
+    file_ = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path, const bool copy_on_write)
+{
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "Cannot open %s\n", path.c_str());
+        return false;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        std::fprintf(stderr, "Cannot map empty file %s\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void *view = mmap(nullptr, size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        std::fprintf(stderr, "Cannot map %s\n", path.c_str());
+        return false;
+    }
+
+    data_ = static_cast<std::byte *>(view);
+    size_ = size;
+    return true;
+}
+
+void MappedFile::close() noexcept
+{
+    if (data_)
+        munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
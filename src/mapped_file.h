@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// View of a whole file through the OS page cache (mmap on POSIX, a file
+// mapping on Windows). Nothing is copied onto the heap. Read-only unless
+// opened copy-on-write: then writes land in private copies of just the
+// pages they touch and never reach the file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    [[nodiscard]] bool open(const std::string &path, bool copy_on_write = false);
+    void close() noexcept;
+
+    [[nodiscard]] const std::byte *data() const noexcept { return data_; }
+    // Only for a copy-on-write view.
+    [[nodiscard]] std::byte *data() noexcept { return data_; }
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+
+private:
+    std::byte *data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,123 @@
+#include "occupancy_pyramid.h"
+
+#include <algorithm>
+
+namespace
+{
+
+constexpr int kSide = 1 << OccupancyPyramid::kShift;
+
+int words_for(const int width) noexcept
+{
+    return (width + 63) / 64;
+}
+
+// ORs each kSide x kSide group of src bits into one dst bit. Rows below the
+// source and padding bits past its width count as occupied, so blocks that
+// straddle the map edge are never reported empty.
+void reduce_level(const std::uint64_t *src, const int src_w, const int src_h, const int src_wpr,
+                  std::uint64_t *dst, const int dst_w, const int dst_h, const int dst_wpr)
+{
+    const std::uint64_t tail_pad = src_w % 64 ? ~std::uint64_t{0} << (src_w % 64) : 0;
+
+    for (int by = 0; by < dst_h; ++by)
+    {
+        std::uint64_t *dst_row = dst + static_cast<std::size_t>(by) * dst_wpr;
+        std::fill_n(dst_row, dst_wpr, 0);
+
+        for (int w = 0; w < src_wpr; ++w)
+        {
+            std::uint64_t merged = w == src_wpr - 1 ? tail_pad : 0;
+            for (int dy = 0; dy < kSide; ++dy)
+            {
+                const int y = by * kSide + dy;
+                merged |= y < src_h ? src[static_cast<std::size_t>(y) * src_wpr + static_cast<std::size_t>(w)]
+                                    : ~std::uint64_t{0};
+            }
+
+            // Each byte of a source word is one block column of the level.
+            for (int b = 0; b < 8; ++b)
+            {
+                const int bx = w * 8 + b;
+                if (bx < dst_w && ((merged >> (b * 8)) & 0xffu) != 0)
+                    dst_row[bx >> 6] |= std::uint64_t{1} << (bx & 63);
+            }
+        }
+    }
+}
+
+// The one dst bit (bx, by) of reduce_level.
+void reduce_block(const std::uint64_t *src, const int src_w, const int src_h, const int src_wpr,
+                  std::uint64_t *dst, const int dst_wpr, const int bx, const int by) noexcept
+{
+    const int w = bx >> 3; // eight blocks per source word, a byte each
+    std::uint64_t merged = w == src_wpr - 1 && src_w % 64 ? ~std::uint64_t{0} << (src_w % 64) : 0;
+    for (int dy = 0; dy < kSide; ++dy)
+    {
+        const int y = by * kSide + dy;
+        merged |= y < src_h ? src[static_cast<std::size_t>(y) * src_wpr + static_cast<std::size_t>(w)]
+                            : ~std::uint64_t{0};
+    }
+
+    std::uint64_t &word = dst[static_cast<std::size_t>(by) * dst_wpr + static_cast<std::size_t>(bx >> 6)];
+    const std::uint64_t bit = std::uint64_t{1} << (bx & 63);
+    word = ((merged >> ((bx & 7) * 8)) & 0xffu) != 0 ? word | bit : word & ~bit;
+}
+
+} // namespace
+
+void OccupancyPyramid::build(const std::uint64_t *occupancy, const int width, const int height,
+                             const int words_per_row)
+{
+    width_ = width;
+    height_ = height;
+    levels_.clear();
+    std::size_t total = 0;
+    for (int w = width, h = height; w > 1 || h > 1;)
+    {
+        w = (w + kSide - 1) / kSide;
+        h = (h + kSide - 1) / kSide;
+        levels_.push_back({w, h, words_for(w), total});
+        total += static_cast<std::size_t>(words_for(w)) * static_cast<std::size_t>(h);
+    }
+    bits_.assign(total, 0);
+
+    const std::uint64_t *src = occupancy;
+    int src_w = width;
+    int src_h = height;
+    int src_wpr = words_per_row;
+    for (const LevelInfo &l : levels_)
+    {
+        std::uint64_t *dst = bits_.data() + l.offset;
+        reduce_level(src, src_w, src_h, src_wpr, dst, l.width, l.height, l.words_per_row);
+        src = dst;
+        src_w = l.width;
+        src_h = l.height;
+        src_wpr = l.words_per_row;
+    }
+}
+
+void OccupancyPyramid::update(const std::uint64_t *occupancy, const int words_per_row, const int mx,
+                              const int my) noexcept
+{
+    if (levels_.empty())
+        return;
+
+    const std::uint64_t *src = occupancy;
+    int src_w = width_;
+    int src_h = height_;
+    int src_wpr = words_per_row;
+    int bx = mx;
+    int by = my;
+    for (const LevelInfo &l : levels_)
+    {
+        bx >>= kShift;
+        by >>= kShift;
+        std::uint64_t *dst = bits_.data() + l.offset;
+        reduce_block(src, src_w, src_h, src_wpr, dst, l.words_per_row, bx, by);
+        src = dst;
+        src_w = l.width;
+        src_h = l.height;
+        src_wpr = l.words_per_row;
+    }
+}
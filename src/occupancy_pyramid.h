@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Coarse occupancy levels over a bit-packed tile grid, used to skip empty
+// space during ray traversal. Level L groups 8^L x 8^L cells into one block;
+// a set bit means the block holds a wall or reaches past the map edge. Each
+// level is packed like the map's occupancy plane (64 blocks per uint64_t,
+// rows padded to whole words), so a 4096x4096 map adds about 33 KiB.
+class OccupancyPyramid
+{
+public:
+    static constexpr int kShift = 3; // log2 of the block side per level
+
+    struct Level
+    {
+        int width = 0;
+        int height = 0;
+        int words_per_row = 0;
+        const std::uint64_t *bits = nullptr;
+    };
+
+    OccupancyPyramid() = default;
+
+    OccupancyPyramid(const OccupancyPyramid &) = delete;
+    OccupancyPyramid &operator=(const OccupancyPyramid &) = delete;
+    OccupancyPyramid(OccupancyPyramid &&) noexcept = default;
+    OccupancyPyramid &operator=(OccupancyPyramid &&) noexcept = default;
+
+    // Rebuilds every level from the cell grid, up to a single block.
+    void build(const std::uint64_t *occupancy, int width, int height, int words_per_row);
+    // Redoes only the block containing cell (mx, my) on each level, after
+    // that cell changed; the grid must have the size build last saw.
+    void update(const std::uint64_t *occupancy, int words_per_row, int mx, int my) noexcept;
+
+    // Number of coarse levels; level(0) is the 8x8 one.
+    [[nodiscard]] int levels() const noexcept { return static_cast<int>(levels_.size()); }
+    [[nodiscard]] Level level(const int i) const noexcept
+    {
+        const LevelInfo &l = levels_[static_cast<std::size_t>(i)];
+        return {l.width, l.height, l.words_per_row, bits_.data() + l.offset};
+    }
+
+    // Coarsest level whose block around cell (mx, my) is empty, counted from
+    // 1 for the 8x8 blocks; 0 when even that block is occupied. The empty
+    // block spans 1 << (kShift * result) cells per side.
+    [[nodiscard]] int empty_level(const int mx, const int my) const noexcept
+    {
+        const std::uint64_t *bits = bits_.data();
+        int found = 0;
+        for (const LevelInfo &l : levels_)
+        {
+            const int shift = kShift * (found + 1);
+            const int bx = mx >> shift;
+            const int by = my >> shift;
+            if (static_cast<unsigned>(bx) >= static_cast<unsigned>(l.width)
+                || static_cast<unsigned>(by) >= static_cast<unsigned>(l.height))
+                break;
+            const std::uint64_t word = bits[l.offset + static_cast<std::size_t>(by) * l.words_per_row
+                                            + static_cast<std::size_t>(bx >> 6)];
+            if ((word >> (bx & 63)) & 1u)
+                break;
+            ++found;
+        }
+        return found;
+    }
+
+private:
+    struct LevelInfo
+    {
+        int width = 0;
+        int height = 0;
+        int words_per_row = 0;
+        std::size_t offset = 0;
+    };
+
+    int width_ = 0; // of the cell grid
+    int height_ = 0;
+    std::vector<LevelInfo> levels_;
+    std::vector<std::uint64_t> bits_;
+};
@@ -1,9 +1,10 @@
 #pragma once
 
 #include "math_utils.h"
-#include "input.h"
 #include <cmath>
 
+class Input;
+
 struct Player
 {
     float x = 150.0f;
@@ -20,31 +21,27 @@ struct Player
         dy = -std::sin(math::deg_to_rad(angle));
     }
 
-    void update(const Input &input, const float dt) noexcept
+    void spawn(const float sx, const float sy, const float sangle) noexcept
+    {
+        x = sx;
+        y = sy;
+        angle = math::fix_angle(sangle);
+        update_direction();
+    }
+
+    void update(const Input &input, float dt) noexcept;
+
+    // t of the way from a to b, turning the short way round.
+    [[nodiscard]] static Player lerp(const Player &a, const Player &b, const float t) noexcept
     {
-        constexpr float kRotSpeed = 120.0f;
-        constexpr float kMoveSpeed = 120.0f;
-
-        bool rotated = false;
-        if (input.down(SDL_SCANCODE_LEFT))
-        {
-            angle = math::fix_angle(angle + kRotSpeed * dt);
-            rotated = true;
-        }
-        if (input.down(SDL_SCANCODE_RIGHT))
-        {
-            angle = math::fix_angle(angle - kRotSpeed * dt);
-            rotated = true;
-        }
-        if (rotated)
-            update_direction();
-
-        const float rx = -dy;
-        const float ry = dx;
-
-        if (input.down(SDL_SCANCODE_W)) { x += dx * kMoveSpeed * dt; y += dy * kMoveSpeed * dt; }
-        if (input.down(SDL_SCANCODE_S)) { x -= dx * kMoveSpeed * dt; y -= dy * kMoveSpeed * dt; }
-        if (input.down(SDL_SCANCODE_D)) { x += rx * kMoveSpeed * dt; y += ry * kMoveSpeed * dt; }
-        if (input.down(SDL_SCANCODE_A)) { x -= rx * kMoveSpeed * dt; y -= ry * kMoveSpeed * dt; }
+        float turn = b.angle - a.angle;
+        if (turn > 180.0f)
+            turn -= 360.0f;
+        else if (turn < -180.0f)
+            turn += 360.0f;
+
+        Player p;
+        p.spawn(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.angle + turn * t);
+        return p;
     }
 };
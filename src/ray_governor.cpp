@@ -0,0 +1,57 @@
+#include "ray_governor.h"
+
+#include <algorithm>
+#include <cmath>
+
+RayGovernor::RayGovernor(const double budget_ms, const int settle_frames) noexcept
+    : budget_ms_(budget_ms), settle_frames_(settle_frames)
+{
+}
+
+void RayGovernor::set_budget(const double budget_ms) noexcept
+{
+    budget_ms_ = budget_ms;
+    reset();
+}
+
+void RayGovernor::reset() noexcept
+{
+    settle_ = 0;
+    samples_ = 0;
+    smoothed_ms_ = -1.0;
+}
+
+int RayGovernor::update(const double cost_ms, const int rays, const int max_rays) noexcept
+{
+    const int hi = std::max(max_rays, kMinRays);
+    const int clamped = std::clamp(rays, kMinRays, hi);
+    if (clamped != rays)
+    {
+        reset();
+        settle_ = settle_frames_;
+        return clamped;
+    }
+    if (settle_ > 0)
+    {
+        --settle_;
+        return rays;
+    }
+
+    smoothed_ms_ = smoothed_ms_ < 0.0 ? cost_ms : smoothed_ms_ + kSmoothing * (cost_ms - smoothed_ms_);
+    if (++samples_ < kMinSamples)
+        return rays;
+    if (smoothed_ms_ <= budget_ms_ && smoothed_ms_ >= kLow * budget_ms_)
+        return rays;
+
+    // Part of the cost does not scale with rays, so a step falls a little
+    // short of the target in either direction and stays inside the band.
+    const double target = 0.5 * (1.0 + kLow) * budget_ms_;
+    const double scale = std::clamp(target / std::max(smoothed_ms_, 1e-3), 0.5, kMaxGrow);
+    const int next = std::clamp(static_cast<int>(std::lround(rays * scale)), kMinRays, hi);
+    if (next != rays)
+    {
+        reset();
+        settle_ = settle_frames_;
+    }
+    return next;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Picks the ray count that keeps a frame's ray cast, batch and submit time
+// under a budget. Frame costs are smoothed, and the count only moves when
+// the smoothed cost rises above the budget or falls below kLow of it; the
+// step aims for the middle of that band assuming cost scales with rays.
+// After a change the governor sits out settle frames, so frames still in
+// flight with the old count (one more when casting is pipelined) are not
+// mistaken for the result.
+class RayGovernor
+{
+public:
+    static constexpr double kLow = 0.75;     // grow below this share of the budget
+    static constexpr double kMaxGrow = 1.25; // per step; shrinking can halve
+    static constexpr int kMinRays = 64;
+
+    explicit RayGovernor(double budget_ms = 8.0, int settle_frames = 8) noexcept;
+
+    void set_budget(double budget_ms) noexcept;
+    [[nodiscard]] double budget_ms() const noexcept { return budget_ms_; }
+    // Smoothed cost since the last change, or 0 before the first sample.
+    [[nodiscard]] double smoothed_ms() const noexcept { return smoothed_ms_ > 0.0 ? smoothed_ms_ : 0.0; }
+
+    // One frame's cost and the rays it was cast with; returns the count to
+    // cast with next, clamped to [kMinRays, max_rays].
+    [[nodiscard]] int update(double cost_ms, int rays, int max_rays) noexcept;
+    // Forgets the history, e.g. after the view size changed.
+    void reset() noexcept;
+
+private:
+    static constexpr double kSmoothing = 0.2; // weight of the newest frame
+    static constexpr int kMinSamples = 4;
+
+    double budget_ms_;
+    int settle_frames_;
+    int settle_ = 0;
+    int samples_ = 0;
+    double smoothed_ms_ = -1.0;
+};
@@ -0,0 +1,514 @@
+#include "ray_packet.h"
+#include "map.h"
+
+#include <climits>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TRYDOOM_X86_64 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TRYDOOM_TARGET_AVX2
+#else
+#define TRYDOOM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define TRYDOOM_X86_64 0
+#endif
+
+namespace
+{
+
+constexpr auto kCellF = static_cast<float>(Map::kCellSize);
+
+// Builds the RayHit the scalar DDA would report for a lane that stopped in
+// cell (mx, my) at ray length t.
+RayHit lane_hit(float dir_x, float dir_y, float px, float py,
+                float t, bool vertical, int mx, int my) noexcept
+{
+    RayHit hit;
+    if (t == FLT_MAX)
+        return hit;
+
+    hit.dist = t;
+    hit.vertical = vertical;
+    if (vertical)
+    {
+        hit.x = static_cast<float>(dir_x > 0.0f ? mx : mx + 1) * kCellF;
+        hit.y = py + dir_y * t;
+    }
+    else
+    {
+        hit.x = px + dir_x * t;
+        hit.y = static_cast<float>(dir_y > 0.0f ? my : my + 1) * kCellF;
+    }
+    return hit;
+}
+
+#if TRYDOOM_X86_64
+
+bool cpu_has_avx2() noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 1);
+    const bool osxsave = (regs[2] & (1 << 27)) != 0;
+    const bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx)
+        return false;
+    __cpuidex(regs, 7, 0);
+    const bool avx2 = (regs[1] & (1 << 5)) != 0;
+    return avx2 && (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) noexcept
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128i select_epi32(__m128i mask, __m128i a, __m128i b) noexcept
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Cell index of coord along one axis, clamped to [lo, hi] (lo >= 0, so
+// truncation is floor).
+inline __m128i cell_between_sse2(__m128 coord, __m128i lo, __m128i hi) noexcept
+{
+    const __m128 c = _mm_mul_ps(coord, _mm_set1_ps(1.0f / kCellF));
+    return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(c, _mm_cvtepi32_ps(lo)), _mm_cvtepi32_ps(hi)));
+}
+
+// SSE2 has no gather: the map and pyramid lookups are done per lane,
+// everything else (stepping, skipping, masking, hit bookkeeping) runs four
+// lanes wide.
+void cast_packet_sse2(const Map &map, const bool skip_empty, const float *dir_x, const float *dir_y,
+                      float px, float py, RayHit *out) noexcept
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 big = _mm_set1_ps(FLT_MAX);
+    const __m128 cell = _mm_set1_ps(kCellF);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 tiny = _mm_set1_ps(1e-6f);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i lane_bits = _mm_setr_epi32(1, 2, 4, 8);
+
+    const int mx0 = static_cast<int>(std::floor(px / kCellF));
+    const int my0 = static_cast<int>(std::floor(py / kCellF));
+
+    const __m128 dx = _mm_loadu_ps(dir_x);
+    const __m128 dy = _mm_loadu_ps(dir_y);
+    const __m128 pos_x = _mm_cmpgt_ps(dx, zero);
+    const __m128 pos_y = _mm_cmpgt_ps(dy, zero);
+    const __m128 walk_x = _mm_cmpge_ps(_mm_and_ps(dx, abs_mask), tiny);
+    const __m128 walk_y = _mm_cmpge_ps(_mm_and_ps(dy, abs_mask), tiny);
+
+    // pos ? 1 : -1
+    const __m128i step_x = _mm_sub_epi32(_mm_and_si128(_mm_castps_si128(pos_x), two), one);
+    const __m128i step_y = _mm_sub_epi32(_mm_and_si128(_mm_castps_si128(pos_y), two), one);
+
+    const __m128 t_delta_x = select_ps(walk_x, _mm_div_ps(cell, _mm_and_ps(dx, abs_mask)), big);
+    const __m128 t_delta_y = select_ps(walk_y, _mm_div_ps(cell, _mm_and_ps(dy, abs_mask)), big);
+
+    const __m128 bx = _mm_add_ps(_mm_set1_ps(static_cast<float>(mx0) * kCellF), _mm_and_ps(pos_x, cell));
+    const __m128 by = _mm_add_ps(_mm_set1_ps(static_cast<float>(my0) * kCellF), _mm_and_ps(pos_y, cell));
+    __m128 t_max_x = select_ps(walk_x, _mm_div_ps(_mm_sub_ps(bx, _mm_set1_ps(px)), dx), big);
+    __m128 t_max_y = select_ps(walk_y, _mm_div_ps(_mm_sub_ps(by, _mm_set1_ps(py)), dy), big);
+
+    __m128i mx = _mm_set1_epi32(mx0);
+    __m128i my = _mm_set1_epi32(my0);
+    __m128 active = _mm_cmpeq_ps(zero, zero);
+    __m128 hit_t = big;
+    __m128 hit_vert = zero;
+    __m128i hit_mx = mx;
+    __m128i hit_my = my;
+
+    const __m128 inv_dx = select_ps(walk_x, _mm_div_ps(_mm_set1_ps(1.0f), dx), zero);
+    const __m128 inv_dy = select_ps(walk_y, _mm_div_ps(_mm_set1_ps(1.0f), dy), zero);
+    const OccupancyPyramid &pyramid = map.pyramid();
+    int busy_bx[4] = {INT_MIN, INT_MIN, INT_MIN, INT_MIN};
+    int busy_by[4] = {INT_MIN, INT_MIN, INT_MIN, INT_MIN};
+
+    const int max_steps = map.max_ray_steps();
+    for (int i = 0; i < max_steps && _mm_movemask_ps(active) != 0; ++i)
+    {
+        // Ties go to the vertical boundary, as in the scalar DDA.
+        __m128 take_x = _mm_cmple_ps(t_max_x, t_max_y);
+
+        // Empty-block skip as in cast_ray_dir: skipping lanes jump to the
+        // last cell before the block's exit face and are forced across it.
+        if (skip_empty)
+        {
+            alignas(16) int lx[4];
+            alignas(16) int ly[4];
+            alignas(16) int size[4];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lx), mx);
+            _mm_store_si128(reinterpret_cast<__m128i *>(ly), my);
+            const int live = _mm_movemask_ps(active);
+            int skipping = 0;
+            for (int l = 0; l < 4; ++l)
+            {
+                size[l] = 1;
+                const int bx = lx[l] >> OccupancyPyramid::kShift;
+                const int by = ly[l] >> OccupancyPyramid::kShift;
+                if (!((live >> l) & 1) || (bx == busy_bx[l] && by == busy_by[l]))
+                    continue;
+                const int level = pyramid.empty_level(lx[l], ly[l]);
+                if (level == 0)
+                {
+                    busy_bx[l] = bx;
+                    busy_by[l] = by;
+                    continue;
+                }
+                size[l] = 1 << (OccupancyPyramid::kShift * level);
+                skipping |= 1 << l;
+            }
+            if (skipping != 0)
+            {
+                const __m128i pos_xi = _mm_castps_si128(pos_x);
+                const __m128i pos_yi = _mm_castps_si128(pos_y);
+                const __m128i sz = _mm_load_si128(reinterpret_cast<const __m128i *>(size));
+                const __m128 skip = _mm_castsi128_ps(_mm_cmpgt_epi32(sz, one));
+                const __m128i neg_sz = _mm_sub_epi32(_mm_setzero_si128(), sz);
+                const __m128i bx0 = _mm_and_si128(mx, neg_sz);
+                const __m128i by0 = _mm_and_si128(my, neg_sz);
+                const __m128i face_x = select_epi32(pos_xi, _mm_add_epi32(bx0, sz), bx0);
+                const __m128i face_y = select_epi32(pos_yi, _mm_add_epi32(by0, sz), by0);
+                const __m128i last_x = _mm_add_epi32(face_x, pos_xi);
+                const __m128i last_y = _mm_add_epi32(face_y, pos_yi);
+
+                const __m128 exit_x = select_ps(walk_x, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(face_x), cell), _mm_set1_ps(px)), inv_dx), big);
+                const __m128 exit_y = select_ps(walk_y, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(face_y), cell), _mm_set1_ps(py)), inv_dy), big);
+                const __m128 exit_on_x = _mm_cmple_ps(exit_x, exit_y);
+                const __m128i exit_on_xi = _mm_castps_si128(exit_on_x);
+
+                // The other axis lands on the exit point's cell, never behind
+                // the current one.
+                const __m128i ey = cell_between_sse2(_mm_add_ps(_mm_set1_ps(py), _mm_mul_ps(dy, exit_x)),
+                                                     select_epi32(pos_yi, my, last_y), select_epi32(pos_yi, last_y, my));
+                const __m128i ex = cell_between_sse2(_mm_add_ps(_mm_set1_ps(px), _mm_mul_ps(dx, exit_y)),
+                                                     select_epi32(pos_xi, mx, last_x), select_epi32(pos_xi, last_x, mx));
+                const __m128i new_mx = select_epi32(exit_on_xi, last_x, ex);
+                const __m128i new_my = select_epi32(exit_on_xi, ey, last_y);
+                const __m128 next_x = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(new_mx, pos_xi)), cell), _mm_set1_ps(px)), inv_dx);
+                const __m128 next_y = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(new_my, pos_yi)), cell), _mm_set1_ps(py)), inv_dy);
+                const __m128 new_t_x = select_ps(exit_on_x, exit_x, select_ps(walk_x, next_x, big));
+                const __m128 new_t_y = select_ps(exit_on_x, select_ps(walk_y, next_y, big), exit_y);
+
+                const __m128i skip_i = _mm_castps_si128(skip);
+                mx = select_epi32(skip_i, new_mx, mx);
+                my = select_epi32(skip_i, new_my, my);
+                t_max_x = select_ps(skip, new_t_x, t_max_x);
+                t_max_y = select_ps(skip, new_t_y, t_max_y);
+                take_x = select_ps(skip, exit_on_x, take_x);
+            }
+        }
+
+        const __m128i take_xi = _mm_castps_si128(take_x);
+        mx = _mm_add_epi32(mx, _mm_and_si128(take_xi, step_x));
+        my = _mm_add_epi32(my, _mm_andnot_si128(take_xi, step_y));
+        const __m128 t = select_ps(take_x, t_max_x, t_max_y);
+
+        alignas(16) int lx[4];
+        alignas(16) int ly[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(lx), mx);
+        _mm_store_si128(reinterpret_cast<__m128i *>(ly), my);
+        int bits = 0;
+        for (int l = 0; l < 4; ++l)
+            bits |= map.is_wall(lx[l], ly[l]) ? 1 << l : 0;
+        const __m128i wall_i = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lane_bits), lane_bits);
+        const __m128 wall = _mm_castsi128_ps(wall_i);
+
+        const __m128 new_hit = _mm_and_ps(wall, active);
+        const __m128i new_hit_i = _mm_castps_si128(new_hit);
+        hit_t = select_ps(new_hit, t, hit_t);
+        hit_vert = select_ps(new_hit, take_x, hit_vert);
+        hit_mx = select_epi32(new_hit_i, mx, hit_mx);
+        hit_my = select_epi32(new_hit_i, my, hit_my);
+        active = _mm_andnot_ps(wall, active);
+
+        t_max_x = _mm_add_ps(t_max_x, _mm_and_ps(take_x, t_delta_x));
+        t_max_y = _mm_add_ps(t_max_y, _mm_andnot_ps(take_x, t_delta_y));
+    }
+
+    alignas(16) float ts[4];
+    alignas(16) int hmx[4];
+    alignas(16) int hmy[4];
+    _mm_store_ps(ts, hit_t);
+    _mm_store_si128(reinterpret_cast<__m128i *>(hmx), hit_mx);
+    _mm_store_si128(reinterpret_cast<__m128i *>(hmy), hit_my);
+    const int vert_bits = _mm_movemask_ps(hit_vert);
+    for (int l = 0; l < 4; ++l)
+        out[l] = lane_hit(dir_x[l], dir_y[l], px, py, ts[l], (vert_bits >> l) & 1, hmx[l], hmy[l]);
+}
+
+TRYDOOM_TARGET_AVX2
+inline __m256i cell_between_avx2(__m256 coord, __m256i lo, __m256i hi) noexcept
+{
+    const __m256 c = _mm256_mul_ps(coord, _mm256_set1_ps(1.0f / kCellF));
+    return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(c, _mm256_cvtepi32_ps(lo)), _mm256_cvtepi32_ps(hi)));
+}
+
+// Block side (1 << (kShift * level)) of the coarsest empty pyramid block
+// around each lane's cell, 1 where there is none. Lanes outside probe are
+// left at 1. Each level is one masked gather, and the search stops as soon
+// as no lane is still climbing.
+TRYDOOM_TARGET_AVX2
+__m256i empty_block_size_avx2(const OccupancyPyramid &pyramid, __m256i mx, __m256i my, __m256i probe) noexcept
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i neg_one = _mm256_set1_epi32(-1);
+    const __m256i bit_mask = _mm256_set1_epi32(31);
+
+    __m256i size = one;
+    __m256i climbing = probe;
+    for (int i = 0; i < pyramid.levels(); ++i)
+    {
+        const OccupancyPyramid::Level level = pyramid.level(i);
+        const int shift = OccupancyPyramid::kShift * (i + 1);
+        const __m256i bx = _mm256_srai_epi32(mx, shift);
+        const __m256i by = _mm256_srai_epi32(my, shift);
+        const __m256i in_x = _mm256_and_si256(_mm256_cmpgt_epi32(bx, neg_one),
+                                              _mm256_cmpgt_epi32(_mm256_set1_epi32(level.width), bx));
+        const __m256i in_y = _mm256_and_si256(_mm256_cmpgt_epi32(by, neg_one),
+                                              _mm256_cmpgt_epi32(_mm256_set1_epi32(level.height), by));
+        const __m256i lookup = _mm256_and_si256(climbing, _mm256_and_si256(in_x, in_y));
+        if (_mm256_testz_si256(lookup, lookup))
+            break;
+
+        const __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(by, _mm256_set1_epi32(level.words_per_row * 2)),
+                                             _mm256_srai_epi32(bx, 5));
+        const __m256i word = _mm256_mask_i32gather_epi32(neg_one, reinterpret_cast<const int *>(level.bits),
+                                                         idx, lookup, 4);
+        const __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(bx, bit_mask)), one);
+        climbing = _mm256_and_si256(lookup, _mm256_cmpeq_epi32(bit, _mm256_setzero_si256()));
+        size = _mm256_blendv_epi8(size, _mm256_set1_epi32(1 << shift), climbing);
+    }
+    return size;
+}
+
+// Same walk eight lanes wide. The map lookup gathers the 32-bit half of
+// each lane's occupancy word and shifts its bit down; out-of-bounds lanes
+// are masked off the gather and read all ones, i.e. wall, like Map::is_wall.
+TRYDOOM_TARGET_AVX2
+void cast_packet_avx2(const Map &map, const bool skip_empty, const float *dir_x, const float *dir_y,
+                      float px, float py, RayHit *out) noexcept
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 big = _mm256_set1_ps(FLT_MAX);
+    const __m256 cell = _mm256_set1_ps(kCellF);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 tiny = _mm256_set1_ps(1e-6f);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i neg_one = _mm256_set1_epi32(-1);
+    const __m256i bit_mask = _mm256_set1_epi32(31);
+    const __m256i map_w = _mm256_set1_epi32(map.width());
+    const __m256i map_h = _mm256_set1_epi32(map.height());
+    const __m256i row_words = _mm256_set1_epi32(map.words_per_row() * 2);
+    const auto *occupancy = reinterpret_cast<const int *>(map.occupancy());
+
+    const int mx0 = static_cast<int>(std::floor(px / kCellF));
+    const int my0 = static_cast<int>(std::floor(py / kCellF));
+
+    const __m256 dx = _mm256_loadu_ps(dir_x);
+    const __m256 dy = _mm256_loadu_ps(dir_y);
+    const __m256 pos_x = _mm256_cmp_ps(dx, zero, _CMP_GT_OQ);
+    const __m256 pos_y = _mm256_cmp_ps(dy, zero, _CMP_GT_OQ);
+    const __m256 walk_x = _mm256_cmp_ps(_mm256_and_ps(dx, abs_mask), tiny, _CMP_GE_OQ);
+    const __m256 walk_y = _mm256_cmp_ps(_mm256_and_ps(dy, abs_mask), tiny, _CMP_GE_OQ);
+
+    const __m256i step_x = _mm256_sub_epi32(_mm256_and_si256(_mm256_castps_si256(pos_x), two), one);
+    const __m256i step_y = _mm256_sub_epi32(_mm256_and_si256(_mm256_castps_si256(pos_y), two), one);
+
+    const __m256 t_delta_x = _mm256_blendv_ps(big, _mm256_div_ps(cell, _mm256_and_ps(dx, abs_mask)), walk_x);
+    const __m256 t_delta_y = _mm256_blendv_ps(big, _mm256_div_ps(cell, _mm256_and_ps(dy, abs_mask)), walk_y);
+
+    const __m256 bx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(mx0) * kCellF), _mm256_and_ps(pos_x, cell));
+    const __m256 by = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(my0) * kCellF), _mm256_and_ps(pos_y, cell));
+    __m256 t_max_x = _mm256_blendv_ps(big, _mm256_div_ps(_mm256_sub_ps(bx, _mm256_set1_ps(px)), dx), walk_x);
+    __m256 t_max_y = _mm256_blendv_ps(big, _mm256_div_ps(_mm256_sub_ps(by, _mm256_set1_ps(py)), dy), walk_y);
+
+    __m256i mx = _mm256_set1_epi32(mx0);
+    __m256i my = _mm256_set1_epi32(my0);
+    __m256 active = _mm256_castsi256_ps(neg_one);
+    __m256 hit_t = big;
+    __m256 hit_vert = zero;
+    __m256i hit_mx = mx;
+    __m256i hit_my = my;
+
+    const __m256 inv_dx = _mm256_blendv_ps(zero, _mm256_div_ps(_mm256_set1_ps(1.0f), dx), walk_x);
+    const __m256 inv_dy = _mm256_blendv_ps(zero, _mm256_div_ps(_mm256_set1_ps(1.0f), dy), walk_y);
+    const OccupancyPyramid &pyramid = map.pyramid();
+    __m256i busy_bx = _mm256_set1_epi32(INT_MIN);
+    __m256i busy_by = _mm256_set1_epi32(INT_MIN);
+
+    const int max_steps = map.max_ray_steps();
+    for (int i = 0; i < max_steps && _mm256_movemask_ps(active) != 0; ++i)
+    {
+        __m256 take_x = _mm256_cmp_ps(t_max_x, t_max_y, _CMP_LE_OQ);
+
+        if (skip_empty)
+        {
+            const __m256i bx = _mm256_srai_epi32(mx, OccupancyPyramid::kShift);
+            const __m256i by = _mm256_srai_epi32(my, OccupancyPyramid::kShift);
+            const __m256i same = _mm256_and_si256(_mm256_cmpeq_epi32(bx, busy_bx), _mm256_cmpeq_epi32(by, busy_by));
+            const __m256i probe = _mm256_andnot_si256(same, _mm256_castps_si256(active));
+            if (!_mm256_testz_si256(probe, probe))
+            {
+                const __m256i sz = empty_block_size_avx2(pyramid, mx, my, probe);
+                const __m256i busy = _mm256_and_si256(probe, _mm256_cmpeq_epi32(sz, one));
+                busy_bx = _mm256_blendv_epi8(busy_bx, bx, busy);
+                busy_by = _mm256_blendv_epi8(busy_by, by, busy);
+
+                const __m256i skip_i = _mm256_cmpgt_epi32(sz, one);
+                if (!_mm256_testz_si256(skip_i, skip_i))
+                {
+                    const __m256i pos_xi = _mm256_castps_si256(pos_x);
+                    const __m256i pos_yi = _mm256_castps_si256(pos_y);
+                    const __m256i neg_sz = _mm256_sub_epi32(_mm256_setzero_si256(), sz);
+                    const __m256i bx0 = _mm256_and_si256(mx, neg_sz);
+                    const __m256i by0 = _mm256_and_si256(my, neg_sz);
+                    const __m256i face_x = _mm256_blendv_epi8(bx0, _mm256_add_epi32(bx0, sz), pos_xi);
+                    const __m256i face_y = _mm256_blendv_epi8(by0, _mm256_add_epi32(by0, sz), pos_yi);
+                    const __m256i last_x = _mm256_add_epi32(face_x, pos_xi);
+                    const __m256i last_y = _mm256_add_epi32(face_y, pos_yi);
+
+                    const __m256 exit_x = _mm256_blendv_ps(big, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(face_x), cell), _mm256_set1_ps(px)), inv_dx), walk_x);
+                    const __m256 exit_y = _mm256_blendv_ps(big, _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(face_y), cell), _mm256_set1_ps(py)), inv_dy), walk_y);
+                    const __m256 exit_on_x = _mm256_cmp_ps(exit_x, exit_y, _CMP_LE_OQ);
+                    const __m256i exit_on_xi = _mm256_castps_si256(exit_on_x);
+
+                    const __m256i ey = cell_between_avx2(_mm256_add_ps(_mm256_set1_ps(py), _mm256_mul_ps(dy, exit_x)),
+                                                         _mm256_blendv_epi8(last_y, my, pos_yi), _mm256_blendv_epi8(my, last_y, pos_yi));
+                    const __m256i ex = cell_between_avx2(_mm256_add_ps(_mm256_set1_ps(px), _mm256_mul_ps(dx, exit_y)),
+                                                         _mm256_blendv_epi8(last_x, mx, pos_xi), _mm256_blendv_epi8(mx, last_x, pos_xi));
+                    const __m256i new_mx = _mm256_blendv_epi8(ex, last_x, exit_on_xi);
+                    const __m256i new_my = _mm256_blendv_epi8(last_y, ey, exit_on_xi);
+                    const __m256 next_x = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(new_mx, pos_xi)), cell), _mm256_set1_ps(px)), inv_dx);
+                    const __m256 next_y = _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(new_my, pos_yi)), cell), _mm256_set1_ps(py)), inv_dy);
+                    const __m256 new_t_x = _mm256_blendv_ps(_mm256_blendv_ps(big, next_x, walk_x), exit_x, exit_on_x);
+                    const __m256 new_t_y = _mm256_blendv_ps(exit_y, _mm256_blendv_ps(big, next_y, walk_y), exit_on_x);
+
+                    const __m256 skip = _mm256_castsi256_ps(skip_i);
+                    mx = _mm256_blendv_epi8(mx, new_mx, skip_i);
+                    my = _mm256_blendv_epi8(my, new_my, skip_i);
+                    t_max_x = _mm256_blendv_ps(t_max_x, new_t_x, skip);
+                    t_max_y = _mm256_blendv_ps(t_max_y, new_t_y, skip);
+                    take_x = _mm256_blendv_ps(take_x, exit_on_x, skip);
+                }
+            }
+        }
+
+        const __m256i take_xi = _mm256_castps_si256(take_x);
+        mx = _mm256_add_epi32(mx, _mm256_and_si256(take_xi, step_x));
+        my = _mm256_add_epi32(my, _mm256_andnot_si256(take_xi, step_y));
+        const __m256 t = _mm256_blendv_ps(t_max_y, t_max_x, take_x);
+
+        const __m256i in_x = _mm256_and_si256(_mm256_cmpgt_epi32(mx, neg_one), _mm256_cmpgt_epi32(map_w, mx));
+        const __m256i in_y = _mm256_and_si256(_mm256_cmpgt_epi32(my, neg_one), _mm256_cmpgt_epi32(map_h, my));
+        const __m256i in_map = _mm256_and_si256(in_x, in_y);
+        const __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(my, row_words), _mm256_srai_epi32(mx, 5));
+        const __m256i word = _mm256_mask_i32gather_epi32(neg_one, occupancy, idx, in_map, 4);
+        const __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(mx, bit_mask)), one);
+        const __m256 wall = _mm256_castsi256_ps(_mm256_cmpeq_epi32(bit, one));
+
+        const __m256 new_hit = _mm256_and_ps(wall, active);
+        hit_t = _mm256_blendv_ps(hit_t, t, new_hit);
+        hit_vert = _mm256_blendv_ps(hit_vert, take_x, new_hit);
+        hit_mx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(hit_mx), _mm256_castsi256_ps(mx), new_hit));
+        hit_my = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(hit_my), _mm256_castsi256_ps(my), new_hit));
+        active = _mm256_andnot_ps(wall, active);
+
+        t_max_x = _mm256_add_ps(t_max_x, _mm256_and_ps(take_x, t_delta_x));
+        t_max_y = _mm256_add_ps(t_max_y, _mm256_andnot_ps(take_x, t_delta_y));
+    }
+
+    alignas(32) float ts[8];
+    alignas(32) int hmx[8];
+    alignas(32) int hmy[8];
+    _mm256_store_ps(ts, hit_t);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(hmx), hit_mx);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(hmy), hit_my);
+    const int vert_bits = _mm256_movemask_ps(hit_vert);
+    for (int l = 0; l < 8; ++l)
+        out[l] = lane_hit(dir_x[l], dir_y[l], px, py, ts[l], (vert_bits >> l) & 1, hmx[l], hmy[l]);
+}
+
+#endif
+
+} // namespace
+
+SimdMode resolve_simd_mode(const SimdMode requested) noexcept
+{
+#if TRYDOOM_X86_64
+    static const bool has_avx2 = cpu_has_avx2();
+    if (requested == SimdMode::Auto)
+        return has_avx2 ? SimdMode::Avx2 : SimdMode::Sse2;
+    if (requested == SimdMode::Avx2 && !has_avx2)
+        return SimdMode::Sse2;
+    return requested;
+#else
+    (void) requested;
+    return SimdMode::Scalar;
+#endif
+}
+
+int packet_width(const SimdMode mode) noexcept
+{
+    switch (mode)
+    {
+    case SimdMode::Sse2: return 4;
+    case SimdMode::Avx2: return 8;
+    default: return 1;
+    }
+}
+
+const char *simd_mode_name(const SimdMode mode) noexcept
+{
+    switch (mode)
+    {
+    case SimdMode::Scalar: return "scalar";
+    case SimdMode::Sse2: return "sse2";
+    case SimdMode::Avx2: return "avx2";
+    case SimdMode::Auto: return "auto";
+    }
+    return "?";
+}
+
+void cast_packet(const Map &map, const SimdMode mode, const bool skip_empty,
+                 const float *dir_x, const float *dir_y,
+                 const float px, const float py, RayHit *out) noexcept
+{
+#if TRYDOOM_X86_64
+    if (mode == SimdMode::Avx2 || mode == SimdMode::Sse2)
+    {
+        if (mode == SimdMode::Avx2)
+            cast_packet_avx2(map, skip_empty, dir_x, dir_y, px, py, out);
+        else
+            cast_packet_sse2(map, skip_empty, dir_x, dir_y, px, py, out);
+        // The kernels stop at a door cell as at a wall. Those lanes are
+        // walked again by the scalar DDA, which looks for the door's panel.
+        if (!map.has_doors())
+            return;
+        for (int l = 0; l < packet_width(mode); ++l)
+        {
+            if (out[l].dist == FLT_MAX)
+                continue;
+            int mx, my;
+            hit_cell(out[l], px, py, mx, my);
+            if (map.is_door(mx, my))
+                out[l] = cast_ray_dir(map, dir_x[l], dir_y[l], px, py, skip_empty);
+        }
+        return;
+    }
+#endif
+    for (int l = 0; l < packet_width(mode); ++l)
+        out[l] = cast_ray_dir(map, dir_x[l], dir_y[l], px, py, skip_empty);
+}
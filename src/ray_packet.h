@@ -0,0 +1,18 @@
+#pragma once
+
+#include "raycaster.h"
+
+inline constexpr int kMaxPacketWidth = 8;
+
+// Maps Auto to the widest supported mode and downgrades anything the
+// running CPU cannot execute.
+[[nodiscard]] SimdMode resolve_simd_mode(SimdMode requested) noexcept;
+[[nodiscard]] int packet_width(SimdMode mode) noexcept;
+[[nodiscard]] const char *simd_mode_name(SimdMode mode) noexcept;
+
+// DDA-traces packet_width(mode) rays sharing the origin (px, py). dir_x and
+// dir_y hold unit directions; every lane is written to out. Results match
+// cast_ray_dir up to float rounding in the packet kernels.
+void cast_packet(const Map &map, SimdMode mode, bool skip_empty,
+                 const float *dir_x, const float *dir_y,
+                 float px, float py, RayHit *out) noexcept;
@@ -0,0 +1,40 @@
+#include "ray_table.h"
+#include "fixed_point.h"
+#include "math_utils.h"
+
+#include <cmath>
+#include <cstdint>
+
+bool RayTable::update(const int view_w, const int num_rays, const float fov_deg)
+{
+    if (view_w == view_w_ && num_rays == num_rays_ && fov_deg == fov_deg_)
+        return false;
+
+    view_w_ = view_w;
+    num_rays_ = num_rays;
+    fov_deg_ = fov_deg;
+
+    const auto w = static_cast<float>(view_w);
+    proj_dist_ = w * 0.5f / std::tan(math::deg_to_rad(fov_deg * 0.5f));
+    column_w_ = w / static_cast<float>(num_rays);
+
+    const auto n = static_cast<std::size_t>(num_rays);
+    forward_.resize(n);
+    side_.resize(n);
+    angle_deg_.resize(n);
+    fine_angle_.resize(n);
+    const auto half_tan = static_cast<std::int64_t>(fixed::tan(fixed::fine_angle(fov_deg * 0.5f)));
+    for (std::size_t c = 0; c < n; ++c)
+    {
+        // Offset of the column centre from the middle of the projection plane.
+        const float sx = (static_cast<float>(c) + 0.5f) * column_w_ - w * 0.5f;
+        const float inv_len = 1.0f / std::sqrt(proj_dist_ * proj_dist_ + sx * sx);
+        forward_[c] = proj_dist_ * inv_len;
+        side_[c] = sx * inv_len;
+        angle_deg_[c] = math::rad_to_deg(std::atan(sx / proj_dist_));
+        // Column centre across [-1, 1] of the plane, times tan(FOV / 2).
+        const std::int64_t across = 2 * static_cast<std::int64_t>(c) + 1 - num_rays;
+        fine_angle_[c] = fixed::atan_fine(static_cast<fixed::Fixed>(half_tan * across / num_rays));
+    }
+    return true;
+}
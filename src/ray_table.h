@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+// Camera-space ray for every screen column of one (viewport width, ray
+// count, FOV) setup. forward and side are the unit ray's components along
+// and across the view direction; forward is also the fisheye correction
+// (the cosine of the column's angle off centre). A frame only rotates them
+// by the player's direction vector, so no trig runs per column.
+class RayTable
+{
+public:
+    // Rebuilds the table when any input changed; returns whether it did.
+    bool update(int view_w, int num_rays, float fov_deg);
+
+    [[nodiscard]] int size() const noexcept { return num_rays_; }
+    [[nodiscard]] float proj_dist() const noexcept { return proj_dist_; }
+    [[nodiscard]] float column_width() const noexcept { return column_w_; }
+
+    [[nodiscard]] const float *forward() const noexcept { return forward_.data(); }
+    [[nodiscard]] const float *side() const noexcept { return side_.data(); }
+    // Degrees the column turns right of the view direction, for the
+    // angle-driven reference traversal.
+    [[nodiscard]] const float *angle_deg() const noexcept { return angle_deg_.data(); }
+    // The same in fixed::kFineAngles per turn, worked out with integers
+    // only (the ray's tangent looked up in the fixed tangent table), so
+    // the fixed-point traversal casts the same rays everywhere.
+    [[nodiscard]] const int *fine_angle() const noexcept { return fine_angle_.data(); }
+
+private:
+    int view_w_ = 0;
+    int num_rays_ = 0;
+    float fov_deg_ = 0.0f;
+
+    float proj_dist_ = 0.0f;
+    float column_w_ = 0.0f;
+    std::vector<float> forward_;
+    std::vector<float> side_;
+    std::vector<float> angle_deg_;
+    std::vector<int> fine_angle_;
+};
@@ -1,41 +1,164 @@
 #include "raycaster.h"
-#include "renderer.h"
+#include "entities.h"
+#include "fixed_point.h"
+#include "frame_profiler.h"
+#include "ray_packet.h"
+#include "render_sink.h"
 #include "player.h"
 #include "map.h"
 #include "math_utils.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cfloat>
 #include <climits>
 #include <cmath>
+#include <limits>
+#include <numbers>
 
 namespace
 {
 
 constexpr auto kCellF = static_cast<float>(Map::kCellSize);
+constexpr float kInvCellF = 1.0f / kCellF;
 
-struct RayHit
+struct Rgb
 {
-    float x = 0.0f;
-    float y = 0.0f;
-    float dist = FLT_MAX;
-    bool vertical = false;
+    float r, g, b;
+};
+
+// One per Entities kind.
+constexpr Rgb kSpriteColors[Entities::kKinds] = {
+    {0.95f, 0.75f, 0.20f},
+    {0.30f, 0.85f, 0.35f},
+    {0.90f, 0.30f, 0.25f},
+    {0.55f, 0.45f, 0.95f},
 };
 
+// Brightness at distance d along the view direction.
+constexpr float kFog = 0.00005f;
+float fog(const float d) noexcept
+{
+    return 1.0f / (1.0f + kFog * d * d);
+}
+
+// Floor and ceiling tile types; WallTextures::index_for_tile picks stone
+// and wood.
+constexpr std::uint8_t kFloorTile = 2;
+constexpr std::uint8_t kCeilingTile = 3;
+
+// Numeric policies for the intercept march (Wolfenstein 3-D's traversal):
+// a ray steps from one cell boundary to the next on each axis, the other
+// coordinate moving by the ray's tangent, and the nearer of the two walls
+// wins. FloatRays is the original march in world units; the reference
+// traversal runs it in double, where the per-step rounding that drifts a
+// float march by ~1e-3 of the distance on big maps stays far below what
+// --compare checks, so it serves as ground truth. FixedRays runs it in
+// 16.16 fixed point with one cell as 1.0 and table trig, so a hit is
+// bit-exact on every platform: boundaries are a mask, "just inside the
+// previous cell" is one raw unit and no step divides or rounds.
+template <typename T>
+struct FloatRays
+{
+    using Scalar = T;
+    struct Trig
+    {
+        T sin, cos, tan, cot;
+    };
+
+    static constexpr Scalar kCell = static_cast<T>(Map::kCellSize);
+    static constexpr Scalar kFar = std::numeric_limits<T>::max();
+
+    [[nodiscard]] static Trig trig(const float ra_deg) noexcept
+    {
+        const T ra_rad = static_cast<T>(math::fix_angle(ra_deg)) * (std::numbers::pi_v<T> / 180);
+        const T s = std::sin(ra_rad);
+        const T c = std::cos(ra_rad);
+        return {s, c, s / c, c / s};
+    }
+    [[nodiscard]] static bool walks(const Scalar v) noexcept { return std::fabs(v) >= static_cast<T>(1e-6); }
+    [[nodiscard]] static Scalar from_world(const float v) noexcept { return v; }
+    [[nodiscard]] static float to_world(const Scalar v) noexcept { return static_cast<float>(v); }
+    [[nodiscard]] static Scalar mul(const Scalar a, const Scalar b) noexcept { return a * b; }
+    [[nodiscard]] static Scalar cell_start(const Scalar v) noexcept { return std::floor(v / kCell) * kCell; }
+    [[nodiscard]] static int cell(const Scalar v) noexcept { return static_cast<int>(v / kCell); }
+    // Moves a cell boundary just inside the cell before it. kEps alone rounds
+    // away past ~2^11 world units, where a float step exceeds 2 * kEps.
+    [[nodiscard]] static Scalar below(const Scalar boundary) noexcept
+    {
+        constexpr T kEps = static_cast<T>(0.0001);
+        return std::min(boundary - kEps, std::nextafter(boundary, -kFar));
+    }
+    [[nodiscard]] static Scalar length(const Scalar dx, const Scalar dy, const Trig &) noexcept
+    {
+        return std::hypot(dx, dy);
+    }
+    // Map::Door::open as a distance.
+    [[nodiscard]] static Scalar door_offset(const std::int32_t open) noexcept
+    {
+        return static_cast<T>(open) * (kCell / static_cast<T>(Map::kDoorOpen));
+    }
+};
+
+struct FixedRays
+{
+    using Scalar = fixed::Fixed;
+    struct Trig
+    {
+        fixed::Fixed sin, cos, tan, cot;
+    };
+
+    static constexpr Scalar kCell = fixed::kOne;
+    static constexpr Scalar kFar = INT32_MAX;
+    static constexpr float kWorld = 1.0f / kCellF; // cells per world unit
+
+    [[nodiscard]] static Trig trig(const int fine) noexcept
+    {
+        return {fixed::sin(fine), fixed::cos(fine), fixed::tan(fine), fixed::tan(fixed::kQuarter - fine)};
+    }
+    [[nodiscard]] static Trig trig(const float ra_deg) noexcept { return trig(fixed::fine_angle(ra_deg)); }
+    [[nodiscard]] static bool walks(const Scalar v) noexcept { return v != 0; }
+    [[nodiscard]] static Scalar from_world(const float v) noexcept { return fixed::from_float(v, kWorld); }
+    [[nodiscard]] static float to_world(const Scalar v) noexcept { return fixed::to_float(v, kCellF); }
+    [[nodiscard]] static Scalar mul(const Scalar a, const Scalar b) noexcept { return fixed::mul(a, b); }
+    [[nodiscard]] static Scalar cell_start(const Scalar v) noexcept { return v & -fixed::kOne; }
+    [[nodiscard]] static int cell(const Scalar v) noexcept { return fixed::floor_int(v); }
+    [[nodiscard]] static Scalar below(const Scalar boundary) noexcept { return boundary - 1; }
+    // Projection onto the ray, which for a point on it is its length.
+    [[nodiscard]] static Scalar length(const Scalar dx, const Scalar dy, const Trig &t) noexcept
+    {
+        return fixed::mul(dx, t.cos) - fixed::mul(dy, t.sin);
+    }
+    [[nodiscard]] static Scalar door_offset(const std::int32_t open) noexcept { return open; }
+};
+static_assert(Map::kDoorOpen == fixed::kOne, "door openings are 16.16 fractions of a cell");
+
+template <typename Num>
 struct RayStep
 {
+    using Scalar = typename Num::Scalar;
     int dof = 0;
-    float rx = 0.0f, ry = 0.0f;
-    float xo = 0.0f, yo = 0.0f;
+    Scalar rx{}, ry{};
+    Scalar xo{}, yo{};
 };
 
-RayStep init_horizontal(float ra_rad, float px, float py)
+template <typename Num>
+struct MarchHit
 {
-    RayStep s{};
-    const float sin_a = std::sin(ra_rad);
-    const float cos_a = std::cos(ra_rad);
+    typename Num::Scalar x{}, y{};
+    typename Num::Scalar dist = Num::kFar;
+    bool vertical = false;
+    bool door = false;
+};
 
-    if (std::fabs(sin_a) < 1e-6f)
+// First crossing of a horizontal cell boundary (y = k * cell) and the step
+// between two of them. y points down, so a ray with sin > 0 heads up.
+template <typename Num>
+RayStep<Num> init_horizontal(const typename Num::Trig &t, const typename Num::Scalar px,
+                             const typename Num::Scalar py) noexcept
+{
+    RayStep<Num> s{};
+    if (!Num::walks(t.sin))
     {
         s.rx = px;
         s.ry = py;
@@ -43,34 +166,28 @@ RayStep init_horizontal(float ra_rad, float px, float py)
         return s;
     }
 
-    if (sin_a > 0.0f)
+    if (t.sin > 0)
     {
-        constexpr float kEps = 0.0001f;
-        s.ry = std::floor(py / kCellF) * kCellF - kEps;
-        const float t = (py - s.ry) / sin_a;
-        s.rx = px + cos_a * t;
-        s.yo = -kCellF;
+        s.ry = Num::below(Num::cell_start(py));
+        s.yo = -Num::kCell;
     }
     else
     {
-        s.ry = std::floor(py / kCellF) * kCellF + kCellF;
-        const float t = (py - s.ry) / sin_a;
-        s.rx = px + cos_a * t;
-        s.yo = kCellF;
+        s.ry = Num::cell_start(py) + Num::kCell;
+        s.yo = Num::kCell;
     }
-
-    s.xo = -(cos_a / sin_a) * s.yo;
-    s.dof = 0;
+    s.rx = px + Num::mul(py - s.ry, t.cot);
+    s.xo = -Num::mul(t.cot, s.yo);
     return s;
 }
 
-RayStep init_vertical(float ra_rad, float px, float py)
+// The same for vertical boundaries (x = k * cell).
+template <typename Num>
+RayStep<Num> init_vertical(const typename Num::Trig &t, const typename Num::Scalar px,
+                           const typename Num::Scalar py) noexcept
 {
-    RayStep s{};
-    const float sin_a = std::sin(ra_rad);
-    const float cos_a = std::cos(ra_rad);
-
-    if (std::fabs(cos_a) < 1e-6f)
+    RayStep<Num> s{};
+    if (!Num::walks(t.cos))
     {
         s.rx = px;
         s.ry = py;
@@ -78,42 +195,64 @@ RayStep init_vertical(float ra_rad, float px, float py)
         return s;
     }
 
-    if (cos_a > 0.0f)
+    if (t.cos > 0)
     {
-        s.rx = std::floor(px / kCellF) * kCellF + kCellF;
-        const float t = (s.rx - px) / cos_a;
-        s.ry = py - sin_a * t;
-        s.xo = kCellF;
+        s.rx = Num::cell_start(px) + Num::kCell;
+        s.xo = Num::kCell;
     }
     else
     {
-        constexpr float kEps = 0.0001f;
-        s.rx = std::floor(px / kCellF) * kCellF - kEps;
-        const float t = (s.rx - px) / cos_a;
-        s.ry = py - sin_a * t;
-        s.xo = -kCellF;
+        s.rx = Num::below(Num::cell_start(px));
+        s.xo = -Num::kCell;
     }
-
-    s.yo = -(sin_a / cos_a) * s.xo;
-    s.dof = 0;
+    s.ry = py - Num::mul(s.rx - px, t.tan);
+    s.yo = -Num::mul(t.tan, s.xo);
     return s;
 }
 
-RayHit march_to_wall(RayStep s, float px, float py)
+// Steps s until it enters a wall; vertical says s crosses x = const
+// boundaries. A door's panel parallel to those sits half a step into its
+// cell, where Wolfenstein 3-D looked for it too; a panel across them is
+// left to the other march, which walks into the door cell through the
+// faces the passage opens onto.
+template <typename Num>
+MarchHit<Num> march_to_wall(const Map &map, RayStep<Num> s, const typename Num::Trig &t,
+                            const typename Num::Scalar px, const typename Num::Scalar py,
+                            const bool vertical) noexcept
 {
-    constexpr int kMaxDof = Map::kWidth + Map::kHeight;
-    RayHit hit;
-    while (s.dof < kMaxDof)
+    const int max_dof = map.max_ray_steps();
+    const bool doors = map.has_doors();
+    MarchHit<Num> hit;
+    hit.vertical = vertical;
+    while (s.dof < max_dof)
     {
-        const auto mx = static_cast<int>(s.rx / kCellF);
-        const auto my = static_cast<int>(s.ry / kCellF);
-
-        if (Map::is_wall(mx, my))
+        const int mx = Num::cell(s.rx);
+        const int my = Num::cell(s.ry);
+        if (map.is_wall(mx, my))
         {
-            hit.x = s.rx;
-            hit.y = s.ry;
-            hit.dist = std::hypot(hit.x - px, hit.y - py);
-            return hit;
+            const Map::Door *door = doors ? map.door(mx, my) : nullptr;
+            if (!door)
+            {
+                hit.x = s.rx;
+                hit.y = s.ry;
+                hit.dist = Num::length(hit.x - px, hit.y - py, t);
+                return hit;
+            }
+            if (door->vertical == vertical)
+            {
+                const auto hx = s.rx + s.xo / 2;
+                const auto hy = s.ry + s.yo / 2;
+                const auto along = vertical ? hy : hx;
+                if (Num::cell(hx) == mx && Num::cell(hy) == my
+                    && along - Num::cell_start(along) >= Num::door_offset(door->open))
+                {
+                    hit.x = hx;
+                    hit.y = hy;
+                    hit.dist = Num::length(hx - px, hy - py, t);
+                    hit.door = true;
+                    return hit;
+                }
+            }
         }
 
         s.rx += s.xo;
@@ -124,39 +263,649 @@ RayHit march_to_wall(RayStep s, float px, float py)
     return hit;
 }
 
-RayHit cast_ray(float ra_deg, float px, float py)
+template <typename Num>
+RayHit cast_ray_march(const Map &map, const typename Num::Trig &t, const float world_px, const float world_py) noexcept
 {
-    ra_deg = math::fix_angle(ra_deg);
-    const float ra_rad = math::deg_to_rad(ra_deg);
+    const auto px = Num::from_world(world_px);
+    const auto py = Num::from_world(world_py);
+    const MarchHit<Num> hh = march_to_wall(map, init_horizontal<Num>(t, px, py), t, px, py, false);
+    const MarchHit<Num> vh = march_to_wall(map, init_vertical<Num>(t, px, py), t, px, py, true);
+
+    const MarchHit<Num> &near = vh.dist <= hh.dist ? vh : hh;
+    RayHit hit;
+    if (near.dist == Num::kFar)
+        return hit;
+    hit.x = Num::to_world(near.x);
+    hit.y = Num::to_world(near.y);
+    hit.dist = Num::to_world(near.dist);
+    hit.vertical = near.vertical;
+    hit.door = near.door;
+    return hit;
+}
+
+// A ray that entered a door's cell at length t_enter meets the panel on
+// the cell's mid line, unless it reaches that line outside the cell (it
+// came in through a side beyond the line, or leaves first) or where the
+// door has slid out of the way. hit is only written on a hit.
+bool door_hit(const Map::Door &door, const float dir_x, const float dir_y, const float px, const float py,
+              const float t_enter, RayHit &hit) noexcept
+{
+    const float dir = door.vertical ? dir_x : dir_y;
+    if (std::fabs(dir) < 1e-6f)
+        return false;
+    const float line = (static_cast<float>(door.vertical ? door.x : door.y) + 0.5f) * kCellF;
+    const float t = (line - (door.vertical ? px : py)) / dir;
+    const float cross = door.vertical ? py + dir_y * t : px + dir_x * t;
+    const float along = cross * kInvCellF - static_cast<float>(door.vertical ? door.y : door.x);
+    if (t < t_enter || !(along >= static_cast<float>(door.open) * (1.0f / Map::kDoorOpen) && along < 1.0f))
+        return false;
+
+    hit = RayHit{};
+    hit.dist = t;
+    hit.x = door.vertical ? line : cross;
+    hit.y = door.vertical ? cross : line;
+    hit.vertical = door.vertical;
+    hit.door = true;
+    return true;
+}
+
+struct ColumnLayout
+{
+    Viewport view;
+    const RayTable &rays;
+};
+
+WallColumn project_column(const ColumnLayout &layout, int r, const RayHit &hit)
+{
+    const Viewport &view = layout.view;
+    const float col_w = layout.rays.column_width();
+
+    // Distance along the view direction; removes the fisheye bulge.
+    const float d = std::max(hit.dist * layout.rays.forward()[r], 0.0001f);
+    const float full_h = kCellF * layout.rays.proj_dist() / d;
+    const float line_h = std::min(full_h, static_cast<float>(view.h));
+    const float line_off = (static_cast<float>(view.h) - line_h) * 0.5f;
+    // A wall taller than the viewport shows only the middle of its texture.
+    const float clip = (1.0f - line_h / full_h) * 0.5f;
+
+    WallColumn col;
+    col.hit = hit;
+    col.depth = d;
+    col.shade = fog(d);
+    col.x0 = static_cast<float>(view.x0) + static_cast<float>(r) * col_w;
+    col.x1 = col.x0 + col_w;
+    col.y0 = static_cast<float>(view.y0) + line_off;
+    col.y1 = col.y0 + line_h;
+    col.v0 = clip;
+    col.v1 = 1.0f - clip;
+    return col;
+}
+
+// Casts columns [begin, end) into out[begin, end). Safe to run concurrently
+// on disjoint ranges.
+void cast_columns(const Map &map, const Player &player, const ColumnLayout &layout,
+                  const CastOptions &opts,
+                  SimdMode simd, int begin, int end, WallColumn *out)
+{
+    const float *angle_deg = layout.rays.angle_deg();
+    const float *forward = layout.rays.forward();
+    const float *side = layout.rays.side();
+
+    if (opts.traversal == RayTraversal::Reference)
+    {
+        for (int r = begin; r < end; ++r)
+        {
+            out[r] = project_column(layout, r,
+                                    cast_ray(map, player.angle - angle_deg[r], player.x, player.y,
+                                             RayTraversal::Reference));
+            texture_hit(map, out[r].hit, player.x, player.y);
+        }
+        return;
+    }
+    if (opts.traversal == RayTraversal::Fixed)
+    {
+        // Integer column angles, so only the pose is ever rounded.
+        const int *fine = layout.rays.fine_angle();
+        const int facing = fixed::fine_angle(player.angle);
+        for (int r = begin; r < end; ++r)
+        {
+            out[r] = project_column(layout, r,
+                                    cast_ray_march<FixedRays>(map, FixedRays::trig(facing - fine[r]), player.x,
+                                                              player.y));
+            texture_hit(map, out[r].hit, player.x, player.y);
+        }
+        return;
+    }
+
+    // Each column's ray is its table direction rotated by the player's
+    // facing; a packet of adjacent columns is traced at once.
+    const int lanes = packet_width(simd);
+
+    alignas(32) float dir_x[kMaxPacketWidth];
+    alignas(32) float dir_y[kMaxPacketWidth];
+    RayHit hits[kMaxPacketWidth];
+
+    for (int r0 = begin; r0 < end; r0 += lanes)
+    {
+        const int n = std::min(lanes, end - r0);
+        for (int l = 0; l < lanes; ++l)
+        {
+            // Lanes past the last column repeat it and are discarded.
+            const int c = r0 + std::min(l, n - 1);
+            dir_x[l] = forward[c] * player.dx - side[c] * player.dy;
+            dir_y[l] = forward[c] * player.dy + side[c] * player.dx;
+        }
+
+        cast_packet(map, simd, opts.skip_empty, dir_x, dir_y, player.x, player.y, hits);
+
+        for (int l = 0; l < n; ++l)
+        {
+            // Filled in place: reloading the hit right after the narrow
+            // u / tile stores would stall on store forwarding.
+            out[r0 + l] = project_column(layout, r0 + l, hits[l]);
+            texture_hit(map, out[r0 + l].hit, player.x, player.y);
+        }
+    }
+}
+
+// Where the ray (dir_x, dir_y) from (px, py) hits, worked out from the
+// previous frame's columns cast from the same spot facing (prev_dx, prev_dy)
+// with the same ray table. The ray must fall between two neighbouring old
+// rays that hit the same face of the same cell: the triangle they span is
+// narrower than a cell, so no wall can hide in it and the new ray hits that
+// face too. False, leaving hit alone, when the ray has to be cast.
+bool reaim_hit(const ColumnLayout &layout, const WallColumn *prev, const float prev_dx, const float prev_dy,
+               const float px, const float py, const float dir_x, const float dir_y, RayHit &hit) noexcept
+{
+    const RayTable &rays = layout.rays;
+
+    // The ray in the old camera's space, then its fractional old column.
+    const float fwd = dir_x * prev_dx + dir_y * prev_dy;
+    const float side = dir_y * prev_dx - dir_x * prev_dy;
+    if (fwd <= 1e-6f)
+        return false;
+    const float sx = rays.proj_dist() * side / fwd + static_cast<float>(layout.view.w) * 0.5f;
+    const float col = sx / rays.column_width() - 0.5f;
+    if (!(col >= 0.0f && col < static_cast<float>(rays.size() - 1)))
+        return false;
+    const auto c = static_cast<int>(col);
+
+    const RayHit &a = prev[c].hit;
+    const RayHit &b = prev[c + 1].hit;
+    if (a.dist == FLT_MAX || b.dist == FLT_MAX || a.vertical != b.vertical || a.door != b.door)
+        return false;
+
+    if (a.vertical)
+    {
+        const auto cell = static_cast<int>(a.y * kInvCellF);
+        if (a.x != b.x || static_cast<int>(b.y * kInvCellF) != cell || std::fabs(dir_x) < 1e-6f)
+            return false;
+        const float t = (a.x - px) / dir_x;
+        const float y = py + dir_y * t;
+        if (t <= 0.0f || y < 0.0f || static_cast<int>(y * kInvCellF) != cell)
+            return false;
+        hit = RayHit{};
+        hit.x = a.x;
+        hit.y = y;
+        hit.dist = t;
+        hit.vertical = true;
+        hit.door = a.door;
+        return true;
+    }
+
+    const auto cell = static_cast<int>(a.x * kInvCellF);
+    if (a.y != b.y || static_cast<int>(b.x * kInvCellF) != cell || std::fabs(dir_y) < 1e-6f)
+        return false;
+    const float t = (a.y - py) / dir_y;
+    const float x = px + dir_x * t;
+    if (t <= 0.0f || x < 0.0f || static_cast<int>(x * kInvCellF) != cell)
+        return false;
+    hit = RayHit{};
+    hit.x = x;
+    hit.y = a.y;
+    hit.dist = t;
+    hit.door = a.door;
+    return true;
+}
+
+// Flags in stale the columns of cols, cast from (px, py) facing (dx, dy),
+// whose rays may reach one of the edited regions: those inside the region's
+// angular extent that got at least as far as its nearest point. Regions
+// past the farthest hit cost one distance and those wholly in front of
+// the camera four projections. A region across the camera's side line has
+// its extent taken around the direction to its centre, which keeps it
+// under a half turn while the camera is outside. Returns the count.
+int mark_stale(const ColumnLayout &layout, const float px, const float py, const float dx, const float dy,
+               const WallColumn *cols, const std::vector<MapRegion> &regions, std::vector<std::uint8_t> &stale)
+{
+    const int n = layout.rays.size();
+    stale.assign(static_cast<std::size_t>(n), 0);
+    const float half_w = static_cast<float>(layout.view.w) * 0.5f;
+    const float proj = layout.rays.proj_dist();
+    const float col_w = layout.rays.column_width();
+    const float edge = std::atan2(half_w, proj);
+    float far = 0.0f;
+    for (int c = 0; c < n; ++c)
+        far = std::max(far, cols[c].hit.dist);
+
+    for (const MapRegion &r : regions)
+    {
+        const float x0 = static_cast<float>(r.x0) * kCellF;
+        const float y0 = static_cast<float>(r.y0) * kCellF;
+        const float x1 = static_cast<float>(r.x1) * kCellF;
+        const float y1 = static_cast<float>(r.y1) * kCellF;
+        const float near = std::hypot(std::max({x0 - px, 0.0f, px - x1}), std::max({y0 - py, 0.0f, py - y1}));
+        if (near - 1.0f > far)
+            continue;
+
+        // Screen x of the corners in front of the camera.
+        float s0 = FLT_MAX;
+        float s1 = -FLT_MAX;
+        bool behind = false;
+        for (const float qx : {x0 - px, x1 - px})
+            for (const float qy : {y0 - py, y1 - py})
+            {
+                const float fwd = qx * dx + qy * dy;
+                if (fwd < 1.0f)
+                {
+                    behind = true;
+                    continue;
+                }
+                const float sx = proj * (qy * dx - qx * dy) / fwd + half_w;
+                s0 = std::min(s0, sx);
+                s1 = std::max(s1, sx);
+            }
+
+        // A column either side as well, for rounding.
+        int c0 = 0;
+        int c1 = n - 1;
+        if (!behind)
+        {
+            if (s1 < 0.0f || s0 > static_cast<float>(layout.view.w))
+                continue;
+            c0 = std::max(static_cast<int>(s0 / col_w - 0.5f) - 1, 0);
+            c1 = std::min(static_cast<int>(s1 / col_w - 0.5f) + 1, n - 1);
+        }
+        else if (near > 0.0f)
+        {
+            const float cx = (x0 + x1) * 0.5f - px;
+            const float cy = (y0 + y1) * 0.5f - py;
+            float lo = FLT_MAX;
+            float hi = -FLT_MAX;
+            for (const float qx : {x0 - px, x1 - px})
+                for (const float qy : {y0 - py, y1 - py})
+                {
+                    const float off = std::atan2(cx * qy - cy * qx, cx * qx + cy * qy);
+                    lo = std::min(lo, off);
+                    hi = std::max(hi, off);
+                }
+            const float centre = std::atan2(cy * dx - cx * dy, cx * dx + cy * dy);
+            lo = std::max(centre + lo, -edge);
+            hi = std::min(centre + hi, edge);
+            if (lo > hi)
+                continue;
+            c0 = std::max(static_cast<int>(std::floor((proj * std::tan(lo) + half_w) / col_w - 0.5f)) - 1, 0);
+            c1 = std::min(static_cast<int>(std::ceil((proj * std::tan(hi) + half_w) / col_w - 0.5f)) + 1, n - 1);
+        }
+        for (int c = c0; c <= c1; ++c)
+            if (cols[c].hit.dist >= near - 1.0f)
+                stale[static_cast<std::size_t>(c)] = 1;
+    }
+
+    int count = 0;
+    for (const std::uint8_t s : stale)
+        count += s;
+    return count;
+}
+
+// cast_columns for a camera that only turned since prev was cast: columns
+// reaim_hit can answer skip the traversal, the rest (mostly the edge that
+// came into view, and silhouette edges) are gathered into packets. Returns
+// the number of rays cast.
+int recast_columns(const Map &map, const Player &player, const ColumnLayout &layout, const CastOptions &opts,
+                   SimdMode simd, const WallColumn *prev, const float prev_dx, const float prev_dy,
+                   int begin, int end, WallColumn *out)
+{
+    const float *forward = layout.rays.forward();
+    const float *side = layout.rays.side();
+    const int lanes = packet_width(simd);
+
+    alignas(32) float dir_x[kMaxPacketWidth];
+    alignas(32) float dir_y[kMaxPacketWidth];
+    int cols[kMaxPacketWidth];
+    RayHit hits[kMaxPacketWidth];
+    int pending = 0;
+    int cast = 0;
+
+    const auto cast_pending = [&] {
+        // Lanes past the last gathered ray repeat it and are discarded.
+        for (int l = pending; l < lanes; ++l)
+        {
+            dir_x[l] = dir_x[pending - 1];
+            dir_y[l] = dir_y[pending - 1];
+        }
+        cast_packet(map, simd, opts.skip_empty, dir_x, dir_y, player.x, player.y, hits);
+        for (int l = 0; l < pending; ++l)
+        {
+            out[cols[l]] = project_column(layout, cols[l], hits[l]);
+            texture_hit(map, out[cols[l]].hit, player.x, player.y);
+        }
+        cast += pending;
+        pending = 0;
+    };
 
-    const RayHit hh = march_to_wall(init_horizontal(ra_rad, px, py), px, py);
+    for (int r = begin; r < end; ++r)
+    {
+        const float dx = forward[r] * player.dx - side[r] * player.dy;
+        const float dy = forward[r] * player.dy + side[r] * player.dx;
 
-    RayHit vh = march_to_wall(init_vertical(ra_rad, px, py), px, py);
-    vh.vertical = true;
+        RayHit hit;
+        if (reaim_hit(layout, prev, prev_dx, prev_dy, player.x, player.y, dx, dy, hit))
+        {
+            out[r] = project_column(layout, r, hit);
+            texture_hit(map, out[r].hit, player.x, player.y);
+            continue;
+        }
 
-    if (vh.dist <= hh.dist)
-        return vh;
-    return hh;
+        dir_x[pending] = dx;
+        dir_y[pending] = dy;
+        cols[pending] = r;
+        if (++pending == lanes)
+            cast_pending();
+    }
+    if (pending > 0)
+        cast_pending();
+    return cast;
 }
 
-float corrected_distance(const Player &player, const RayHit &hit)
+// Flat walls go to sink as trapezoids, and sprites as quads after them.
+bool merges_walls(const RenderSink &sink, const CastOptions &opts) noexcept
 {
-    const float d = std::cos(math::deg_to_rad(player.angle)) * (hit.x - player.x)
-                    - std::sin(math::deg_to_rad(player.angle)) * (hit.y - player.y);
-    return std::max(d, 0.0001f);
+    return !opts.textured && opts.merge_walls && sink.merges_walls();
 }
 
-float proj_plane_dist(const Viewport &v, float fov_deg)
+// Sends cols[lo..hi], all on one flat face, as a single WallRun. Along the
+// face 1 / depth is affine in screen x, and so are the wall's top and
+// bottom: the run's edges are extrapolated from its end columns and fogged
+// there. Fog is not affine, so a run whose shading strays more than
+// kRunShadeError from the columns' is split at the worst column.
+void emit_wall_run(RenderSink &sink, const ColumnLayout &layout, const WallColumn *cols, const int lo,
+                   const int hi)
 {
-    return static_cast<float>(v.w) * 0.5f / std::tan(math::deg_to_rad(fov_deg * 0.5f));
+    constexpr float kRunShadeError = 2.0f / 255.0f;
+    const WallColumn &first = cols[lo];
+    const WallColumn &last = cols[hi];
+    if (lo == hi)
+    {
+        sink.push_column(first.x0, first.x1 - first.x0, first.y0, first.y1, first.shade, first.shade, first.shade);
+        return;
+    }
+
+    const float xa = (first.x0 + first.x1) * 0.5f;
+    const float xb = (last.x0 + last.x1) * 0.5f;
+    const float ia = 1.0f / first.depth;
+    const float slope = (1.0f / last.depth - ia) / (xb - xa);
+    const float i0 = std::max(ia + slope * (first.x0 - xa), 1e-6f);
+    const float i1 = std::max(ia + slope * (last.x1 - xa), 1e-6f);
+    const float shade0 = fog(1.0f / i0);
+    const float shade1 = fog(1.0f / i1);
+
+    int worst = lo;
+    float worst_error = kRunShadeError;
+    for (int c = lo; c <= hi; ++c)
+    {
+        const float t = ((cols[c].x0 + cols[c].x1) * 0.5f - first.x0) / (last.x1 - first.x0);
+        const float error = std::fabs(shade0 + (shade1 - shade0) * t - cols[c].shade);
+        if (error > worst_error)
+        {
+            worst = c;
+            worst_error = error;
+        }
+    }
+    if (worst_error > kRunShadeError)
+    {
+        const int split = std::min(worst, hi - 1);
+        emit_wall_run(sink, layout, cols, lo, split);
+        emit_wall_run(sink, layout, cols, split + 1, hi);
+        return;
+    }
+
+    // A wall taller than the viewport is clipped at both ends at once.
+    const float half_h = static_cast<float>(layout.view.h) * 0.5f;
+    const float vy_mid = static_cast<float>(layout.view.y0) + half_h;
+    const float wall_scale = kCellF * layout.rays.proj_dist() * 0.5f;
+    const float h0 = first.v0 > 0.0f ? half_h : std::min(wall_scale * i0, half_h);
+    const float h1 = first.v0 > 0.0f ? half_h : std::min(wall_scale * i1, half_h);
+    sink.push_wall_run({first.x0, last.x1, vy_mid - h0, vy_mid + h0, vy_mid - h1, vy_mid + h1, shade0, shade1});
+}
+
+// Sends cols as runs of adjacent columns that hit the same face of the same
+// cell, clipped and unclipped columns apart.
+void push_wall_runs(RenderSink &sink, const ColumnLayout &layout, const WallColumn *cols, const int n,
+                    const float px, const float py)
+{
+    for (int begin = 0; begin < n;)
+    {
+        const WallColumn &first = cols[begin];
+        int end = begin + 1;
+        if (first.hit.dist != FLT_MAX)
+        {
+            int mx = 0;
+            int my = 0;
+            hit_cell(first.hit, px, py, mx, my);
+            for (; end < n; ++end)
+            {
+                const WallColumn &col = cols[end];
+                if (col.hit.dist == FLT_MAX || col.hit.vertical != first.hit.vertical
+                    || col.hit.door != first.hit.door || (col.v0 > 0.0f) != (first.v0 > 0.0f))
+                    break;
+                int cx = 0;
+                int cy = 0;
+                hit_cell(col.hit, px, py, cx, cy);
+                if (cx != mx || cy != my)
+                    break;
+            }
+        }
+        emit_wall_run(sink, layout, cols, begin, end - 1);
+        begin = end;
+    }
 }
 
 } // namespace
 
-void cast_and_draw(Renderer2D &renderer, const Player &player,
-                   const Viewport &view, const int num_rays, bool draw_debug_rays)
+RayHit cast_ray(const Map &map, float ra_deg, const float px, const float py,
+                const RayTraversal traversal)
+{
+    if (traversal == RayTraversal::Reference)
+        return cast_ray_march<FloatRays<double>>(map, FloatRays<double>::trig(ra_deg), px, py);
+    if (traversal == RayTraversal::Fixed)
+        return cast_ray_march<FixedRays>(map, FixedRays::trig(ra_deg), px, py);
+
+    ra_deg = math::fix_angle(ra_deg);
+    const float ra_rad = math::deg_to_rad(ra_deg);
+    return cast_ray_dir(map, std::cos(ra_rad), -std::sin(ra_rad), px, py);
+}
+
+// A wall hit lies on a cell face; the wall cell is the one on the far side
+// of that face from the viewer. A door hit lies inside the door's cell.
+// Hits are never left of or above the map, so truncation is floor.
+void hit_cell(const RayHit &hit, const float px, const float py, int &mx, int &my) noexcept
+{
+    if (hit.door)
+    {
+        mx = static_cast<int>(hit.x * kInvCellF);
+        my = static_cast<int>(hit.y * kInvCellF);
+    }
+    else if (hit.vertical)
+    {
+        mx = static_cast<int>(hit.x * kInvCellF + 0.5f) - (hit.x > px ? 0 : 1);
+        my = static_cast<int>(hit.y * kInvCellF);
+    }
+    else
+    {
+        mx = static_cast<int>(hit.x * kInvCellF);
+        my = static_cast<int>(hit.y * kInvCellF + 0.5f) - (hit.y > py ? 0 : 1);
+    }
+}
+
+// u runs left to right as the viewer sees it. A door's texture slides
+// with its panel, so the part that went into the jamb is the one hidden.
+void texture_hit(const Map &map, RayHit &hit, const float px, const float py) noexcept
+{
+    if (hit.dist == FLT_MAX)
+        return;
+
+    int mx, my;
+    hit_cell(hit, px, py, mx, my);
+    float along = hit.vertical ? hit.y * kInvCellF - static_cast<float>(my)
+                               : hit.x * kInvCellF - static_cast<float>(mx);
+    if (hit.door)
+        if (const Map::Door *door = map.door(mx, my))
+            along -= static_cast<float>(door->open) * (1.0f / Map::kDoorOpen);
+    const bool flip = hit.vertical ? hit.x <= px : hit.y > py;
+    hit.u = flip ? 1.0f - along : along;
+    hit.tile = map.tile(mx, my);
+}
+
+// Amanatides-Woo grid walk: t_max_* is the ray length at the next x / y cell
+// boundary, t_delta_* the length between two boundaries on that axis. Both
+// axes advance in one loop, so a ray costs one step per cell it enters, or
+// per empty pyramid block it crosses when skip_empty is set. A ray that
+// misses the panel in a door cell walks on through it.
+RayHit cast_ray_dir(const Map &map, const float dir_x, const float dir_y,
+                    const float px, const float py, const bool skip_empty) noexcept
+{
+    auto mx = static_cast<int>(std::floor(px / kCellF));
+    auto my = static_cast<int>(std::floor(py / kCellF));
+
+    const int step_x = dir_x > 0.0f ? 1 : -1;
+    const int step_y = dir_y > 0.0f ? 1 : -1;
+
+    const bool walk_x = std::fabs(dir_x) >= 1e-6f;
+    const bool walk_y = std::fabs(dir_y) >= 1e-6f;
+
+    const float t_delta_x = walk_x ? kCellF / std::fabs(dir_x) : FLT_MAX;
+    const float t_delta_y = walk_y ? kCellF / std::fabs(dir_y) : FLT_MAX;
+
+    float t_max_x = FLT_MAX;
+    if (walk_x)
+    {
+        const float bx = static_cast<float>(step_x > 0 ? mx + 1 : mx) * kCellF;
+        t_max_x = (bx - px) / dir_x;
+    }
+    float t_max_y = FLT_MAX;
+    if (walk_y)
+    {
+        const float by = static_cast<float>(step_y > 0 ? my + 1 : my) * kCellF;
+        t_max_y = (by - py) / dir_y;
+    }
+
+    const float inv_dir_x = walk_x ? 1.0f / dir_x : 0.0f;
+    const float inv_dir_y = walk_y ? 1.0f / dir_y : 0.0f;
+    const OccupancyPyramid &pyramid = map.pyramid();
+    int busy_bx = INT_MIN;
+    int busy_by = INT_MIN;
+
+    const int max_steps = map.max_ray_steps();
+    const bool doors = map.has_doors();
+    RayHit hit;
+    if (doors && map.is_door(mx, my) && door_hit(*map.door(mx, my), dir_x, dir_y, px, py, 0.0f, hit))
+        return hit;
+    for (int i = 0; i < max_steps; ++i)
+    {
+        // Ties go to the vertical boundary, as in the intercept march.
+        bool cross_x = t_max_x <= t_max_y;
+
+        // Inside an empty block, jump to the last cell the ray visits before
+        // leaving it and cross the face it leaves through. The exit comes
+        // from the block's faces rather than from stepping, and the other
+        // axis never moves backwards, so rounding at a corner cannot undo
+        // progress. An occupied 8x8 block is only looked up once per visit.
+        if (skip_empty && ((mx >> OccupancyPyramid::kShift) != busy_bx
+                           || (my >> OccupancyPyramid::kShift) != busy_by))
+        {
+            const int level = pyramid.empty_level(mx, my);
+            if (level == 0)
+            {
+                busy_bx = mx >> OccupancyPyramid::kShift;
+                busy_by = my >> OccupancyPyramid::kShift;
+            }
+            else
+            {
+                const int size = 1 << (OccupancyPyramid::kShift * level);
+                const int bx0 = mx & -size;
+                const int by0 = my & -size;
+                const float exit_x = walk_x ? (static_cast<float>(step_x > 0 ? bx0 + size : bx0) * kCellF - px) * inv_dir_x
+                                            : FLT_MAX;
+                const float exit_y = walk_y ? (static_cast<float>(step_y > 0 ? by0 + size : by0) * kCellF - py) * inv_dir_y
+                                            : FLT_MAX;
+
+                cross_x = exit_x <= exit_y;
+                if (cross_x)
+                {
+                    const auto y = static_cast<int>((py + dir_y * exit_x) * kInvCellF);
+                    mx = step_x > 0 ? bx0 + size - 1 : bx0;
+                    my = step_y > 0 ? std::clamp(y, my, by0 + size - 1) : std::clamp(y, by0, my);
+                    t_max_x = exit_x;
+                    if (walk_y)
+                        t_max_y = (static_cast<float>(step_y > 0 ? my + 1 : my) * kCellF - py) * inv_dir_y;
+                }
+                else
+                {
+                    const auto x = static_cast<int>((px + dir_x * exit_y) * kInvCellF);
+                    my = step_y > 0 ? by0 + size - 1 : by0;
+                    mx = step_x > 0 ? std::clamp(x, mx, bx0 + size - 1) : std::clamp(x, bx0, mx);
+                    t_max_y = exit_y;
+                    if (walk_x)
+                        t_max_x = (static_cast<float>(step_x > 0 ? mx + 1 : mx) * kCellF - px) * inv_dir_x;
+                }
+            }
+        }
+
+        if (cross_x)
+        {
+            mx += step_x;
+            if (map.is_wall(mx, my))
+            {
+                if (!doors || !map.is_door(mx, my))
+                {
+                    hit.dist = t_max_x;
+                    hit.x = static_cast<float>(step_x > 0 ? mx : mx + 1) * kCellF;
+                    hit.y = py + dir_y * t_max_x;
+                    hit.vertical = true;
+                    return hit;
+                }
+                if (door_hit(*map.door(mx, my), dir_x, dir_y, px, py, t_max_x, hit))
+                    return hit;
+            }
+            t_max_x += t_delta_x;
+        }
+        else
+        {
+            my += step_y;
+            if (map.is_wall(mx, my))
+            {
+                if (!doors || !map.is_door(mx, my))
+                {
+                    hit.dist = t_max_y;
+                    hit.x = px + dir_x * t_max_y;
+                    hit.y = static_cast<float>(step_y > 0 ? my : my + 1) * kCellF;
+                    return hit;
+                }
+                if (door_hit(*map.door(mx, my), dir_x, dir_y, px, py, t_max_y, hit))
+                    return hit;
+            }
+            t_max_y += t_delta_y;
+        }
+    }
+
+    return hit;
+}
+
+void Raycaster::cast_and_draw(RenderSink &sink, const Map &map, const Player &player,
+                              const Viewport &view, const CastOptions &opts)
 {
-    constexpr float kFovDeg = 90.0f;
+    const int num_rays = opts.num_rays;
 
     const auto vx0 = static_cast<float>(view.x0);
     const auto vy0 = static_cast<float>(view.y0);
@@ -164,62 +913,269 @@ void cast_and_draw(Renderer2D &renderer, const Player &player,
     const float vy_mid = vy0 + static_cast<float>(view.h) * 0.5f;
     const auto vy1 = static_cast<float>(view.y0 + view.h);
 
-    renderer.push_quad(vx0, vy0, vx1, vy_mid, 0.0f, 1.0f, 1.0f);
-    renderer.push_quad(vx0, vy_mid, vx1, vy1, 0.0f, 0.0f, 1.0f);
+    const bool new_table = rays_.update(view.w, num_rays, opts.fov_deg);
+    const ColumnLayout layout{view, rays_};
+    const SimdMode simd = resolve_simd_mode(opts.simd);
 
-    const float pp = proj_plane_dist(view, kFovDeg);
-    const float col_w = static_cast<float>(view.w) / static_cast<float>(num_rays);
+    // From the same spot, last frame's hits answer most rays; standing
+    // still with the same view, all of them. They must have been cast the
+    // same way too, or switching traversal would keep the old one's hits.
+    bool same_spot = opts.reuse_hits && opts.traversal == RayTraversal::Dda && !new_table
+                     && camera_.map == &map && camera_.x == player.x && camera_.y == player.y
+                     && camera_.traversal == opts.traversal && camera_.simd == simd
+                     && camera_.skip_empty == opts.skip_empty
+                     && columns_.size() == static_cast<std::size_t>(num_rays);
+    // Map edits since then only cost the columns that look towards them,
+    // while fewer regions changed than half the columns; each takes about
+    // as long to check as a ray does to cast.
+    edited_.clear();
+    if (same_spot && camera_.revision != map.revision()
+        && !map.edited_since(camera_.revision, edited_, columns_.size() / 2))
+    {
+        same_spot = false;
+        edited_.clear();
+    }
+    const bool same_view = camera_.view.x0 == view.x0 && camera_.view.y0 == view.y0
+                           && camera_.view.w == view.w && camera_.view.h == view.h;
+    const bool unchanged = same_spot && same_view && camera_.dx == player.dx && camera_.dy == player.dy;
+    if (same_spot && !unchanged)
+        columns_.swap(last_columns_);
+    const Camera last = camera_;
+    camera_ = {&map, map.revision(), player.x, player.y, player.dx, player.dy, view,
+               opts.traversal, simd, opts.skip_empty};
+
+    columns_.resize(static_cast<std::size_t>(num_rays));
+    pool_.resize(opts.threads);
 
-    for (int r = 0; r < num_rays; ++r)
+    // Standing still, the stale columns are cast again in place; turning,
+    // their old hits are dropped so nothing is re-aimed at them.
+    int stale = 0;
+    if (!edited_.empty())
     {
-        const float screen_x = (static_cast<float>(r) + 0.5f) * col_w
-                               - static_cast<float>(view.w) * 0.5f;
-        const float ra = math::fix_angle(
-            player.angle - math::rad_to_deg(std::atan(screen_x / pp)));
+        WallColumn *prev = unchanged ? columns_.data() : last_columns_.data();
+        stale = mark_stale(layout, last.x, last.y, last.dx, last.dy, prev, edited_, stale_);
+        if (!unchanged)
+            for (int r = 0; r < num_rays; ++r)
+                if (stale_[static_cast<std::size_t>(r)])
+                    prev[r].hit.dist = FLT_MAX;
+    }
+    // Past half the columns, casting them all beats gathering the stale ones.
+    const bool cast_all = !same_spot || stale * 2 > num_rays;
 
-        const RayHit hit = cast_ray(ra, player.x, player.y);
+    // A few chunks per thread evens out columns that look down long
+    // corridors; chunks stay whole packets so lanes are never wasted.
+    constexpr int kChunksPerThread = 4;
+    const int chunks = pool_.size() * kChunksPerThread;
+    int chunk = (num_rays + chunks - 1) / chunks;
+    chunk = (chunk + kMaxPacketWidth - 1) / kMaxPacketWidth * kMaxPacketWidth;
+    const int tasks = (num_rays + chunk - 1) / chunk;
 
-        if (draw_debug_rays)
-            renderer.push_line(player.x, player.y, hit.x, hit.y, 1.0f, 0.0f, 0.0f);
+    if (cast_all)
+    {
+        const StageScope timed{opts.stage_times, FrameStage::Cast};
+        pool_.parallel_for(tasks, [&](const int t) {
+            const int begin = t * chunk;
+            const int end = std::min(begin + chunk, num_rays);
+            cast_columns(map, player, layout, opts, simd, begin, end, columns_.data());
+        });
+        rays_cast_ = num_rays;
+    }
+    else if (unchanged && stale == 0)
+        rays_cast_ = 0;
+    else if (unchanged)
+    {
+        const StageScope timed{opts.stage_times, FrameStage::Cast};
+        pool_.parallel_for(tasks, [&](const int t) {
+            const int end = std::min((t + 1) * chunk, num_rays);
+            for (int r = t * chunk; r < end;)
+            {
+                if (!stale_[static_cast<std::size_t>(r)])
+                {
+                    ++r;
+                    continue;
+                }
+                int run = r + 1;
+                while (run < end && stale_[static_cast<std::size_t>(run)])
+                    ++run;
+                cast_columns(map, player, layout, opts, simd, r, run, columns_.data());
+                r = run;
+            }
+        });
+        rays_cast_ = stale;
+    }
+    else
+    {
+        const StageScope timed{opts.stage_times, FrameStage::Cast};
+        std::atomic<int> cast{0};
+        pool_.parallel_for(tasks, [&](const int t) {
+            const int begin = t * chunk;
+            const int end = std::min(begin + chunk, num_rays);
+            cast.fetch_add(recast_columns(map, player, layout, opts, simd, last_columns_.data(), last.dx, last.dy,
+                                          begin, end, columns_.data()),
+                           std::memory_order_relaxed);
+        });
+        rays_cast_ = cast.load(std::memory_order_relaxed);
+    }
+
+    const StageScope timed{opts.stage_times, FrameStage::Batch};
+    const bool cast_floors = opts.textured_floors && sink.casts_floors();
+    const bool merge = merges_walls(sink, opts);
+    if (!cast_floors)
+    {
+        sink.push_column(vx0, vx1 - vx0, vy0, vy_mid, 0.0f, 1.0f, 1.0f);
+        sink.push_column(vx0, vx1 - vx0, vy_mid, vy1, 0.0f, 0.0f, 1.0f);
+    }
+    const float *forward = rays_.forward();
+    const float *side = rays_.side();
+    for (std::size_t r = 0; r < columns_.size(); ++r)
+    {
+        const WallColumn &col = columns_[r];
+        if (cast_floors)
+        {
+            // The ray stretched to a unit step along the view direction.
+            const float slope = side[r] / forward[r];
+            sink.push_floor({col.x0, col.x1 - col.x0, vy0, vy1, col.y0, col.y1, vy_mid,
+                             kCellF * 0.5f * rays_.proj_dist(), player.x, player.y,
+                             player.dx - slope * player.dy, player.dy + slope * player.dx, kCellF, kFog,
+                             kFloorTile, kCeilingTile});
+        }
+        if (opts.draw_debug_rays)
+            sink.push_line(player.x, player.y, col.hit.x, col.hit.y, 1.0f, 0.0f, 0.0f);
+        if (opts.textured)
+            sink.push_wall({col.x0, col.x1 - col.x0, col.y0, col.y1, col.hit.u, col.v0, col.v1, col.shade,
+                            col.hit.tile});
+        else if (!merge)
+            sink.push_column(col.x0, col.x1 - col.x0, col.y0, col.y1, col.shade, col.shade, col.shade);
+    }
+    if (merge)
+        push_wall_runs(sink, layout, columns_.data(), num_rays, player.x, player.y);
+}
+
+void Raycaster::draw_sprites(RenderSink &sink, const Entities &entities, const Player &player,
+                             const Viewport &view, const CastOptions &opts)
+{
+    const StageScope timed{opts.stage_times, FrameStage::Batch};
+    sprites_drawn_ = 0;
+    const int num_rays = rays_.size();
+    if (entities.size() == 0 || num_rays == 0 || columns_.size() != static_cast<std::size_t>(num_rays))
+        return;
 
-        const float d = corrected_distance(player, hit);
-        float line_h = kCellF * pp / d;
-        line_h = std::min(line_h, static_cast<float>(view.h));
-        const float line_off = (static_cast<float>(view.h) - line_h) * 0.5f;
+    // Frustum edges through the viewport's sides, out to the farthest wall.
+    const float proj = rays_.proj_dist();
+    const float half_w = static_cast<float>(view.w) * 0.5f;
+    const float edge = half_w / proj;
+    const float inv_len = 1.0f / std::sqrt(1.0f + edge * edge);
+    float far = 0.0f;
+    for (const WallColumn &col : columns_)
+        far = std::max(far, col.hit.dist);
+    sprite_ids_.clear();
+    entities.query(player.x, player.y,
+                   (player.dx + edge * player.dy) * inv_len, (player.dy - edge * player.dx) * inv_len,
+                   (player.dx - edge * player.dy) * inv_len, (player.dy + edge * player.dx) * inv_len,
+                   far + Entities::kRadius, sprite_ids_);
 
-        constexpr float kFog = 0.00005f;
-        const float shade = 1.0f / (1.0f + kFog * d * d);
+    constexpr float kNear = 1.0f;
+    const std::span<const float> ex = entities.x();
+    const std::span<const float> ey = entities.y();
+    sprites_.clear();
+    for (const std::uint32_t id : sprite_ids_)
+    {
+        const float rel_x = ex[id] - player.x;
+        const float rel_y = ey[id] - player.y;
+        const float depth = rel_x * player.dx + rel_y * player.dy;
+        if (depth < kNear)
+            continue;
+        const float screen_x = (rel_y * player.dx - rel_x * player.dy) * proj / depth + half_w;
+        const float half = Entities::kRadius * proj / depth;
+        if (screen_x + half <= 0.0f || screen_x - half >= static_cast<float>(view.w))
+            continue;
+        sprites_.push_back({depth, screen_x, id});
+    }
+    std::ranges::sort(sprites_, std::ranges::greater{}, &VisibleSprite::depth);
 
-        const float x0 = static_cast<float>(view.x0) + static_cast<float>(r) * col_w;
-        const float x1 = x0 + col_w;
-        const float y0 = static_cast<float>(view.y0) + line_off;
-        const float y1 = y0 + line_h;
+    const float col_w = rays_.column_width();
+    const auto vx0 = static_cast<float>(view.x0);
+    const auto vy0 = static_cast<float>(view.y0);
+    const auto vy1 = static_cast<float>(view.y0 + view.h);
+    const float vy_mid = vy0 + static_cast<float>(view.h) * 0.5f;
+    const std::span<const std::uint8_t> kinds = entities.kind();
+    const bool merge = merges_walls(sink, opts);
+    for (const VisibleSprite &s : sprites_)
+    {
+        // Standing on the floor, which meets the walls at half a cell below the eye.
+        const float scale = proj / s.depth;
+        const float half = Entities::kRadius * scale;
+        const float half_h = Entities::kHeight * 0.5f * scale;
+        const float mid_y = vy_mid + (kCellF * 0.5f - Entities::kHeight * 0.5f) * scale;
+        const float shade = fog(s.depth);
+        const Rgb &rgb = kSpriteColors[kinds[s.id] % Entities::kKinds];
 
-        renderer.push_quad(x0, y0, x1, y1, shade, shade, shade);
+        const int c0 = std::max(static_cast<int>((s.screen_x - half) / col_w), 0);
+        const int c1 = std::min(static_cast<int>((s.screen_x + half) / col_w), num_rays - 1);
+        bool drawn = false;
+        for (int c = c0; c <= c1; ++c)
+        {
+            if (s.depth >= columns_[static_cast<std::size_t>(c)].depth)
+                continue;
+            // A round blob: the strip shrinks and darkens towards the rim.
+            const float u = ((static_cast<float>(c) + 0.5f) * col_w - s.screen_x) / half;
+            if (u * u >= 1.0f)
+                continue;
+            const float profile = std::sqrt(1.0f - u * u);
+            const float y0 = std::max(mid_y - half_h * profile, vy0);
+            const float y1 = std::min(mid_y + half_h * profile, vy1);
+            if (y0 >= y1)
+                continue;
+            const float lit = shade * (0.55f + 0.45f * profile);
+            const float x = vx0 + static_cast<float>(c) * col_w;
+            if (merge)
+                sink.push_quad(x, y0, x + col_w, y1, rgb.r * lit, rgb.g * lit, rgb.b * lit);
+            else
+                sink.push_column(x, col_w, y0, y1, rgb.r * lit, rgb.g * lit, rgb.b * lit);
+            drawn = true;
+        }
+        sprites_drawn_ += drawn ? 1 : 0;
     }
 }
 
-void draw_minimap(Renderer2D &renderer)
+// Tiles are drawn 1:1 in world units, so only those overlapping the clip
+// rectangle can be seen; big maps would otherwise cost a quad per tile
+// every frame.
+MapRegion minimap_cells(const Map &map, const int clip_w, const int clip_h) noexcept
+{
+    return {0, 0, std::min(map.width(), clip_w / Map::kCellSize + 1),
+            std::min(map.height(), clip_h / Map::kCellSize + 1)};
+}
+
+void draw_minimap(RenderSink &sink, const Map &map, const int clip_w, const int clip_h)
 {
-    for (int y = 0; y < Map::kHeight; ++y)
+    const MapRegion cells = minimap_cells(map, clip_w, clip_h);
+    for (int y = cells.y0; y < cells.y1; ++y)
     {
-        for (int x = 0; x < Map::kWidth; ++x)
+        for (int x = cells.x0; x < cells.x1; ++x)
         {
-            const float c = Map::is_wall(x, y) ? 1.0f : 0.0f;
             const auto xo = static_cast<float>(x) * kCellF;
             const auto yo = static_cast<float>(y) * kCellF;
-            renderer.push_quad(xo + 1, yo + 1, xo + kCellF - 1, yo + kCellF - 1, c, c, c);
+            if (const Map::Door *door = map.door(x, y))
+            {
+                const float shut = 1.0f - static_cast<float>(door->open) * (1.0f / Map::kDoorOpen);
+                sink.push_quad(xo + 1, yo + 1, xo + kCellF - 1, yo + kCellF - 1, 0.8f * shut, 0.5f * shut,
+                               0.2f * shut);
+                continue;
+            }
+            const float c = map.is_wall(x, y) ? 1.0f : 0.0f;
+            sink.push_quad(xo + 1, yo + 1, xo + kCellF - 1, yo + kCellF - 1, c, c, c);
         }
     }
 }
 
-void draw_player_2d(Renderer2D &renderer, const Player &player)
+void draw_player_2d(RenderSink &sink, const Player &player)
 {
     constexpr float kHalf = 4.0f;
-    renderer.push_quad(player.x - kHalf, player.y - kHalf,
-                       player.x + kHalf, player.y + kHalf,
-                       1.0f, 1.0f, 0.0f);
-    renderer.push_line(player.x, player.y,
-                       player.x + player.dx * 20.0f, player.y + player.dy * 20.0f,
-                       1.0f, 1.0f, 0.0f);
+    sink.push_quad(player.x - kHalf, player.y - kHalf,
+                   player.x + kHalf, player.y + kHalf,
+                   1.0f, 1.0f, 0.0f);
+    sink.push_line(player.x, player.y,
+                   player.x + player.dx * 20.0f, player.y + player.dy * 20.0f,
+                   1.0f, 1.0f, 0.0f);
 }
@@ -1,7 +1,17 @@
 #pragma once
 
-class Renderer2D;
+#include "map.h"
+#include "ray_table.h"
+#include "thread_pool.h"
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+class Entities;
+class RenderSink;
 struct Player;
+struct StageTimes;
 
 struct Viewport
 {
@@ -11,7 +21,153 @@ struct Viewport
     int h = 320;
 };
 
-void cast_and_draw(Renderer2D &renderer, const Player &player,
-                   const Viewport &view, int num_rays, bool draw_debug_rays);
-void draw_minimap(Renderer2D &renderer);
-void draw_player_2d(Renderer2D &renderer, const Player &player);
+struct RayHit
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float dist = FLT_MAX;
+    bool vertical = false;
+    bool door = false; // on a door's panel, mid-cell, rather than a cell face
+    // Where along the wall face the ray landed, 0..1 left to right as seen
+    // from the ray, and the wall's tile type. Filled in by texture_hit.
+    float u = 0.0f;
+    std::uint8_t tile = 0;
+};
+
+enum class RayTraversal
+{
+    Dda,       // single interleaved walk over both axes
+    Reference, // original horizontal + vertical march in double, kept for comparison
+    Fixed,     // the same march in 16.16 fixed point: bit-exact on every platform
+};
+
+// What the game and the bench cast with unless told otherwise. Configure
+// with -DTRYDOOM_FIXED_POINT=ON when hits must match across machines, for
+// replays or lockstep simulation.
+#if TRYDOOM_FIXED_POINT
+inline constexpr RayTraversal kDefaultTraversal = RayTraversal::Fixed;
+#else
+inline constexpr RayTraversal kDefaultTraversal = RayTraversal::Dda;
+#endif
+
+// Instruction set used to trace several adjacent columns at once. Only the
+// DDA traversal has packet kernels; Auto picks the widest one the CPU runs.
+enum class SimdMode
+{
+    Scalar,
+    Sse2, // 4 lanes
+    Avx2, // 8 lanes
+    Auto,
+};
+
+struct CastOptions
+{
+    int num_rays = 1000;
+    bool draw_debug_rays = false;
+    RayTraversal traversal = kDefaultTraversal;
+    SimdMode simd = SimdMode::Auto;
+    int threads = 1; // including the calling thread
+    bool skip_empty = true; // DDA jumps across empty OccupancyPyramid blocks
+    float fov_deg = 90.0f;
+    bool textured = true; // walls go to RenderSink::push_wall, else push_column
+    bool textured_floors = true; // RenderSink::push_floor for sinks that cast floors
+    bool merge_walls = true; // flat walls: one push_wall_run per face, for sinks that merge
+    // DDA only: while the camera stays put, rebuild columns from the last
+    // frame's hits and cast only the rays those cannot answer, or that look
+    // towards map regions edited since.
+    bool reuse_hits = true;
+    StageTimes *stage_times = nullptr; // Cast and Batch spans, when set
+};
+
+[[nodiscard]] RayHit cast_ray(const Map &map, float ra_deg, float px, float py,
+                              RayTraversal traversal = RayTraversal::Dda);
+// DDA walk along the unit direction (dir_x, dir_y), y pointing down. With
+// skip_empty the walk crosses empty pyramid blocks in one step each.
+[[nodiscard]] RayHit cast_ray_dir(const Map &map, float dir_x, float dir_y,
+                                  float px, float py, bool skip_empty = true) noexcept;
+// Cell whose wall a hit seen from (px, py) landed on: past the face for
+// cell walls, the door's own for doors. Not for misses.
+void hit_cell(const RayHit &hit, float px, float py, int &mx, int &my) noexcept;
+// Sets hit.u and hit.tile for a hit seen from (px, py); misses are left alone.
+void texture_hit(const Map &map, RayHit &hit, float px, float py) noexcept;
+
+// Projected wall strip for one screen column.
+struct WallColumn
+{
+    RayHit hit;
+    float x0 = 0.0f, y0 = 0.0f;
+    float x1 = 0.0f, y1 = 0.0f;
+    float shade = 0.0f;
+    float v0 = 0.0f, v1 = 1.0f; // texture rows visible after clipping to the viewport
+    float depth = FLT_MAX;      // along the view direction; sprites behind it are hidden
+};
+
+class Raycaster
+{
+public:
+    Raycaster() = default;
+
+    Raycaster(const Raycaster &) = delete;
+    Raycaster &operator=(const Raycaster &) = delete;
+
+    // Casts opts.num_rays columns across view and emits sky, floor and walls
+    // into sink. Columns are split across opts.threads workers, each filling
+    // its own range of columns_; the sink always receives them in order.
+    void cast_and_draw(RenderSink &sink, const Map &map, const Player &player,
+                       const Viewport &view, const CastOptions &opts);
+
+    // Billboards for the entities in view, after cast_and_draw with the same
+    // player and view. Only entities in the frustum up to the farthest wall
+    // are looked at; they are drawn far to near, each column clipped against
+    // the wall depth of that cast. Timed as Batch.
+    void draw_sprites(RenderSink &sink, const Entities &entities, const Player &player,
+                      const Viewport &view, const CastOptions &opts);
+
+    // Rays the last cast_and_draw traced; the rest of its columns were reused.
+    [[nodiscard]] int rays_cast() const noexcept { return rays_cast_; }
+    // Entities the last draw_sprites put on screen.
+    [[nodiscard]] int sprites_drawn() const noexcept { return sprites_drawn_; }
+
+private:
+    struct VisibleSprite
+    {
+        float depth;
+        float screen_x; // centre, from the viewport's left edge
+        std::uint32_t id;
+    };
+
+    // Where columns_ was cast from.
+    struct Camera
+    {
+        const Map *map = nullptr;
+        std::uint64_t revision = 0; // Map::revision() at the time
+        float x = 0.0f, y = 0.0f;
+        float dx = 0.0f, dy = 0.0f;
+        Viewport view;
+        // How the hits were cast; reuse needs them all to match.
+        RayTraversal traversal = RayTraversal::Dda;
+        SimdMode simd = SimdMode::Scalar;
+        bool skip_empty = true;
+    };
+
+    ThreadPool pool_;
+    RayTable rays_; // rebuilt only when the viewport width, ray count or FOV change
+    std::vector<WallColumn> columns_;
+    std::vector<WallColumn> last_columns_; // the frame before, while reusing
+    Camera camera_;
+    int rays_cast_ = 0;
+    std::vector<MapRegion> edited_;   // since camera_.revision
+    std::vector<std::uint8_t> stale_; // per column: may see an edited region
+
+    std::vector<std::uint32_t> sprite_ids_;
+    std::vector<VisibleSprite> sprites_;
+    int sprites_drawn_ = 0;
+};
+
+// Draws the tiles visible inside [0, clip_w) x [0, clip_h), doors shaded by
+// how far they are open. The output only depends on the map and the clip
+// size, so the game retains it in a layer and redraws it only when an edit
+// lands inside minimap_cells.
+void draw_minimap(RenderSink &sink, const Map &map, int clip_w, int clip_h);
+[[nodiscard]] MapRegion minimap_cells(const Map &map, int clip_w, int clip_h) noexcept;
+void draw_player_2d(RenderSink &sink, const Player &player);
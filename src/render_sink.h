@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// RGBA8 colour as every sink stores it: red in the low byte, so the bytes
+// in memory read R, G, B, A.
+[[nodiscard]] inline std::uint32_t pack_rgba(const float r, const float g, const float b) noexcept
+{
+    const auto unorm8 = [](const float v) {
+        return static_cast<std::uint32_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+    };
+    return unorm8(r) | unorm8(g) << 8 | unorm8(b) << 16 | 0xff000000u;
+}
+
+// A textured wall strip: texture column u of the tile's wall texture, with
+// texture rows v0..v1 stretched over [y0, y1). v0 > 0 or v1 < 1 when the
+// wall is taller than the viewport and clipped.
+struct WallSpan
+{
+    float x0, width;
+    float y0, y1;
+    float u;
+    float v0, v1;
+    float shade;
+    std::uint8_t tile;
+};
+
+// Floor and ceiling above and below one wall strip. The pixel row centred
+// at y sees the floor (below the horizon) or the ceiling (above it) at view
+// depth d = depth_scale / |y - horizon|, i.e. the world point
+// (px, py) + (dir_x, dir_y) * d: dir is the column's ray scaled to a unit
+// step along the view direction.
+struct FloorSpan
+{
+    float x0, width;
+    float view_y0, view_y1;
+    float ceiling_y1; // ceiling covers [view_y0, ceiling_y1)
+    float floor_y0;   // floor covers [floor_y0, view_y1)
+    float horizon;
+    float depth_scale;
+    float px, py;
+    float dir_x, dir_y;
+    float cell; // world size of one floor texture repeat
+    float fog;  // brightness at depth d is 1 / (1 + fog * d * d)
+    std::uint8_t floor_tile, ceiling_tile;
+};
+
+// Adjacent flat wall strips that hit the same face, as one trapezoid: the
+// left edge at x0 spans [top0, bottom0), the right edge at x1 [top1,
+// bottom1), and the grey level runs from shade0 to shade1 across it.
+struct WallRun
+{
+    float x0, x1;
+    float top0, bottom0;
+    float top1, bottom1;
+    float shade0, shade1;
+};
+
+class RenderSink
+{
+public:
+    virtual ~RenderSink() = default;
+
+    virtual void push_quad(float x0, float y0, float x1, float y1, float r, float g, float b) = 0;
+    virtual void push_line(float x0, float y0, float x1, float y1, float r, float g, float b) = 0;
+
+    // Screen-aligned strip [x0, x0 + width) x [y0, y1): wall columns and the
+    // sky / floor bands. Sinks without a cheaper path take it as a quad.
+    virtual void push_column(float x0, float width, float y0, float y1, float r, float g, float b)
+    {
+        push_quad(x0, y0, x0 + width, y1, r, g, b);
+    }
+
+    // Sinks without wall textures draw the flat shaded strip.
+    virtual void push_wall(const WallSpan &w)
+    {
+        push_column(w.x0, w.width, w.y0, w.y1, w.shade, w.shade, w.shade);
+    }
+
+    // Sinks that texture floors themselves say so; cast_and_draw then sends
+    // a push_floor per column instead of flat sky and floor bands.
+    [[nodiscard]] virtual bool casts_floors() const noexcept { return false; }
+    virtual void push_floor(const FloorSpan &) {}
+
+    // Sinks that draw trapezoids say so; cast_and_draw then sends flat walls
+    // as one push_wall_run per face instead of a push_column per ray, and
+    // sprites as quads, which such sinks must draw after columns.
+    [[nodiscard]] virtual bool merges_walls() const noexcept { return false; }
+    virtual void push_wall_run(const WallRun &) {}
+};
@@ -1,6 +1,7 @@
 #include "renderer.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <iterator>
@@ -49,32 +50,118 @@ GLuint link_program(GLuint vs, GLuint fs)
     return p;
 }
 
-void setup_vao(GLuint &vao, GLuint &vbo)
+void set_vertex_layout()
+{
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex2D), nullptr);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex2D),
+                          reinterpret_cast<void *>(offsetof(Vertex2D, rgba)));
+}
+
+// Per-instance attributes for ColumnInstance records starting at offset in
+// the bound GL_ARRAY_BUFFER. GL 3.3 has no base instance, so ring segments
+// are selected by re-pointing the attributes.
+void set_column_layout(const std::size_t offset)
+{
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ColumnInstance),
+                          reinterpret_cast<void *>(offset));
+    glVertexAttribDivisor(0, 1);
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ColumnInstance),
+                          reinterpret_cast<void *>(offset + offsetof(ColumnInstance, rgba)));
+    glVertexAttribDivisor(1, 1);
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(ColumnInstance),
+                          reinterpret_cast<void *>(offset + offsetof(ColumnInstance, u)));
+    glVertexAttribDivisor(2, 1);
+}
+
+void setup_vao(GLuint &vao, GLuint &vbo, const bool columns = false)
 {
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    if (columns)
+        set_column_layout(0);
+    else
+        set_vertex_layout();
+    glBindVertexArray(0);
+}
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex2D), nullptr);
+bool buffer_storage_supported()
+{
+#if defined(GL_VERSION_4_4)
+    if (GLAD_GL_VERSION_4_4)
+        return true;
+#endif
+#if defined(GL_ARB_buffer_storage)
+    if (GLAD_GL_ARB_buffer_storage)
+        return true;
+#endif
+    return false;
+}
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex2D),
-                          reinterpret_cast<void *>(2 * sizeof(float)));
+// Immutable, persistently mapped storage for the bound GL_ARRAY_BUFFER.
+// Returns null when the loader was generated without buffer storage.
+void *map_persistent(const GLsizeiptr bytes)
+{
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+    constexpr GLbitfield kFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, kFlags);
+    return glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, kFlags);
+#else
+    (void) bytes;
+    return nullptr;
+#endif
+}
 
-    glBindVertexArray(0);
+// Fills the bound buffer with data, re-specifying its storage only when it
+// must grow; smaller frames orphan and overwrite the existing size.
+void upload(const GLenum target, std::size_t &capacity, const void *data, const std::size_t bytes)
+{
+    if (bytes > capacity)
+    {
+        capacity = bytes;
+        glBufferData(target, static_cast<GLsizeiptr>(bytes), data, GL_STREAM_DRAW);
+        return;
+    }
+    glBufferData(target, static_cast<GLsizeiptr>(capacity), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, static_cast<GLsizeiptr>(bytes), data);
 }
 
+// Enough for a 5000-column frame with debug rays and the minimap.
+constexpr std::size_t kMinSegmentVerts = 64 * 1024;
+constexpr std::size_t kMinSegmentColumns = 8 * 1024;
+
 } // namespace
 
 Renderer2D::~Renderer2D()
 {
+    destroy_ring();
+    for (const Layer &layer : layers_)
+    {
+        if (layer.vbo) glDeleteBuffers(1, &layer.vbo);
+        if (layer.vao) glDeleteVertexArrays(1, &layer.vao);
+    }
+    if (ibo_quads_) glDeleteBuffers(1, &ibo_quads_);
+    if (vbo_col_) glDeleteBuffers(1, &vbo_col_);
+    if (vao_col_) glDeleteVertexArrays(1, &vao_col_);
     if (vbo_line_) glDeleteBuffers(1, &vbo_line_);
     if (vao_line_) glDeleteVertexArrays(1, &vao_line_);
     if (vbo_tri_) glDeleteBuffers(1, &vbo_tri_);
     if (vao_tri_) glDeleteVertexArrays(1, &vao_tri_);
+    if (wall_tex_) glDeleteTextures(1, &wall_tex_);
+    if (frame_tex_) glDeleteTextures(1, &frame_tex_);
+    if (blit_vao_) glDeleteVertexArrays(1, &blit_vao_);
+    if (blit_prog_) glDeleteProgram(blit_prog_);
+    if (col_prog_) glDeleteProgram(col_prog_);
     if (prog_) glDeleteProgram(prog_);
 }
 
@@ -83,15 +170,53 @@ void Renderer2D::init()
     constexpr auto vs_src = R"GLSL(
         #version 330 core
         layout (location = 0) in vec2 aPos;
-        layout (location = 1) in vec3 aColor;
+        layout (location = 1) in vec4 aColor;
         uniform mat4 uMVP;
         out vec3 vColor;
         void main() {
-            vColor = aColor;
+            vColor = aColor.rgb;
             gl_Position = uMVP * vec4(aPos, 0.0, 1.0);
         }
     )GLSL";
 
+    // One instance per column, drawn as a 4-vertex triangle strip whose
+    // corners come from gl_VertexID. Wall textures are stored column-major,
+    // so s runs down the wall and t along it; v's screen-space derivative
+    // picks the mip level from the projected wall height.
+    constexpr auto col_vs_src = R"GLSL(
+        #version 330 core
+        layout (location = 0) in vec4 aRect; // x0, width, y0, y1
+        layout (location = 1) in vec4 aColor;
+        layout (location = 2) in vec4 aTex;  // u, layer, v0, v1
+        uniform mat4 uMVP;
+        out vec3 vColor;
+        out vec2 vTexel;
+        flat out float vLayer;
+        void main() {
+            vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+            vec2 pos = vec2(aRect.x + aRect.y * corner.x, mix(aRect.z, aRect.w, corner.y));
+            vColor = aColor.rgb;
+            vTexel = vec2(mix(aTex.z, aTex.w, corner.y), aTex.x) / 65535.0;
+            vLayer = aTex.y == 65535.0 ? -1.0 : aTex.y;
+            gl_Position = uMVP * vec4(pos, 0.0, 1.0);
+        }
+    )GLSL";
+
+    constexpr auto col_fs_src = R"GLSL(
+        #version 330 core
+        in vec3 vColor;
+        in vec2 vTexel;
+        flat in float vLayer;
+        uniform sampler2DArray uWalls;
+        out vec4 FragColor;
+        void main() {
+            vec3 c = vColor;
+            if (vLayer >= 0.0)
+                c *= texture(uWalls, vec3(vTexel, vLayer)).rgb;
+            FragColor = vec4(c, 1.0);
+        }
+    )GLSL";
+
     constexpr auto fs_src = R"GLSL(
         #version 330 core
         in vec3 vColor;
@@ -99,21 +224,247 @@ void Renderer2D::init()
         void main() { FragColor = vec4(vColor, 1.0); }
     )GLSL";
 
+    // Fullscreen triangle over a SoftwareFramebuffer. Its pixels are
+    // column-major, so texture rows are screen columns and the lookup swaps
+    // the axes instead of the CPU transposing the frame.
+    constexpr auto blit_vs_src = R"GLSL(
+        #version 330 core
+        out vec2 vScreen;
+        void main() {
+            vec2 pos = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID >> 1) * 4.0 - 1.0);
+            vScreen = vec2(pos.x + 1.0, 1.0 - pos.y) * 0.5;
+            gl_Position = vec4(pos, 0.0, 1.0);
+        }
+    )GLSL";
+
+    constexpr auto blit_fs_src = R"GLSL(
+        #version 330 core
+        in vec2 vScreen;
+        uniform sampler2D uFrame;
+        out vec4 FragColor;
+        void main() { FragColor = vec4(texture(uFrame, vScreen.yx).rgb, 1.0); }
+    )GLSL";
+
     const GLuint vs = compile_shader(GL_VERTEX_SHADER, vs_src);
     const GLuint fs = compile_shader(GL_FRAGMENT_SHADER, fs_src);
     prog_ = link_program(vs, fs);
     mvp_loc_ = glGetUniformLocation(prog_, "uMVP");
 
+    const GLuint col_vs = compile_shader(GL_VERTEX_SHADER, col_vs_src);
+    const GLuint col_fs = compile_shader(GL_FRAGMENT_SHADER, col_fs_src);
+    col_prog_ = link_program(col_vs, col_fs);
+    col_mvp_loc_ = glGetUniformLocation(col_prog_, "uMVP");
+    glUseProgram(col_prog_);
+    glUniform1i(glGetUniformLocation(col_prog_, "uWalls"), 0);
+    glUseProgram(0);
+
+    const GLuint blit_vs = compile_shader(GL_VERTEX_SHADER, blit_vs_src);
+    const GLuint blit_fs = compile_shader(GL_FRAGMENT_SHADER, blit_fs_src);
+    blit_prog_ = link_program(blit_vs, blit_fs);
+    glGenVertexArrays(1, &blit_vao_);
+
     setup_vao(vao_tri_, vbo_tri_);
     setup_vao(vao_line_, vbo_line_);
+    setup_vao(vao_col_, vbo_col_, true);
+
+    glGenBuffers(1, &ibo_quads_);
+    glBindVertexArray(vao_tri_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_quads_);
+    glBindVertexArray(0);
+    ensure_quad_indices(kMinSegmentVerts / 4);
+
+    persistent_supported_ = buffer_storage_supported();
 
     glDisable(GL_DEPTH_TEST);
 }
 
+bool Renderer2D::create_stream(StreamBuffer &s, const std::size_t segment_bytes)
+{
+    s.segment_bytes = segment_bytes;
+    const auto bytes = static_cast<GLsizeiptr>(segment_bytes * kRingFrames);
+
+    glGenVertexArrays(1, &s.vao);
+    glGenBuffers(1, &s.vbo);
+    glBindVertexArray(s.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, s.vbo);
+    if (mode_ == UploadMode::Persistent)
+    {
+        s.persistent_base = static_cast<std::byte *>(map_persistent(bytes));
+        return s.persistent_base != nullptr;
+    }
+    glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    return true;
+}
+
+void Renderer2D::create_ring(const std::size_t segment_verts, const std::size_t segment_columns)
+{
+    destroy_ring();
+    if (!create_stream(vert_ring_, segment_verts * sizeof(Vertex2D))
+        || !create_stream(col_ring_, segment_columns * sizeof(ColumnInstance)))
+    {
+        // Storage may already be immutable; start over on fresh buffers.
+        std::fprintf(stderr, "Persistent mapping failed, using glMapBufferRange\n");
+        destroy_ring();
+        mode_ = UploadMode::MapRange;
+        persistent_supported_ = false;
+        create_stream(vert_ring_, segment_verts * sizeof(Vertex2D));
+        create_stream(col_ring_, segment_columns * sizeof(ColumnInstance));
+    }
+    segment_verts_ = segment_verts;
+    segment_cols_ = segment_columns;
+
+    glBindVertexArray(vert_ring_.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vert_ring_.vbo);
+    set_vertex_layout();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_quads_);
+    glBindVertexArray(0);
+    ensure_quad_indices(segment_verts / 4);
+    segment_ = 0;
+}
+
+// The index pattern is the same for every frame, so it is only rebuilt
+// when a frame draws more quads than it covers.
+void Renderer2D::ensure_quad_indices(const std::size_t quads)
+{
+    if (quads <= index_quads_)
+        return;
+    index_quads_ = std::max(quads, index_quads_ * 2);
+
+    std::vector<std::uint32_t> indices(index_quads_ * 6);
+    for (std::size_t q = 0; q < index_quads_; ++q)
+    {
+        const auto v = static_cast<std::uint32_t>(q * 4);
+        std::uint32_t *i = indices.data() + q * 6;
+        i[0] = v;
+        i[1] = v + 1;
+        i[2] = v + 2;
+        i[3] = v;
+        i[4] = v + 2;
+        i[5] = v + 3;
+    }
+    // Element bindings are VAO state; vao_tri_ holds the buffer, the others
+    // share the same name so they see the new storage too.
+    glBindVertexArray(vao_tri_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(std::uint32_t)),
+                 indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
+
+void Renderer2D::destroy_ring()
+{
+    for (GLsync &fence : fences_)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    for (StreamBuffer *s : {&vert_ring_, &col_ring_})
+    {
+        if (s->persistent_base)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, s->vbo);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        if (s->vbo) glDeleteBuffers(1, &s->vbo);
+        if (s->vao) glDeleteVertexArrays(1, &s->vao);
+        *s = StreamBuffer{};
+    }
+    segment_verts_ = 0;
+    segment_cols_ = 0;
+}
+
+void Renderer2D::map_stream(StreamBuffer &s) const
+{
+    const std::size_t first = static_cast<std::size_t>(segment_) * s.segment_bytes;
+    if (s.persistent_base)
+    {
+        s.mapped = s.persistent_base + first;
+        return;
+    }
+
+    // The fence already guarantees the GPU is done with this range, so the
+    // driver need not synchronise or keep its old contents.
+    glBindBuffer(GL_ARRAY_BUFFER, s.vbo);
+    s.mapped = static_cast<std::byte *>(glMapBufferRange(
+        GL_ARRAY_BUFFER, static_cast<GLintptr>(first), static_cast<GLsizeiptr>(s.segment_bytes),
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+        | GL_MAP_FLUSH_EXPLICIT_BIT));
+}
+
+// Flushes the bytes written at the front and back of the current segment;
+// nothing is copied.
+void Renderer2D::unmap_stream(StreamBuffer &s, const std::size_t front_bytes,
+                              const std::size_t back_bytes) const
+{
+    if (s.mapped && !s.persistent_base)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, s.vbo);
+        if (front_bytes > 0)
+            glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(front_bytes));
+        if (back_bytes > 0)
+            glFlushMappedBufferRange(GL_ARRAY_BUFFER,
+                                     static_cast<GLintptr>(s.segment_bytes - back_bytes),
+                                     static_cast<GLsizeiptr>(back_bytes));
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    s.mapped = nullptr;
+}
+
+// Advances to the next ring segment, waiting for the GPU to finish the frame
+// that last read it (kRingFrames frames ago, so normally already done).
+void Renderer2D::map_segment()
+{
+    segment_ = (segment_ + 1) % kRingFrames;
+    if (GLsync &fence = fences_[segment_])
+    {
+        GLenum status;
+        do
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+        while (status == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    map_stream(vert_ring_);
+    map_stream(col_ring_);
+}
+
 void Renderer2D::begin_frame(int w, int h)
 {
-    tris_.clear();
+    // Spill vectors keep their capacity; reserving the high-water mark up
+    // front means a steady-state frame never reallocates.
+    quads_.clear();
     lines_.clear();
+    cols_.clear();
+    quads_.reserve(high_water_quads_ * 4);
+    lines_.reserve(high_water_lines_);
+    cols_.reserve(high_water_cols_);
+    quad_count_ = 0;
+    line_count_ = 0;
+    col_count_ = 0;
+
+    UploadMode mode = requested_mode_;
+    if (mode == UploadMode::Persistent && !persistent_supported_)
+        mode = UploadMode::MapRange;
+    if (mode == UploadMode::BufferData)
+    {
+        if (mode_ != mode)
+            destroy_ring();
+        mode_ = mode;
+    }
+    else
+    {
+        // Grow past the largest frame seen so far; spills only cost the
+        // frame that first outgrows the ring.
+        const std::size_t high_water_verts = high_water_quads_ * 4 + high_water_lines_;
+        if (mode != mode_ || high_water_verts > segment_verts_ || high_water_cols_ > segment_cols_)
+        {
+            mode_ = mode;
+            create_ring(std::max({kMinSegmentVerts, segment_verts_, high_water_verts + high_water_verts / 2}),
+                        std::max({kMinSegmentColumns, segment_cols_, high_water_cols_ + high_water_cols_ / 2}));
+        }
+        map_segment();
+    }
+
     viewport_w_ = w;
     viewport_h_ = h;
 
@@ -129,54 +480,347 @@ void Renderer2D::begin_frame(int w, int h)
     mvp_[15] = 1.0f;
 }
 
+std::span<Vertex2D> Renderer2D::reserve_quads(const std::size_t n)
+{
+    if (building_layer_ >= 0)
+    {
+        layer_quads_.resize(layer_quads_.size() + n * 4);
+        return {layer_quads_.data() + layer_quads_.size() - n * 4, n * 4};
+    }
+
+    // Once a batch spills it keeps spilling, so draw order is preserved.
+    if (vert_ring_.mapped && quads_.empty() && (quad_count_ + n) * 4 + line_count_ <= segment_verts_)
+    {
+        Vertex2D *dst = reinterpret_cast<Vertex2D *>(vert_ring_.mapped) + quad_count_ * 4;
+        quad_count_ += n;
+        return {dst, n * 4};
+    }
+    quads_.resize(quads_.size() + n * 4);
+    return {quads_.data() + quads_.size() - n * 4, n * 4};
+}
+
+Vertex2D *Renderer2D::reserve_lines(const std::size_t n)
+{
+    if (building_layer_ >= 0)
+    {
+        layer_lines_.resize(layer_lines_.size() + n);
+        return layer_lines_.data() + layer_lines_.size() - n;
+    }
+    if (vert_ring_.mapped && lines_.empty() && quad_count_ * 4 + line_count_ + n <= segment_verts_)
+    {
+        line_count_ += n;
+        return reinterpret_cast<Vertex2D *>(vert_ring_.mapped) + segment_verts_ - line_count_;
+    }
+    lines_.resize(lines_.size() + n);
+    return lines_.data() + lines_.size() - n;
+}
+
 void Renderer2D::push_quad(float x0, float y0, float x1, float y1,
                            float r, float g, float b)
 {
-    const Vertex2D a{x0, y0, r, g, b};
-    const Vertex2D bb{x1, y0, r, g, b};
-    const Vertex2D c{x1, y1, r, g, b};
-    const Vertex2D d{x0, y1, r, g, b};
-    tris_.push_back(a);
-    tris_.push_back(bb);
-    tris_.push_back(c);
-    tris_.push_back(a);
-    tris_.push_back(c);
-    tris_.push_back(d);
+    const std::uint32_t rgba = pack_rgba(r, g, b);
+    const std::span<Vertex2D> v = reserve_quads(1);
+    v[0] = Vertex2D{x0, y0, rgba};
+    v[1] = Vertex2D{x1, y0, rgba};
+    v[2] = Vertex2D{x1, y1, rgba};
+    v[3] = Vertex2D{x0, y1, rgba};
+}
+
+void Renderer2D::push_wall_run(const WallRun &run)
+{
+    const std::uint32_t left = pack_rgba(run.shade0, run.shade0, run.shade0);
+    const std::uint32_t right = pack_rgba(run.shade1, run.shade1, run.shade1);
+    const std::span<Vertex2D> v = reserve_quads(1);
+    v[0] = Vertex2D{run.x0, run.top0, left};
+    v[1] = Vertex2D{run.x1, run.top1, right};
+    v[2] = Vertex2D{run.x1, run.bottom1, right};
+    v[3] = Vertex2D{run.x0, run.bottom0, left};
 }
 
 void Renderer2D::push_line(float x0, float y0, float x1, float y1,
                            float r, float g, float b)
 {
-    lines_.push_back(Vertex2D{x0, y0, r, g, b});
-    lines_.push_back(Vertex2D{x1, y1, r, g, b});
+    const std::uint32_t rgba = pack_rgba(r, g, b);
+    Vertex2D *v = reserve_lines(2);
+    v[0] = Vertex2D{x0, y0, rgba};
+    v[1] = Vertex2D{x1, y1, rgba};
+}
+
+void Renderer2D::push_column(float x0, float width, float y0, float y1,
+                             float r, float g, float b)
+{
+    if (!instanced_columns_ || building_layer_ >= 0)
+    {
+        push_quad(x0, y0, x0 + width, y1, r, g, b);
+        return;
+    }
+
+    push_instance(ColumnInstance{x0, width, y0, y1, pack_rgba(r, g, b)});
+}
+
+void Renderer2D::push_wall(const WallSpan &w)
+{
+    if (!wall_tex_ || !instanced_columns_ || building_layer_ >= 0)
+    {
+        RenderSink::push_wall(w);
+        return;
+    }
+
+    push_instance(wall_instance(w));
+}
+
+void Renderer2D::push_instance(const ColumnInstance &col)
+{
+    if (col_ring_.mapped && cols_.empty() && col_count_ < segment_cols_)
+        reinterpret_cast<ColumnInstance *>(col_ring_.mapped)[col_count_++] = col;
+    else
+        cols_.push_back(col);
+}
+
+std::span<ColumnInstance> Renderer2D::reserve_columns(const std::size_t n)
+{
+    if (col_ring_.mapped && cols_.empty() && col_count_ + n <= segment_cols_)
+    {
+        ColumnInstance *dst = reinterpret_cast<ColumnInstance *>(col_ring_.mapped) + col_count_;
+        col_count_ += n;
+        return {dst, n};
+    }
+    cols_.resize(cols_.size() + n);
+    return {cols_.data() + cols_.size() - n, n};
+}
+
+void Renderer2D::submit(const DrawList &list)
+{
+    const std::span<const ColumnInstance> cols = list.columns();
+    if (instanced_columns_ && building_layer_ < 0)
+    {
+        const std::span<ColumnInstance> dst = reserve_columns(cols.size());
+        std::ranges::copy(cols, dst.begin());
+        if (!wall_tex_)
+            for (ColumnInstance &c : dst)
+                c.layer = ColumnInstance::kFlat;
+    }
+    else
+    {
+        const std::span<Vertex2D> v = reserve_quads(cols.size());
+        for (std::size_t i = 0; i < cols.size(); ++i)
+        {
+            const ColumnInstance &c = cols[i];
+            const float x1 = c.x0 + c.width;
+            v[i * 4 + 0] = Vertex2D{c.x0, c.y0, c.rgba};
+            v[i * 4 + 1] = Vertex2D{x1, c.y0, c.rgba};
+            v[i * 4 + 2] = Vertex2D{x1, c.y1, c.rgba};
+            v[i * 4 + 3] = Vertex2D{c.x0, c.y1, c.rgba};
+        }
+    }
+
+    std::ranges::copy(list.quads(), reserve_quads(list.quads().size() / 4).begin());
+    std::ranges::copy(list.lines(), reserve_lines(list.lines().size()));
+}
+
+void Renderer2D::set_wall_textures(const WallTextures &textures)
+{
+    if (!wall_tex_)
+        glGenTextures(1, &wall_tex_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, wall_tex_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, WallTextures::kLevels - 1);
+
+    // Our own box-filtered mips, so GPU and software pick the same texels.
+    std::vector<std::uint32_t> layers;
+    for (int level = 0; level < WallTextures::kLevels; ++level)
+    {
+        const int side = WallTextures::kSize >> level;
+        const auto texels = static_cast<std::size_t>(side) * static_cast<std::size_t>(side);
+        layers.clear();
+        for (int t = 0; t < WallTextures::kCount; ++t)
+            layers.insert(layers.end(), textures.level(t, level), textures.level(t, level) + texels);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, side, side, WallTextures::kCount, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, layers.data());
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+int Renderer2D::create_layer()
+{
+    Layer layer;
+    glGenVertexArrays(1, &layer.vao);
+    glGenBuffers(1, &layer.vbo);
+    glBindVertexArray(layer.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+    set_vertex_layout();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_quads_);
+    glBindVertexArray(0);
+
+    layers_.push_back(layer);
+    return static_cast<int>(layers_.size()) - 1;
+}
+
+void Renderer2D::begin_layer(const int layer)
+{
+    building_layer_ = layer;
+    layer_quads_.clear();
+    layer_lines_.clear();
 }
 
-void Renderer2D::flush() const
+// Quads and lines share one VBO: quads first, lines after them.
+void Renderer2D::end_layer()
+{
+    Layer &layer = layers_[static_cast<std::size_t>(building_layer_)];
+    building_layer_ = -1;
+
+    const std::size_t quad_bytes = layer_quads_.size() * sizeof(Vertex2D);
+    const std::size_t line_bytes = layer_lines_.size() * sizeof(Vertex2D);
+    glBindBuffer(GL_ARRAY_BUFFER, layer.vbo);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(quad_bytes + line_bytes), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(quad_bytes), layer_quads_.data());
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(quad_bytes), static_cast<GLsizeiptr>(line_bytes),
+                    layer_lines_.data());
+    layer.quads = static_cast<GLsizei>(layer_quads_.size() / 4);
+    layer.line_verts = static_cast<GLsizei>(layer_lines_.size());
+    ensure_quad_indices(layer_quads_.size() / 4);
+
+    // Nothing of the layer is needed on the CPU any more.
+    layer_quads_ = {};
+    layer_lines_ = {};
+}
+
+void Renderer2D::set_layer_visible(const int layer, const bool visible) noexcept
+{
+    layers_[static_cast<std::size_t>(layer)].visible = visible;
+}
+
+void Renderer2D::present(const SoftwareFramebuffer &fb, const int w, const int h)
+{
+    if (!frame_tex_)
+    {
+        glGenTextures(1, &frame_tex_);
+        glBindTexture(GL_TEXTURE_2D, frame_tex_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, frame_tex_);
+
+    // Texture width is the framebuffer height: one texture row per column.
+    if (fb.height() != frame_tex_w_ || fb.width() != frame_tex_h_)
+    {
+        frame_tex_w_ = fb.height();
+        frame_tex_h_ = fb.width();
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frame_tex_w_, frame_tex_h_, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                     nullptr);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame_tex_w_, frame_tex_h_, GL_RGBA, GL_UNSIGNED_BYTE,
+                    fb.columns());
+
+    glViewport(0, 0, w, h);
+    glUseProgram(blit_prog_);
+    glBindVertexArray(blit_vao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    uploaded_bytes_ = static_cast<std::size_t>(fb.width()) * static_cast<std::size_t>(fb.height())
+                      * sizeof(std::uint32_t);
+}
+
+void Renderer2D::flush()
 {
     glViewport(0, 0, viewport_w_, viewport_h_);
+
+    glUseProgram(prog_);
+    glUniformMatrix4fv(mvp_loc_, 1, GL_FALSE, mvp_);
+    for (const Layer &layer : layers_)
+    {
+        if (!layer.visible)
+            continue;
+        glBindVertexArray(layer.vao);
+        if (layer.quads > 0)
+            glDrawElements(GL_TRIANGLES, layer.quads * 6, GL_UNSIGNED_INT, nullptr);
+        if (layer.line_verts > 0)
+            glDrawArrays(GL_LINES, layer.quads * 4, layer.line_verts);
+    }
+
+    const bool streamed = vert_ring_.mapped != nullptr;
+    unmap_stream(vert_ring_, quad_count_ * 4 * sizeof(Vertex2D), line_count_ * sizeof(Vertex2D));
+    unmap_stream(col_ring_, col_count_ * sizeof(ColumnInstance), 0);
+
+    if (col_count_ > 0 || !cols_.empty())
+    {
+        glUseProgram(col_prog_);
+        glUniformMatrix4fv(col_mvp_loc_, 1, GL_FALSE, mvp_);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, wall_tex_);
+
+        if (col_count_ > 0)
+        {
+            glBindVertexArray(col_ring_.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, col_ring_.vbo);
+            set_column_layout(static_cast<std::size_t>(segment_) * col_ring_.segment_bytes);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(col_count_));
+        }
+
+        if (!cols_.empty())
+        {
+            glBindVertexArray(vao_col_);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo_col_);
+            upload(GL_ARRAY_BUFFER, vbo_col_bytes_, cols_.data(), cols_.size() * sizeof(ColumnInstance));
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(cols_.size()));
+        }
+    }
+
     glUseProgram(prog_);
     glUniformMatrix4fv(mvp_loc_, 1, GL_FALSE, mvp_);
 
-    if (!tris_.empty())
+    const auto first = static_cast<GLint>(static_cast<std::size_t>(segment_) * segment_verts_);
+    if (streamed && quad_count_ > 0)
     {
+        glBindVertexArray(vert_ring_.vao);
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(quad_count_ * 6), GL_UNSIGNED_INT,
+                                 nullptr, first);
+    }
+
+    if (!quads_.empty())
+    {
+        ensure_quad_indices(quads_.size() / 4);
         glBindVertexArray(vao_tri_);
         glBindBuffer(GL_ARRAY_BUFFER, vbo_tri_);
-        glBufferData(GL_ARRAY_BUFFER,
-                     static_cast<GLsizeiptr>(tris_.size() * sizeof(Vertex2D)),
-                     tris_.data(), GL_STREAM_DRAW);
-        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(tris_.size()));
+        upload(GL_ARRAY_BUFFER, vbo_tri_bytes_, quads_.data(), quads_.size() * sizeof(Vertex2D));
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(quads_.size() / 4 * 6), GL_UNSIGNED_INT, nullptr);
+    }
+
+    if (streamed && line_count_ > 0)
+    {
+        glBindVertexArray(vert_ring_.vao);
+        glDrawArrays(GL_LINES, first + static_cast<GLint>(segment_verts_ - line_count_),
+                     static_cast<GLsizei>(line_count_));
     }
 
     if (!lines_.empty())
     {
         glBindVertexArray(vao_line_);
         glBindBuffer(GL_ARRAY_BUFFER, vbo_line_);
-        glBufferData(GL_ARRAY_BUFFER,
-                     static_cast<GLsizeiptr>(lines_.size() * sizeof(Vertex2D)),
-                     lines_.data(), GL_STREAM_DRAW);
+        upload(GL_ARRAY_BUFFER, vbo_line_bytes_, lines_.data(), lines_.size() * sizeof(Vertex2D));
         glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(lines_.size()));
     }
 
     glBindVertexArray(0);
     glUseProgram(0);
+
+    if (streamed)
+        fences_[segment_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    const std::size_t quads = quad_count_ + quads_.size() / 4;
+    const std::size_t lines = line_count_ + lines_.size();
+    const std::size_t cols = col_count_ + cols_.size();
+    const std::size_t verts = quads * 4 + lines;
+    high_water_quads_ = std::max(high_water_quads_, quads);
+    high_water_lines_ = std::max(high_water_lines_, lines);
+    high_water_cols_ = std::max(high_water_cols_, cols);
+    uploaded_bytes_ = verts * sizeof(Vertex2D) + cols * sizeof(ColumnInstance);
 }
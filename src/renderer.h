@@ -1,19 +1,28 @@
 #pragma once
 
+#include "draw_list.h"
+#include "render_sink.h"
+#include "software_framebuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <vector>
 #include <glad/glad.h>
 
-struct Vertex2D
+// How vertices reach the GPU each frame.
+enum class UploadMode
 {
-    float x, y;
-    float r, g, b;
+    BufferData, // CPU vectors re-specified with glBufferData in flush
+    MapRange,   // ring segment mapped unsynchronized, fenced per frame
+    Persistent, // ring mapped once (GL 4.4 / ARB_buffer_storage)
 };
 
-class Renderer2D
+class Renderer2D final : public RenderSink
 {
 public:
     Renderer2D() = default;
-    ~Renderer2D();
+    ~Renderer2D() override;
 
     Renderer2D(const Renderer2D &) = delete;
     Renderer2D &operator=(const Renderer2D &) = delete;
@@ -22,19 +31,133 @@ public:
 
     void init();
     void begin_frame(int w, int h);
-    void push_quad(float x0, float y0, float x1, float y1, float r, float g, float b);
-    void push_line(float x0, float y0, float x1, float y1, float r, float g, float b);
-    void flush() const;
+    void push_quad(float x0, float y0, float x1, float y1, float r, float g, float b) override;
+    void push_line(float x0, float y0, float x1, float y1, float r, float g, float b) override;
+    void push_column(float x0, float width, float y0, float y1, float r, float g, float b) override;
+    void push_wall(const WallSpan &w) override;
+    [[nodiscard]] bool merges_walls() const noexcept override { return true; }
+    void push_wall_run(const WallRun &run) override;
+    // Room for n quads written in place, four vertices each in the order
+    // (x0, y0) (x1, y0) (x1, y1) (x0, y1). Valid until the next push or flush.
+    [[nodiscard]] std::span<Vertex2D> reserve_quads(std::size_t n);
+    // Copies a list built elsewhere, as if its pushes were made here: one
+    // bulk copy per span into the ring, with the same flat fallbacks.
+    void submit(const DrawList &list);
+    // Retained layers are drawn first, then columns, then the quads and
+    // lines of the same frame.
+    void flush();
+
+    // Retained geometry for draws that do not change between frames (the
+    // minimap). Quads, lines and columns pushed between begin_layer and
+    // end_layer go into the layer's own static VBO instead of the frame;
+    // every flush then draws each visible layer with one indexed call and
+    // one line call, whatever its size. Rebuilding replaces the contents.
+    [[nodiscard]] int create_layer();
+    void begin_layer(int layer);
+    void end_layer();
+    void set_layer_visible(int layer, bool visible) noexcept;
+
+    // Uploads every texture as one layer of a mipmapped 2D array. Until
+    // then push_wall draws flat strips. The texture rows are the atlas's
+    // columns, so the shader samples with swapped axes.
+    void set_wall_textures(const WallTextures &textures);
+
+    // Software backend: uploads fb as one streaming texture and draws it over
+    // a w x h viewport, in place of begin_frame .. flush.
+    void present(const SoftwareFramebuffer &fb, int w, int h);
+
+    // Takes effect at the next begin_frame; Persistent falls back to
+    // MapRange when the context lacks buffer storage.
+    void set_upload_mode(UploadMode mode) noexcept { requested_mode_ = mode; }
+    [[nodiscard]] UploadMode upload_mode() const noexcept { return mode_; }
+    [[nodiscard]] bool persistent_supported() const noexcept { return persistent_supported_; }
+    // With instancing off, push_column goes through push_quad like before.
+    void set_instanced_columns(bool on) noexcept { instanced_columns_ = on; }
+    [[nodiscard]] bool instanced_columns() const noexcept { return instanced_columns_; }
+    // Vertex and instance bytes handed to GL by the last flush.
+    [[nodiscard]] std::size_t uploaded_bytes() const noexcept { return uploaded_bytes_; }
 
 private:
+    // Streaming ring: kRingFrames segments of segment_bytes each, one per
+    // frame in flight, all guarded by the same per-segment fences.
+    static constexpr int kRingFrames = 3;
+
+    struct Layer
+    {
+        GLuint vao = 0, vbo = 0;
+        GLsizei quads = 0;
+        GLsizei line_verts = 0;
+        bool visible = true;
+    };
+
+    struct StreamBuffer
+    {
+        GLuint vao = 0, vbo = 0;
+        std::size_t segment_bytes = 0;
+        std::byte *persistent_base = nullptr;
+        std::byte *mapped = nullptr; // current segment, null when not streaming
+    };
+
+    void create_ring(std::size_t segment_verts, std::size_t segment_columns);
+    void destroy_ring();
+    void map_segment();
+    bool create_stream(StreamBuffer &s, std::size_t segment_bytes);
+    void map_stream(StreamBuffer &s) const;
+    void unmap_stream(StreamBuffer &s, std::size_t front_bytes, std::size_t back_bytes) const;
+    void ensure_quad_indices(std::size_t quads);
+    [[nodiscard]] Vertex2D *reserve_lines(std::size_t n);
+    [[nodiscard]] std::span<ColumnInstance> reserve_columns(std::size_t n);
+    void push_instance(const ColumnInstance &col);
+
     GLuint prog_ = 0;
     GLint mvp_loc_ = -1;
+    GLuint col_prog_ = 0;
+    GLint col_mvp_loc_ = -1;
+    GLuint blit_prog_ = 0;
+    GLuint blit_vao_ = 0;
+    GLuint frame_tex_ = 0;
+    GLuint wall_tex_ = 0;
+    int frame_tex_w_ = 0, frame_tex_h_ = 0;
 
     GLuint vao_tri_ = 0, vbo_tri_ = 0;
     GLuint vao_line_ = 0, vbo_line_ = 0;
+    GLuint vao_col_ = 0, vbo_col_ = 0;
+    std::size_t vbo_tri_bytes_ = 0, vbo_line_bytes_ = 0, vbo_col_bytes_ = 0;
+
+    // Shared by every quad draw: 0 1 2 0 2 3 per quad, offset by 4 each.
+    GLuint ibo_quads_ = 0;
+    std::size_t index_quads_ = 0;
 
-    std::vector<Vertex2D> tris_;
+    std::vector<Vertex2D> quads_; // four vertices per quad
     std::vector<Vertex2D> lines_;
+    std::vector<ColumnInstance> cols_;
+
+    std::vector<Layer> layers_;
+    int building_layer_ = -1;
+    std::vector<Vertex2D> layer_quads_;
+    std::vector<Vertex2D> layer_lines_;
+
+    UploadMode requested_mode_ = UploadMode::Persistent;
+    UploadMode mode_ = UploadMode::BufferData;
+    bool persistent_supported_ = false;
+    bool instanced_columns_ = true;
+
+    // Quads fill a vertex segment from the front and lines from the back;
+    // columns get their own segment. What does not fit spills into quads_ /
+    // lines_ / cols_, which keep the high-water capacity across frames.
+    StreamBuffer vert_ring_;
+    StreamBuffer col_ring_;
+    std::size_t segment_verts_ = 0;
+    std::size_t segment_cols_ = 0;
+    std::size_t high_water_quads_ = 0;
+    std::size_t high_water_lines_ = 0;
+    std::size_t high_water_cols_ = 0;
+    int segment_ = 0;
+    GLsync fences_[kRingFrames]{};
+    std::size_t quad_count_ = 0;
+    std::size_t line_count_ = 0;
+    std::size_t col_count_ = 0;
+    std::size_t uploaded_bytes_ = 0;
 
     int viewport_w_ = 0, viewport_h_ = 0;
     float mvp_[16]{};
@@ -0,0 +1,362 @@
+#include "software_framebuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TRYDOOM_X86_64 1
+#include <emmintrin.h>
+#else
+#define TRYDOOM_X86_64 0
+#endif
+
+namespace
+{
+
+// SSE2 is part of x86-64, so no dispatch is needed; spans are a few dozen
+// to a few hundred pixels, which the unrolled 16-pixel loop covers.
+void fill_span(std::uint32_t *dst, const int n, const std::uint32_t rgba) noexcept
+{
+    int i = 0;
+#if TRYDOOM_X86_64
+    const __m128i v = _mm_set1_epi32(static_cast<int>(rgba));
+    for (; i + 16 <= n; i += 16)
+    {
+        auto *p = reinterpret_cast<__m128i *>(dst + i);
+        _mm_storeu_si128(p, v);
+        _mm_storeu_si128(p + 1, v);
+        _mm_storeu_si128(p + 2, v);
+        _mm_storeu_si128(p + 3, v);
+    }
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+#endif
+    for (; i < n; ++i)
+        dst[i] = rgba;
+}
+
+// Scales the colour channels by shade / 256 (shade <= 256), two at a time.
+std::uint32_t scale_rgb(const std::uint32_t rgba, const std::uint32_t shade) noexcept
+{
+    const std::uint32_t rb = ((rgba & 0x00ff00ffu) * shade >> 8) & 0x00ff00ffu;
+    const std::uint32_t g = ((rgba & 0x0000ff00u) * shade >> 8) & 0x0000ff00u;
+    return rb | g | 0xff000000u;
+}
+
+// First pixel whose centre lies at or past edge.
+int pixel_edge(const float edge) noexcept
+{
+    return static_cast<int>(std::ceil(edge - 0.5f));
+}
+
+} // namespace
+
+void SoftwareFramebuffer::resize(const int w, const int h)
+{
+    if (w == w_ && h == h_ && data_ == pixels_.data())
+        return;
+    w_ = std::max(w, 0);
+    h_ = std::max(h, 0);
+    pixels_.assign(static_cast<std::size_t>(w_) * static_cast<std::size_t>(h_), clear_rgba_);
+    data_ = pixels_.data();
+    stride_ = h_;
+}
+
+void SoftwareFramebuffer::view_tile(const SoftwareFramebuffer &atlas, int x, int y, int w, int h) noexcept
+{
+    x = std::clamp(x, 0, atlas.w_);
+    y = std::clamp(y, 0, atlas.h_);
+    w_ = std::clamp(w, 0, atlas.w_ - x);
+    h_ = std::clamp(h, 0, atlas.h_ - y);
+    stride_ = atlas.stride_;
+    // The pixels are the atlas's, and so is the right to write them.
+    data_ = atlas.data_ + static_cast<std::size_t>(x) * static_cast<std::size_t>(stride_) + static_cast<std::size_t>(y);
+    textures_ = atlas.textures_;
+    clear_rgba_ = atlas.clear_rgba_;
+}
+
+void SoftwareFramebuffer::clear() noexcept
+{
+    if (stride_ == h_)
+    {
+        fill_span(data_, w_ * h_, clear_rgba_);
+        return;
+    }
+    for (int x = 0; x < w_; ++x)
+        fill_span(data_ + static_cast<std::size_t>(x) * static_cast<std::size_t>(stride_), h_, clear_rgba_);
+}
+
+// Covers the pixels whose centres fall inside [x0, x1) x [y0, y1), the same
+// rule GL applies to the quads Renderer2D draws.
+void SoftwareFramebuffer::fill_rect(const float x0, const float y0, const float x1, const float y1,
+                                    const std::uint32_t rgba) noexcept
+{
+    const int xs = std::max(pixel_edge(std::min(x0, x1)), 0);
+    const int xe = std::min(pixel_edge(std::max(x0, x1)), w_);
+    const int ys = std::max(pixel_edge(std::min(y0, y1)), 0);
+    const int ye = std::min(pixel_edge(std::max(y0, y1)), h_);
+    if (xs >= xe || ys >= ye)
+        return;
+
+    std::uint32_t *col = data_ + static_cast<std::size_t>(xs) * static_cast<std::size_t>(stride_) + ys;
+    for (int x = xs; x < xe; ++x, col += stride_)
+        fill_span(col, ye - ys, rgba);
+}
+
+void SoftwareFramebuffer::push_quad(float x0, float y0, float x1, float y1,
+                                    float r, float g, float b)
+{
+    fill_rect(x0, y0, x1, y1, pack_rgba(r, g, b));
+}
+
+void SoftwareFramebuffer::push_column(float x0, float width, float y0, float y1,
+                                      float r, float g, float b)
+{
+    fill_rect(x0, y0, x0 + width, y1, pack_rgba(r, g, b));
+}
+
+// Every pixel column of the strip reads the same contiguous texture column,
+// stepping down it in 16.16 fixed point.
+void SoftwareFramebuffer::push_wall(const WallSpan &w)
+{
+    if (!textures_)
+    {
+        RenderSink::push_wall(w);
+        return;
+    }
+
+    const int xs = std::max(pixel_edge(w.x0), 0);
+    const int xe = std::min(pixel_edge(w.x0 + w.width), w_);
+    const int ys = std::max(pixel_edge(w.y0), 0);
+    const int ye = std::min(pixel_edge(w.y1), h_);
+    if (xs >= xe || ys >= ye)
+        return;
+
+    const float span_h = w.y1 - w.y0;
+    const int level = WallTextures::level_for_height(span_h / std::max(w.v1 - w.v0, 1e-6f));
+    const int side = WallTextures::kSize >> level;
+    const int tu = std::clamp(static_cast<int>(w.u * static_cast<float>(side)), 0, side - 1);
+    const std::uint32_t *texels = textures_->column(WallTextures::index_for_tile(w.tile), level, tu);
+
+    // Shading the (at most kSize) texels once is cheaper than shading every
+    // pixel; the extra entry absorbs fixed-point overshoot at the bottom.
+    const auto shade = static_cast<std::uint32_t>(std::clamp(w.shade, 0.0f, 1.0f) * 256.0f);
+    std::uint32_t shaded[WallTextures::kSize + 1];
+    for (int v = 0; v < side; ++v)
+        shaded[v] = scale_rgb(texels[v], shade);
+    shaded[side] = shaded[side - 1];
+
+    const float texels_per_px = (w.v1 - w.v0) * static_cast<float>(side) / span_h;
+    const float v_start = w.v0 * static_cast<float>(side) + (static_cast<float>(ys) + 0.5f - w.y0) * texels_per_px;
+    const auto step = static_cast<std::uint32_t>(texels_per_px * 65536.0f);
+    std::uint32_t v = static_cast<std::uint32_t>(std::clamp(v_start, 0.0f, static_cast<float>(side)) * 65536.0f);
+
+    std::uint32_t *col = data_ + static_cast<std::size_t>(xs) * static_cast<std::size_t>(stride_);
+    for (int y = ys; y < ye; ++y, v += step)
+        col[y] = shaded[std::min(v >> 16, static_cast<std::uint32_t>(side))];
+    // Strips are a pixel or two wide: copy the first column to the rest.
+    for (int x = xs + 1; x < xe; ++x)
+        std::copy(col + ys, col + ye, col + static_cast<std::size_t>(x - xs) * static_cast<std::size_t>(stride_) + ys);
+}
+
+void SoftwareFramebuffer::update_floor_rows(const FloorSpan &f)
+{
+    FloorRows &r = floor_rows_;
+    if (r.h == h_ && r.horizon == f.horizon && r.depth_scale == f.depth_scale && r.cell == f.cell && r.fog == f.fog)
+        return;
+    r.h = h_;
+    r.horizon = f.horizon;
+    r.depth_scale = f.depth_scale;
+    r.cell = f.cell;
+    r.fog = f.fog;
+
+    const auto n = static_cast<std::size_t>(h_);
+    r.depth.resize(n);
+    r.scale.resize(n);
+    r.side.resize(n);
+    r.inv_side.resize(n);
+    r.base.resize(n);
+    r.shade.resize(n);
+    for (std::size_t y = 0; y < n; ++y)
+    {
+        // Rows at the horizon would see infinitely far; walls hide them
+        // anyway, the cap only keeps the texel maths finite.
+        constexpr float kMaxDepth = 65536.0f;
+        const float dy = std::max(std::fabs(static_cast<float>(y) + 0.5f - f.horizon), 1e-3f);
+        const float depth = std::min(f.depth_scale / dy, kMaxDepth);
+        // A texture repeat spans 2 * depth_scale / depth pixels across.
+        const int level = WallTextures::level_for_height(2.0f * f.depth_scale / depth);
+        const int side = WallTextures::kSize >> level;
+        r.depth[y] = depth;
+        r.side[y] = static_cast<float>(side);
+        r.inv_side[y] = 1.0f / static_cast<float>(side);
+        r.scale[y] = static_cast<float>(side) / f.cell;
+        r.base[y] = static_cast<float>(textures_->level(0, level) - textures_->level(0, 0));
+        const auto shade = static_cast<std::uint64_t>(256.0f / (1.0f + f.fog * depth * depth));
+        r.shade[y] = shade * 0x0001000100010001ull;
+    }
+}
+
+// Rows [ys, ye) of one pixel column, all on the same side of the horizon:
+// four rows per step work out the world point, wrap it into the row's mip
+// and fetch and shade the texels.
+void SoftwareFramebuffer::cast_floor(std::uint32_t *col, const int ys, const int ye, const FloorSpan &f,
+                                     const std::uint32_t *texels) const noexcept
+{
+    const FloorRows &r = floor_rows_;
+    int y = ys;
+#if TRYDOOM_X86_64
+    const __m128 px = _mm_set1_ps(f.px);
+    const __m128 py = _mm_set1_ps(f.py);
+    const __m128 dx = _mm_set1_ps(f.dir_x);
+    const __m128 dy = _mm_set1_ps(f.dir_y);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    // No _mm_floor_ps in SSE2: truncate, then step down where that rounded up.
+    const auto floor4 = [&](const __m128 v) {
+        const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), one));
+    };
+    // Texel offset of a world coordinate wrapped into [0, side).
+    const auto wrap = [&](const __m128 t, const __m128 side, const __m128 inv_side) {
+        const __m128 w = _mm_sub_ps(t, _mm_mul_ps(side, floor4(_mm_mul_ps(t, inv_side))));
+        return _mm_min_ps(_mm_max_ps(floor4(w), _mm_setzero_ps()), _mm_sub_ps(side, one));
+    };
+    for (; y + 4 <= ye; y += 4)
+    {
+        const auto i = static_cast<std::size_t>(y);
+        const __m128 depth = _mm_loadu_ps(r.depth.data() + i);
+        const __m128 scale = _mm_loadu_ps(r.scale.data() + i);
+        const __m128 side = _mm_loadu_ps(r.side.data() + i);
+        const __m128 inv_side = _mm_loadu_ps(r.inv_side.data() + i);
+        const __m128 u = wrap(_mm_mul_ps(_mm_add_ps(px, _mm_mul_ps(dx, depth)), scale), side, inv_side);
+        const __m128 v = wrap(_mm_mul_ps(_mm_add_ps(py, _mm_mul_ps(dy, depth)), scale), side, inv_side);
+        // Column-major mips: texel (u, v) at base + u * side + v.
+        const __m128 at = _mm_add_ps(_mm_loadu_ps(r.base.data() + i), _mm_add_ps(_mm_mul_ps(u, side), v));
+        alignas(16) std::int32_t idx[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(idx), _mm_cvttps_epi32(at));
+        const __m128i tex = _mm_set_epi32(static_cast<int>(texels[idx[3]]), static_cast<int>(texels[idx[2]]),
+                                          static_cast<int>(texels[idx[1]]), static_cast<int>(texels[idx[0]]));
+
+        // Channels widened to 16 bits, times the row's fog, back to bytes.
+        const __m128i shade_lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r.shade.data() + i));
+        const __m128i shade_hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r.shade.data() + i + 2));
+        const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(tex, zero), shade_lo), 8);
+        const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(tex, zero), shade_hi), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(col + y), _mm_or_si128(_mm_packus_epi16(lo, hi), alpha));
+    }
+#endif
+    for (; y < ye; ++y)
+    {
+        const auto i = static_cast<std::size_t>(y);
+        const float side = r.side[i];
+        const auto wrap = [&](const float t) {
+            const float w = t - side * std::floor(t * r.inv_side[i]);
+            return std::clamp(std::floor(w), 0.0f, side - 1.0f);
+        };
+        const float u = wrap((f.px + f.dir_x * r.depth[i]) * r.scale[i]);
+        const float v = wrap((f.py + f.dir_y * r.depth[i]) * r.scale[i]);
+        col[y] = scale_rgb(texels[static_cast<std::size_t>(r.base[i] + u * side + v)],
+                           static_cast<std::uint32_t>(r.shade[i] & 0xffffu));
+    }
+}
+
+// Every pixel column of the strip shows the same ray, so the first one is
+// cast and copied, as in push_wall.
+void SoftwareFramebuffer::push_floor(const FloorSpan &f)
+{
+    if (!textures_)
+        return;
+
+    const int xs = std::max(pixel_edge(f.x0), 0);
+    const int xe = std::min(pixel_edge(f.x0 + f.width), w_);
+    const int vs = std::max(pixel_edge(f.view_y0), 0);
+    const int ve = std::min(pixel_edge(f.view_y1), h_);
+    if (xs >= xe || vs >= ve)
+        return;
+    update_floor_rows(f);
+
+    const int horizon = pixel_edge(f.horizon);
+    const int ce = std::clamp(std::min(pixel_edge(f.ceiling_y1), horizon), vs, ve);
+    const int fs = std::clamp(std::max(pixel_edge(f.floor_y0), horizon), vs, ve);
+
+    std::uint32_t *col = data_ + static_cast<std::size_t>(xs) * static_cast<std::size_t>(stride_);
+    cast_floor(col, vs, ce, f, textures_->level(WallTextures::index_for_tile(f.ceiling_tile), 0));
+    cast_floor(col, fs, ve, f, textures_->level(WallTextures::index_for_tile(f.floor_tile), 0));
+    for (int x = xs + 1; x < xe; ++x)
+    {
+        std::uint32_t *dst = col + static_cast<std::size_t>(x - xs) * static_cast<std::size_t>(stride_);
+        std::copy(col + vs, col + ce, dst + vs);
+        std::copy(col + fs, col + ve, dst + fs);
+    }
+}
+
+// One pixel per step along the major axis; debug rays and the player
+// marker are the only lines, so nothing fancier is needed.
+void SoftwareFramebuffer::push_line(float x0, float y0, float x1, float y1,
+                                    float r, float g, float b)
+{
+    const std::uint32_t rgba = pack_rgba(r, g, b);
+    const float dx = x1 - x0;
+    const float dy = y1 - y0;
+    const int steps = static_cast<int>(std::ceil(std::max(std::fabs(dx), std::fabs(dy))));
+    const float inv = steps > 0 ? 1.0f / static_cast<float>(steps) : 0.0f;
+    for (int i = 0; i <= steps; ++i)
+    {
+        const float t = static_cast<float>(i) * inv;
+        const auto x = static_cast<int>(std::floor(x0 + dx * t));
+        const auto y = static_cast<int>(std::floor(y0 + dy * t));
+        if (static_cast<unsigned>(x) < static_cast<unsigned>(w_) && static_cast<unsigned>(y) < static_cast<unsigned>(h_))
+            data_[static_cast<std::size_t>(x) * static_cast<std::size_t>(stride_) + static_cast<std::size_t>(y)] = rgba;
+    }
+}
+
+void SoftwareFramebuffer::copy_rows(std::uint32_t *dst) const
+{
+    // Tiles keep both the column reads and the row writes in cache.
+    constexpr int kTile = 32;
+    for (int x0 = 0; x0 < w_; x0 += kTile)
+    {
+        const int x1 = std::min(x0 + kTile, w_);
+        for (int y0 = 0; y0 < h_; y0 += kTile)
+        {
+            const int y1 = std::min(y0 + kTile, h_);
+            for (int x = x0; x < x1; ++x)
+            {
+                const std::uint32_t *src = data_ + static_cast<std::size_t>(x) * static_cast<std::size_t>(stride_);
+                for (int y = y0; y < y1; ++y)
+                    dst[static_cast<std::size_t>(y) * static_cast<std::size_t>(w_) + static_cast<std::size_t>(x)] = src[y];
+            }
+        }
+    }
+}
+
+bool SoftwareFramebuffer::write_ppm(const std::string &path) const
+{
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<std::uint32_t> rows(static_cast<std::size_t>(w_) * static_cast<std::size_t>(h_));
+    copy_rows(rows.data());
+    std::vector<unsigned char> rgb(rows.size() * 3);
+    for (std::size_t i = 0; i < rows.size(); ++i)
+    {
+        rgb[i * 3 + 0] = static_cast<unsigned char>(rows[i]);
+        rgb[i * 3 + 1] = static_cast<unsigned char>(rows[i] >> 8);
+        rgb[i * 3 + 2] = static_cast<unsigned char>(rows[i] >> 16);
+    }
+
+    bool ok = std::fprintf(f, "P6\n%d %d\n255\n", w_, h_) > 0;
+    ok = ok && std::fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+    ok = std::fclose(f) == 0 && ok;
+
+    if (!ok)
+        std::fprintf(stderr, "Failed writing %s\n", path.c_str());
+    return ok;
+}
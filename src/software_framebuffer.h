@@ -0,0 +1,89 @@
+#pragma once
+
+#include "render_sink.h"
+#include "wall_textures.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU render target for cast_and_draw: columns, quads and lines are
+// rasterised straight into RGBA8 pixels (pack_rgba layout), no GL needed.
+// Pixels are stored column-major, so every wall strip is a set of
+// contiguous vertical spans filled with SIMD stores; copy_rows transposes
+// for anything that wants an ordinary row-major image. A framebuffer can
+// also draw into a tile of another one (view_tile), so several threads can
+// render disjoint tiles of one atlas without copies.
+class SoftwareFramebuffer final : public RenderSink
+{
+public:
+    SoftwareFramebuffer() = default;
+
+    SoftwareFramebuffer(const SoftwareFramebuffer &) = delete;
+    SoftwareFramebuffer &operator=(const SoftwareFramebuffer &) = delete;
+
+    // Keeps the pixels when the size is unchanged; stops viewing a tile.
+    void resize(int w, int h);
+    // Draws into the w x h tile at (x, y) of atlas, clipped to it, instead
+    // of into owned pixels, with the atlas's textures and clear colour. The
+    // atlas must outlive the view and not be resized meanwhile.
+    void view_tile(const SoftwareFramebuffer &atlas, int x, int y, int w, int h) noexcept;
+    void set_clear_color(std::uint32_t rgba) noexcept { clear_rgba_ = rgba; }
+    // Without textures, push_wall draws flat strips. Not owned.
+    void set_wall_textures(const WallTextures *textures) noexcept { textures_ = textures; }
+    void clear() noexcept;
+
+    void push_quad(float x0, float y0, float x1, float y1, float r, float g, float b) override;
+    void push_line(float x0, float y0, float x1, float y1, float r, float g, float b) override;
+    void push_column(float x0, float width, float y0, float y1, float r, float g, float b) override;
+    void push_wall(const WallSpan &w) override;
+    [[nodiscard]] bool casts_floors() const noexcept override { return textures_ != nullptr; }
+    void push_floor(const FloorSpan &f) override;
+
+    [[nodiscard]] int width() const noexcept { return w_; }
+    [[nodiscard]] int height() const noexcept { return h_; }
+    // Pixel (x, y) is at columns()[x * stride() + y]; stride() is height()
+    // unless this views a tile.
+    [[nodiscard]] const std::uint32_t *columns() const noexcept { return data_; }
+    [[nodiscard]] int stride() const noexcept { return stride_; }
+    [[nodiscard]] std::uint32_t pixel(const int x, const int y) const noexcept
+    {
+        return data_[static_cast<std::size_t>(x) * static_cast<std::size_t>(stride_) + static_cast<std::size_t>(y)];
+    }
+
+    // Writes width() * height() pixels, row by row, to dst.
+    void copy_rows(std::uint32_t *dst) const;
+    // Binary PPM (P6), for headless runs; prints the reason on failure.
+    [[nodiscard]] bool write_ppm(const std::string &path) const;
+
+private:
+    // What every pixel row of the floor / ceiling shares, as arrays the
+    // floor kernel loads four rows at a time. Rebuilt when the horizon,
+    // depth scale, cell, fog or height change, so normally once.
+    struct FloorRows
+    {
+        float horizon = 0.0f, depth_scale = 0.0f, cell = 0.0f, fog = 0.0f;
+        int h = -1;
+        std::vector<float> depth;      // view depth
+        std::vector<float> scale;      // texels per world unit of the row's mip
+        std::vector<float> side;       // mip side in texels
+        std::vector<float> inv_side;
+        std::vector<float> base;       // texel offset of the mip within a texture
+        // Fog, 256 = full brightness, repeated for the four channels so
+        // two rows load as one vector of 16-bit factors.
+        std::vector<std::uint64_t> shade;
+    };
+
+    void fill_rect(float x0, float y0, float x1, float y1, std::uint32_t rgba) noexcept;
+    void update_floor_rows(const FloorSpan &f);
+    void cast_floor(std::uint32_t *col, int ys, int ye, const FloorSpan &f, const std::uint32_t *texels) const noexcept;
+
+    int w_ = 0;
+    int h_ = 0;
+    std::uint32_t clear_rgba_ = 0xff000000u;
+    const WallTextures *textures_ = nullptr;
+    std::vector<std::uint32_t> pixels_;
+    std::uint32_t *data_ = nullptr; // pixels_, or the viewed tile
+    int stride_ = 0;
+    FloorRows floor_rows_;
+};
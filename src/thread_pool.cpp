@@ -0,0 +1,110 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(const int threads)
+{
+    start(std::max(threads, 1) - 1);
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+void ThreadPool::resize(const int threads)
+{
+    const int n = std::max(threads, 1);
+    if (n == size())
+        return;
+    stop();
+    start(n - 1);
+}
+
+int ThreadPool::hardware_threads() noexcept
+{
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+void ThreadPool::start(const int workers)
+{
+    // New workers wait for the next parallel_for, not the ones before them.
+    std::uint64_t generation = 0;
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = false;
+        generation = generation_;
+    }
+    workers_.reserve(static_cast<std::size_t>(workers));
+    for (int i = 0; i < workers; ++i)
+        workers_.emplace_back([this, generation] { worker_loop(generation); });
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    start_cv_.notify_all();
+    for (std::thread &t : workers_)
+        t.join();
+    workers_.clear();
+}
+
+void ThreadPool::drain(const std::function<void(int)> &fn, const int tasks)
+{
+    for (int i = next_.fetch_add(1, std::memory_order_relaxed); i < tasks;
+         i = next_.fetch_add(1, std::memory_order_relaxed))
+        fn(i);
+}
+
+void ThreadPool::worker_loop(std::uint64_t seen)
+{
+    for (;;)
+    {
+        const std::function<void(int)> *job = nullptr;
+        int tasks = 0;
+        {
+            std::unique_lock lock(mutex_);
+            start_cv_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+            if (stopping_)
+                return;
+            seen = generation_;
+            job = job_;
+            tasks = tasks_;
+        }
+
+        drain(*job, tasks);
+
+        std::lock_guard lock(mutex_);
+        if (--busy_ == 0)
+            done_cv_.notify_one();
+    }
+}
+
+void ThreadPool::parallel_for(const int tasks, const std::function<void(int)> &fn)
+{
+    if (workers_.empty() || tasks <= 1)
+    {
+        for (int i = 0; i < tasks; ++i)
+            fn(i);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        job_ = &fn;
+        tasks_ = tasks;
+        busy_ = static_cast<int>(workers_.size());
+        next_.store(0, std::memory_order_relaxed);
+        ++generation_;
+    }
+    start_cv_.notify_all();
+
+    drain(fn, tasks);
+
+    std::unique_lock lock(mutex_);
+    done_cv_.wait(lock, [&] { return busy_ == 0; });
+    job_ = nullptr;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent workers for data-parallel loops. The calling thread takes part
+// in every parallel_for, so a pool of size N owns N - 1 std::threads.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = 1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    [[nodiscard]] int size() const noexcept { return static_cast<int>(workers_.size()) + 1; }
+    void resize(int threads);
+
+    // Runs fn(i) for every i in [0, tasks) and returns once all are done.
+    // Tasks are claimed in order from a shared counter.
+    void parallel_for(int tasks, const std::function<void(int)> &fn);
+
+    [[nodiscard]] static int hardware_threads() noexcept;
+
+private:
+    void start(int workers);
+    void stop();
+    void worker_loop(std::uint64_t seen);
+    void drain(const std::function<void(int)> &fn, int tasks);
+
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(int)> *job_ = nullptr;
+    int tasks_ = 0;
+    int busy_ = 0;
+    std::uint64_t generation_ = 0;
+    bool stopping_ = false;
+
+    std::atomic<int> next_{0};
+};
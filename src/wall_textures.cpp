@@ -0,0 +1,119 @@
+#include "wall_textures.h"
+#include "render_sink.h"
+
+
+namespace
+{
+
+constexpr int kSize = WallTextures::kSize;
+
+std::uint32_t hash2(const int x, const int y, const std::uint32_t seed) noexcept
+{
+    std::uint32_t h = static_cast<std::uint32_t>(x) * 0x27d4eb2du ^ static_cast<std::uint32_t>(y) * 0x165667b1u ^ seed;
+    h ^= h >> 15;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// Uniform noise in [-amount, amount].
+float noise(const int x, const int y, const std::uint32_t seed, const float amount) noexcept
+{
+    return (static_cast<float>(hash2(x, y, seed) & 0xffffu) / 65535.0f * 2.0f - 1.0f) * amount;
+}
+
+std::uint32_t shaded(const float r, const float g, const float b, const float k) noexcept
+{
+    return pack_rgba(r * k, g * k, b * k);
+}
+
+// u runs along the wall, v down it.
+std::uint32_t brick(const int u, const int v) noexcept
+{
+    const int row = v / 8;
+    const int shift = row & 1 ? 8 : 0;
+    if (v % 8 == 7 || (u + shift) % 16 == 15)
+        return shaded(0.55f, 0.53f, 0.5f, 1.0f + noise(u, v, 1, 0.08f));
+    const float k = 0.9f + noise((u + shift) / 16, row, 2, 0.12f) + noise(u, v, 3, 0.06f);
+    return shaded(0.62f, 0.24f, 0.16f, k);
+}
+
+std::uint32_t stone(const int u, const int v) noexcept
+{
+    const int bx = u / 32;
+    const int by = (v + (bx & 1) * 16) / 32;
+    const int lu = u % 32;
+    const int lv = (v + (bx & 1) * 16) % 32;
+    if (lu == 0 || lv == 0)
+        return shaded(0.25f, 0.25f, 0.27f, 1.0f);
+    const float edge = lu == 1 || lv == 1 ? 1.12f : lu == 31 || lv == 31 ? 0.82f : 1.0f;
+    const float k = edge * (0.85f + noise(bx, by, 4, 0.1f) + noise(u, v, 5, 0.1f));
+    return shaded(0.55f, 0.55f, 0.58f, k);
+}
+
+std::uint32_t wood(const int u, const int v) noexcept
+{
+    const int plank = u / 11;
+    if (u % 11 == 10)
+        return shaded(0.2f, 0.12f, 0.06f, 1.0f);
+    const float grain = noise(plank * 64 + u % 11 / 3, v / 5, 6, 0.1f);
+    const float k = 0.9f + noise(plank, 0, 7, 0.12f) + grain + noise(u, v, 8, 0.04f);
+    return shaded(0.55f, 0.36f, 0.18f, k);
+}
+
+std::uint32_t metal(const int u, const int v) noexcept
+{
+    const int lu = u % 32;
+    const int lv = v % 32;
+    if (lu == 0 || lv == 0)
+        return shaded(0.2f, 0.22f, 0.26f, 1.0f);
+    const bool rivet = (lu == 3 || lu == 28) && (lv == 3 || lv == 28);
+    const float k = rivet ? 1.35f : 0.95f + noise(u, v, 9, 0.04f) + (lv < 16 ? 0.05f : -0.05f);
+    return shaded(0.45f, 0.5f, 0.58f, k);
+}
+
+std::uint32_t average(const std::uint32_t a, const std::uint32_t b, const std::uint32_t c,
+                      const std::uint32_t d) noexcept
+{
+    std::uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        const std::uint32_t sum = (a >> shift & 0xffu) + (b >> shift & 0xffu) + (c >> shift & 0xffu)
+                                  + (d >> shift & 0xffu);
+        out |= (sum + 2) / 4 << shift;
+    }
+    return out;
+}
+
+} // namespace
+
+WallTextures::WallTextures()
+    : texels_(kTexelsPerTexture * kCount)
+{
+    using Generator = std::uint32_t (*)(int, int) noexcept;
+    constexpr Generator kGenerators[kCount] = {brick, stone, wood, metal};
+
+    for (int t = 0; t < kCount; ++t)
+    {
+        auto *base = texels_.data() + static_cast<std::size_t>(t) * kTexelsPerTexture;
+        for (int u = 0; u < kSize; ++u)
+            for (int v = 0; v < kSize; ++v)
+                base[u * kSize + v] = kGenerators[t](u, v);
+
+        // Box-filter each level from the one above; columns stay columns.
+        for (int l = 1; l < kLevels; ++l)
+        {
+            const std::uint32_t *src = base + level_offset(l - 1);
+            std::uint32_t *dst = base + level_offset(l);
+            const int side = kSize >> l;
+            const int src_side = side * 2;
+            for (int u = 0; u < side; ++u)
+            {
+                const std::uint32_t *c0 = src + static_cast<std::size_t>(u * 2) * src_side;
+                const std::uint32_t *c1 = c0 + src_side;
+                for (int v = 0; v < side; ++v)
+                    dst[u * side + v] = average(c0[v * 2], c0[v * 2 + 1], c1[v * 2], c1[v * 2 + 1]);
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Procedural wall textures, one per tile type, each with a full mip chain.
+// Every level is stored column-major (texel (u, v) at u * side + v), so a
+// screen column walks one contiguous run of memory instead of striding a
+// whole row per pixel. Texels use the pack_rgba layout.
+class WallTextures
+{
+public:
+    static constexpr int kSizeLog2 = 6;
+    static constexpr int kSize = 1 << kSizeLog2; // level 0 is kSize x kSize
+    static constexpr int kLevels = kSizeLog2 + 1;
+    static constexpr int kCount = 4;
+
+    WallTextures();
+
+    WallTextures(const WallTextures &) = delete;
+    WallTextures &operator=(const WallTextures &) = delete;
+
+    // Wall tiles are 1..255; they cycle through the textures.
+    [[nodiscard]] static int index_for_tile(const std::uint8_t tile) noexcept
+    {
+        return (tile + kCount - 1) % kCount;
+    }
+
+    // Finest level that is no taller than a wall drawn wall_h pixels high,
+    // so a screen column never skips texels.
+    [[nodiscard]] static int level_for_height(const float wall_h) noexcept
+    {
+        int level = 0;
+        while (level + 1 < kLevels && static_cast<float>(kSize >> level) > wall_h)
+            ++level;
+        return level;
+    }
+
+    // (kSize >> level)^2 texels of one texture level, column-major.
+    [[nodiscard]] const std::uint32_t *level(const int texture, const int lvl) const noexcept
+    {
+        return texels_.data() + static_cast<std::size_t>(texture) * kTexelsPerTexture + level_offset(lvl);
+    }
+    [[nodiscard]] const std::uint32_t *column(const int texture, const int lvl, const int u) const noexcept
+    {
+        return level(texture, lvl) + static_cast<std::size_t>(u) * static_cast<std::size_t>(kSize >> lvl);
+    }
+
+private:
+    static constexpr std::size_t level_offset(const int lvl) noexcept
+    {
+        std::size_t offset = 0;
+        for (int l = 0; l < lvl; ++l)
+            offset += static_cast<std::size_t>(kSize >> l) * static_cast<std::size_t>(kSize >> l);
+        return offset;
+    }
+    // Sum of (kSize >> l)^2 over every level: a geometric series in 4.
+    static constexpr std::size_t kTexelsPerTexture = (std::size_t{kSize} * kSize * 4 - 1) / 3;
+
+    std::vector<std::uint32_t> texels_;
+};